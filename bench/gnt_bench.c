@@ -0,0 +1,783 @@
+/*
+ * gnt_bench.c - Generic Nibble Trie benchmarks
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <search.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "gnt.h"
+
+#define BENCH_SAMPLE 8 // One operation in this many is timed on its own for the latency percentiles
+#define BENCH_THREADS_MAX 64
+#define BENCH_HASH_LOAD 70 // Percentage of used slots past which the hash table doubles
+#define BENCH_STRING_SIZE 64 // Room given to each generated string key
+
+typedef struct bench_engine // Structure under test, keys are integers or pointers to strings
+{
+    const char* name;
+    bool concurrent; // Safe to call from several threads, others are serialized by the benchmark
+    void* (*create)(bool strings, bool concurrent);
+    void (*destroy)(void* table);
+    void (*insert)(void* table, gnt_key_t key, gnt_data_t data);
+    gnt_data_t (*search)(void* table, gnt_key_t key);
+    void (*delete)(void* table, gnt_key_t key);
+} bench_engine_t;
+
+typedef struct bench_hash // Open addressing with linear probing and tombstones
+{
+    gnt_key_t* keys;
+    gnt_data_t* data;
+    uint8_t* states; // 0 when empty, 1 when used, 2 when deleted
+    size_t capacity;
+    size_t used; // Used and deleted slots
+    bool strings;
+} bench_hash_t;
+
+typedef struct bench_tree // Red-black tree of the C library
+{
+    void* root;
+    bool strings;
+} bench_tree_t;
+
+typedef struct bench_item // Pair stored in the tree
+{
+    gnt_key_t key;
+    gnt_data_t data;
+} bench_item_t;
+
+typedef struct bench_run // Table, keys and measures shared by the threads of a timed phase
+{
+    const bench_engine_t* engine;
+    void* table;
+    mtx_t mutex; // Serializes engines that are not concurrent
+    const gnt_key_t* keys;
+    size_t count; // Keys available in keys
+    size_t operations; // Operations per thread
+    uint8_t reads; // Percentage of searches in mixes, the rest split evenly between inserts and deletes
+    uint8_t threads;
+} bench_run_t;
+
+typedef struct bench_worker // Thread of a timed phase
+{
+    bench_run_t* run;
+    uint8_t index;
+    uint64_t seed;
+    uint32_t* latencies;
+    size_t sampled;
+} bench_worker_t;
+
+typedef enum bench_phase
+{
+    BENCH_INSERT,
+    BENCH_SEARCH,
+    BENCH_DELETE,
+    BENCH_MIX,
+    BENCH_CHURN
+} bench_phase_t;
+
+static const char* bench_phases[] = {"insert", "search", "delete", "mix", "churn"};
+
+static uint64_t bench_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static uint64_t bench_random(uint64_t* state)
+{
+    // splitmix64, enough for key generation and shuffles
+    uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+
+    return z ^ (z >> 31);
+}
+
+static size_t bench_rss(void)
+{
+    long pages = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if (statm)
+    {
+        if (2 != fscanf(statm, "%ld %ld", &pages, &resident))
+        {
+            resident = 0;
+        }
+
+        fclose(statm);
+    }
+
+    return (size_t) resident * (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static size_t bench_peak_rss(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (size_t) usage.ru_maxrss * 1024;
+}
+
+static uint64_t bench_hash_key(gnt_key_t key, bool strings)
+{
+    if (!strings)
+    {
+        uint64_t state = key;
+        return bench_random(&state);
+    }
+
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325u;
+
+    for (const char* c = (const char*) key; *c; c++)
+    {
+        hash = (hash ^ (uint8_t) *c) * 0x100000001B3u;
+    }
+
+    return hash;
+}
+
+static bool bench_equal(gnt_key_t a, gnt_key_t b, bool strings)
+{
+    return strings ? 0 == strcmp((const char*) a, (const char*) b) : a == b;
+}
+
+static void* bench_hash_create(bool strings, bool concurrent)
+{
+    (void) concurrent;
+
+    bench_hash_t* hash = calloc(1, sizeof(bench_hash_t));
+
+    hash->capacity = 16;
+    hash->keys = calloc(hash->capacity, sizeof(gnt_key_t));
+    hash->data = calloc(hash->capacity, sizeof(gnt_data_t));
+    hash->states = calloc(hash->capacity, 1);
+    hash->strings = strings;
+
+    return hash;
+}
+
+static void bench_hash_destroy(void* table)
+{
+    bench_hash_t* hash = table;
+
+    free(hash->keys);
+    free(hash->data);
+    free(hash->states);
+    free(hash);
+}
+
+static size_t bench_hash_find(bench_hash_t* hash, gnt_key_t key, bool* found)
+{
+    size_t mask = hash->capacity - 1;
+    size_t slot = bench_hash_key(key, hash->strings) & mask;
+    size_t reusable = SIZE_MAX;
+
+    while (hash->states[slot])
+    {
+        if (1 == hash->states[slot] && bench_equal(hash->keys[slot], key, hash->strings))
+        {
+            *found = true;
+            return slot;
+        }
+
+        if (2 == hash->states[slot] && SIZE_MAX == reusable)
+        {
+            reusable = slot;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    *found = false;
+    return SIZE_MAX == reusable ? slot : reusable;
+}
+
+static void bench_hash_insert(void* table, gnt_key_t key, gnt_data_t data);
+
+static void bench_hash_grow(bench_hash_t* hash)
+{
+    bench_hash_t old = *hash;
+    size_t live = 0;
+
+    for (size_t i = 0; i < old.capacity; i++)
+    {
+        live += 1 == old.states[i];
+    }
+
+    // Rehashing also drops the tombstones, so the table only doubles when it is really full
+    hash->capacity = live * 100 / BENCH_HASH_LOAD >= old.capacity / 2 ? old.capacity * 2 : old.capacity;
+    hash->keys = calloc(hash->capacity, sizeof(gnt_key_t));
+    hash->data = calloc(hash->capacity, sizeof(gnt_data_t));
+    hash->states = calloc(hash->capacity, 1);
+    hash->used = 0;
+
+    for (size_t i = 0; i < old.capacity; i++)
+    {
+        if (1 == old.states[i])
+        {
+            bench_hash_insert(hash, old.keys[i], old.data[i]);
+        }
+    }
+
+    free(old.keys);
+    free(old.data);
+    free(old.states);
+}
+
+static void bench_hash_insert(void* table, gnt_key_t key, gnt_data_t data)
+{
+    bench_hash_t* hash = table;
+
+    if ((hash->used + 1) * 100 > hash->capacity * BENCH_HASH_LOAD)
+    {
+        bench_hash_grow(hash);
+    }
+
+    bool found;
+    size_t slot = bench_hash_find(hash, key, &found);
+
+    if (!found)
+    {
+        hash->used += 0 == hash->states[slot];
+        hash->states[slot] = 1;
+        hash->keys[slot] = key;
+    }
+
+    hash->data[slot] = data;
+}
+
+static gnt_data_t bench_hash_search(void* table, gnt_key_t key)
+{
+    bench_hash_t* hash = table;
+    bool found;
+    size_t slot = bench_hash_find(hash, key, &found);
+
+    return found ? hash->data[slot] : 0;
+}
+
+static void bench_hash_delete(void* table, gnt_key_t key)
+{
+    bench_hash_t* hash = table;
+    bool found;
+    size_t slot = bench_hash_find(hash, key, &found);
+
+    if (found)
+    {
+        hash->states[slot] = 2;
+    }
+}
+
+static int bench_compare_integers(const void* a, const void* b)
+{
+    gnt_key_t x = ((const bench_item_t*) a)->key;
+    gnt_key_t y = ((const bench_item_t*) b)->key;
+
+    return (x > y) - (x < y);
+}
+
+static int bench_compare_strings(const void* a, const void* b)
+{
+    return strcmp((const char*) ((const bench_item_t*) a)->key, (const char*) ((const bench_item_t*) b)->key);
+}
+
+static void* bench_tree_create(bool strings, bool concurrent)
+{
+    (void) concurrent;
+
+    bench_tree_t* tree = calloc(1, sizeof(bench_tree_t));
+    tree->strings = strings;
+
+    return tree;
+}
+
+static void bench_tree_destroy(void* table)
+{
+    bench_tree_t* tree = table;
+
+    tdestroy(tree->root, free);
+    free(tree);
+}
+
+static void bench_tree_insert(void* table, gnt_key_t key, gnt_data_t data)
+{
+    bench_tree_t* tree = table;
+    bench_item_t* item = malloc(sizeof(bench_item_t));
+
+    item->key = key;
+    item->data = data;
+
+    bench_item_t** stored = tsearch(item, &tree->root, tree->strings ? bench_compare_strings : bench_compare_integers);
+
+    if (*stored != item)
+    {
+        (*stored)->data = data;
+        free(item);
+    }
+}
+
+static gnt_data_t bench_tree_search(void* table, gnt_key_t key)
+{
+    bench_tree_t* tree = table;
+    bench_item_t item = {key, 0};
+    bench_item_t** stored = tfind(&item, &tree->root, tree->strings ? bench_compare_strings : bench_compare_integers);
+
+    return stored ? (*stored)->data : 0;
+}
+
+static void bench_tree_delete(void* table, gnt_key_t key)
+{
+    bench_tree_t* tree = table;
+    bench_item_t item = {key, 0};
+    int (*compare)(const void*, const void*) = tree->strings ? bench_compare_strings : bench_compare_integers;
+    bench_item_t** stored = tfind(&item, &tree->root, compare);
+
+    if (stored)
+    {
+        bench_item_t* found = *stored;
+        tdelete(&item, &tree->root, compare);
+        free(found);
+    }
+}
+
+static void* bench_gnt_create(bool strings, bool concurrent)
+{
+    gnt_cfg_t cfg = {0};
+
+    cfg.accessor = strings ? gnt_accessor_string : NULL;
+    cfg.flags = concurrent ? GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK : 0;
+
+    return gnt_create(&cfg);
+}
+
+static void bench_gnt_destroy(void* table)
+{
+    gnt_destroy(table);
+}
+
+static void bench_gnt_insert(void* table, gnt_key_t key, gnt_data_t data)
+{
+    gnt_insert(table, key, data);
+}
+
+static gnt_data_t bench_gnt_search(void* table, gnt_key_t key)
+{
+    return gnt_search(table, key);
+}
+
+static void bench_gnt_delete(void* table, gnt_key_t key)
+{
+    gnt_delete(table, key);
+}
+
+static const bench_engine_t bench_engines[] =
+{
+    {"gnt", true, bench_gnt_create, bench_gnt_destroy, bench_gnt_insert, bench_gnt_search, bench_gnt_delete},
+    {"hash", false, bench_hash_create, bench_hash_destroy, bench_hash_insert, bench_hash_search, bench_hash_delete},
+    {"tree", false, bench_tree_create, bench_tree_destroy, bench_tree_insert, bench_tree_search, bench_tree_delete}
+};
+
+#define BENCH_ENGINES (sizeof(bench_engines) / sizeof(bench_engines[0]))
+
+static int bench_compare_latencies(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+static GNT_FORCE_INLINE void bench_operation(bench_run_t* run, bench_phase_t phase, uint64_t* seed, size_t i)
+{
+    const bench_engine_t* engine = run->engine;
+    gnt_key_t key;
+
+    if (BENCH_MIX == phase || BENCH_CHURN == phase)
+    {
+        uint64_t pick = bench_random(seed);
+        key = run->keys[pick % run->count];
+
+        // Churn replaces a random key by another one, mixes draw from keys of which about half are stored
+        if (BENCH_CHURN == phase)
+        {
+            phase = (pick >> 32) & 1 ? BENCH_INSERT : BENCH_DELETE;
+        }
+        else
+        {
+            uint8_t roll = (pick >> 32) % 100;
+            phase = roll < run->reads ? BENCH_SEARCH : (roll - run->reads) & 1 ? BENCH_INSERT : BENCH_DELETE;
+        }
+    }
+    else
+    {
+        key = run->keys[i];
+    }
+
+    if (!engine->concurrent && run->threads > 1)
+    {
+        mtx_lock(&run->mutex);
+    }
+
+    switch (phase)
+    {
+        case BENCH_INSERT:
+            engine->insert(run->table, key, (gnt_data_t) i + 1);
+            break;
+        case BENCH_SEARCH:
+            engine->search(run->table, key);
+            break;
+        default:
+            engine->delete(run->table, key);
+            break;
+    }
+
+    if (!engine->concurrent && run->threads > 1)
+    {
+        mtx_unlock(&run->mutex);
+    }
+}
+
+static void bench_work(bench_worker_t* worker, bench_phase_t phase)
+{
+    bench_run_t* run = worker->run;
+    size_t first = worker->index * run->operations;
+
+    for (size_t i = first; i < first + run->operations; i++)
+    {
+        if (0 == i % BENCH_SAMPLE)
+        {
+            uint64_t start = bench_clock();
+            bench_operation(run, phase, &worker->seed, i);
+            uint64_t elapsed = bench_clock() - start;
+
+            worker->latencies[worker->sampled++] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed;
+        }
+        else
+        {
+            bench_operation(run, phase, &worker->seed, i);
+        }
+    }
+}
+
+static int bench_mix_thread(void* worker)
+{
+    bench_work(worker, BENCH_MIX);
+    return 0;
+}
+
+static void bench_report(const char* workload, bench_phase_t phase, bench_run_t* run, bench_worker_t* workers, uint64_t elapsed, size_t stored, size_t bytes)
+{
+    size_t sampled = 0;
+
+    for (uint8_t i = 0; i < run->threads; i++)
+    {
+        sampled += workers[i].sampled;
+    }
+
+    uint32_t* latencies = malloc((sampled ? sampled : 1) * sizeof(uint32_t));
+    size_t merged = 0;
+
+    for (uint8_t i = 0; i < run->threads; i++)
+    {
+        memcpy(latencies + merged, workers[i].latencies, workers[i].sampled * sizeof(uint32_t));
+        merged += workers[i].sampled;
+    }
+
+    qsort(latencies, sampled, sizeof(uint32_t), bench_compare_latencies);
+
+    double operations = (double) run->operations * run->threads;
+
+    printf("%-14s %-7s %-5s %3u %9.2f %7u %7u %7u %9.1f %9.1f\n",
+           workload, bench_phases[phase], run->engine->name, run->threads,
+           elapsed ? operations * 1000.0 / elapsed : 0,
+           sampled ? latencies[sampled / 2] : 0,
+           sampled ? latencies[sampled * 99 / 100] : 0,
+           sampled ? latencies[sampled * 999 / 1000] : 0,
+           stored ? (double) bytes / stored : 0,
+           bench_peak_rss() / 1048576.0);
+
+    fflush(stdout);
+    free(latencies);
+}
+
+static void bench_phase(const char* workload, bench_phase_t phase, bench_run_t* run, size_t stored, size_t bytes)
+{
+    bench_worker_t workers[BENCH_THREADS_MAX];
+    thrd_t threads[BENCH_THREADS_MAX];
+
+    for (uint8_t i = 0; i < run->threads; i++)
+    {
+        workers[i] = (bench_worker_t) {run, i, 0x5EED0000u + i, malloc((run->operations / BENCH_SAMPLE + 1) * sizeof(uint32_t)), 0};
+    }
+
+    uint64_t start = bench_clock();
+
+    if (BENCH_MIX == phase)
+    {
+        for (uint8_t i = 1; i < run->threads; i++)
+        {
+            thrd_create(&threads[i], bench_mix_thread, &workers[i]);
+        }
+
+        bench_work(&workers[0], phase);
+
+        for (uint8_t i = 1; i < run->threads; i++)
+        {
+            thrd_join(threads[i], NULL);
+        }
+    }
+    else
+    {
+        bench_work(&workers[0], phase);
+    }
+
+    uint64_t elapsed = bench_clock() - start;
+
+    bench_report(workload, phase, run, workers, elapsed, stored, bytes);
+
+    for (uint8_t i = 0; i < run->threads; i++)
+    {
+        free(workers[i].latencies);
+    }
+}
+
+static void bench_shuffle(gnt_key_t* keys, size_t count, uint64_t seed)
+{
+    for (size_t i = count; i > 1; i--)
+    {
+        size_t j = bench_random(&seed) % i;
+        gnt_key_t key = keys[i - 1];
+        keys[i - 1] = keys[j];
+        keys[j] = key;
+    }
+}
+
+static gnt_key_t* bench_keys(const char* workload, size_t count, char** strings)
+{
+    gnt_key_t* keys = malloc(count * sizeof(gnt_key_t));
+    uint64_t seed = 42;
+
+    *strings = NULL;
+
+    if (0 == strcmp(workload, "dense-int"))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            keys[i] = i;
+        }
+    }
+    else if (0 == strcmp(workload, "random-string") || 0 == strcmp(workload, "prefix-string"))
+    {
+        bool prefixed = 'p' == workload[0];
+        char* text = *strings = malloc(count * BENCH_STRING_SIZE);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            char* key = text + i * BENCH_STRING_SIZE;
+
+            if (prefixed)
+            {
+                // URL-like keys, long runs shared between neighbours and a few distinct hosts
+                snprintf(key, BENCH_STRING_SIZE, "https://host%u.example.com/users/%08zu/feed", (unsigned) (i % 4), i);
+            }
+            else
+            {
+                uint8_t length = 8 + bench_random(&seed) % 24;
+
+                for (uint8_t c = 0; c < length; c++)
+                {
+                    key[c] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"[bench_random(&seed) % 62];
+                }
+
+                // Keeps random keys distinct
+                snprintf(key + length, BENCH_STRING_SIZE - length, "%zx", i);
+            }
+
+            keys[i] = (gnt_key_t) key;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            keys[i] = bench_random(&seed);
+        }
+    }
+
+    return keys;
+}
+
+static void bench_workload(const char* workload, const bench_engine_t* engine, size_t count, uint8_t threads)
+{
+    char* strings;
+    bool mixed = !strstr(workload, "-int") && !strstr(workload, "-string");
+    bool integers = mixed || strstr(workload, "-int");
+
+    // Mixes and churn draw from twice as many sparse keys as they store
+    size_t total = mixed ? count * 2 : count;
+    gnt_key_t* keys = bench_keys(mixed ? "sparse-int" : workload, total, &strings);
+
+    bench_run_t run = {.engine = engine, .keys = keys, .count = count, .operations = count, .threads = 1};
+
+    mtx_init(&run.mutex, mtx_plain);
+
+    // Each table is built in this process and measured from here, keys are already allocated
+    size_t resident = bench_rss();
+    run.table = engine->create(!integers, mixed);
+
+    bench_phase(workload, BENCH_INSERT, &run, 0, 0);
+
+    size_t bytes = bench_rss() - resident;
+
+    if (!mixed)
+    {
+        gnt_key_t* ordered = keys;
+
+        // Searches and deletes visit the keys in another order than they were inserted in
+        keys = malloc(count * sizeof(gnt_key_t));
+        memcpy(keys, ordered, count * sizeof(gnt_key_t));
+        bench_shuffle(keys, count, 7);
+        run.keys = keys;
+
+        bench_phase(workload, BENCH_SEARCH, &run, count, bytes);
+        bench_phase(workload, BENCH_DELETE, &run, count, bytes);
+
+        free(ordered);
+    }
+    else if (0 == strcmp(workload, "churn"))
+    {
+        run.count = total;
+        bench_phase(workload, BENCH_CHURN, &run, count, bytes);
+    }
+    else
+    {
+        run.count = total;
+        run.reads = 0 == strcmp(workload, "read-mostly") ? 95 : 50;
+
+        for (uint8_t n = 1; n <= threads; n = n < threads && n * 2 > threads ? threads : n * 2)
+        {
+            run.threads = n;
+            run.operations = count / n;
+            bench_phase(workload, BENCH_MIX, &run, count, bytes);
+        }
+    }
+
+    engine->destroy(run.table);
+    mtx_destroy(&run.mutex);
+    free(keys);
+    free(strings);
+}
+
+static void bench_usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [-n keys] [-t threads] [-e engine] [workload...]\n", program);
+    fprintf(stderr, "workloads: dense-int sparse-int random-string prefix-string read-mostly write-heavy churn\n");
+    fprintf(stderr, "engines: gnt hash tree, all by default\n");
+}
+
+int main(int argc, char** argv)
+{
+    static const char* workloads[] = {"dense-int", "sparse-int", "random-string", "prefix-string", "read-mostly", "write-heavy", "churn"};
+    size_t count = 1000000;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* only = NULL;
+    int option;
+
+    while (-1 != (option = getopt(argc, argv, "n:t:e:h")))
+    {
+        switch (option)
+        {
+            case 'n':
+                count = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = strtol(optarg, NULL, 0);
+                break;
+            case 'e':
+                only = optarg;
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 'h' == option ? 0 : 1;
+        }
+    }
+
+    if (!count || threads < 1)
+    {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    threads = threads > BENCH_THREADS_MAX ? BENCH_THREADS_MAX : threads;
+
+    const char** selected = optind < argc ? (const char**) argv + optind : workloads;
+    size_t selections = optind < argc ? (size_t) (argc - optind) : sizeof(workloads) / sizeof(workloads[0]);
+
+    printf("%-14s %-7s %-5s %3s %9s %7s %7s %7s %9s %9s\n", "workload", "phase", "table", "thr", "Mops/s", "p50ns", "p99ns", "p999ns", "bytes/key", "peakMiB");
+    fflush(stdout);
+
+    for (size_t w = 0; w < selections; w++)
+    {
+        for (size_t e = 0; e < BENCH_ENGINES; e++)
+        {
+            if (only && 0 != strcmp(only, bench_engines[e].name))
+            {
+                continue;
+            }
+
+            // A process per table, so that peak RSS and the allocator's state belong to it alone
+            pid_t child = fork();
+
+            if (0 == child)
+            {
+                bench_workload(selected[w], &bench_engines[e], count, (uint8_t) threads);
+                exit(0);
+            }
+
+            int status = 0;
+
+            if (child < 0 || child != waitpid(child, &status, 0) || !WIFEXITED(status) || 0 != WEXITSTATUS(status))
+            {
+                fprintf(stderr, "%s on %s failed\n", selected[w], bench_engines[e].name);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -24,344 +24,6140 @@
  * SOFTWARE.
  */
 
+#define _POSIX_C_SOURCE 200809L // ftruncate, fsync and fdatasync for journals
+#define _DEFAULT_SOURCE // syscall, to find the NUMA node of the calling thread
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <threads.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "gnt.h"
 
 #define GNT_HIGH_NIBBLE(byte)           (byte >> 4)
 #define GNT_LOW_NIBBLE(byte)            (byte & 0x0F)
 #define GNT_SELECT_KEY_BYTE(key, index) (key >> (8 * index))
+#define GNT_MAKE_BYTE(high, low)        ((high << 4) | low)
+
+#define GNT_BIT(nibble)                 (1u << (nibble))
+#define GNT_CHILDREN(object)            ((gnt_index_t) __builtin_popcount((object)->map))
+#define GNT_RANK(map, nibble)           ((gnt_index_t) __builtin_popcount((map) & (GNT_BIT(nibble) - 1)))
+#define GNT_FIRST(map)                  ((gnt_byte_t) __builtin_ctz(map))
+#define GNT_LAST(map)                   ((gnt_byte_t) (31 - __builtin_clz(map)))
+
+#define GNT_NIBBLE_SIZE(capacity)       (sizeof(gnt_nibble_t) + (capacity) * sizeof(gnt_node_t*))
+#define GNT_NODE_SIZE(capacity)         (sizeof(gnt_node_t) + (capacity) * sizeof(gnt_nibble_t*))
+
+// Child counts are not stored, the map's popcount gives them. Slots stay full pointers: 32-bit handles would
+// shrink a slot to 4 bytes but cost a decode on every level, and would not survive merges moving slabs across tries
+#define GNT_PREFIX_SIZE 11 // Fills the 16 bytes before the node's data along with its 5-byte header
+
+#define GNT_POOL_CLASSES                11 // Five nibble capacities followed by six node capacities
+#define GNT_NIBBLE_CLASS(capacity)      ((uint8_t) __builtin_ctz(capacity))
+#define GNT_NODE_CLASS(capacity)        ((uint8_t) (5 + ((capacity) ? __builtin_ctz(capacity) + 1 : 0)))
+#define GNT_SLAB_MIN                    1024
+#define GNT_SLAB_MAX                    (256 * 1024)
+
+#define GNT_BATCH_WIDTH 8 // Keys walked in lockstep by batched searches
+#define GNT_SPAN_BUFFER 64 // Bytes gathered in place from accessors before spilling to the heap
+#define GNT_PATH_DEPTH 64 // Nodes of the previous key remembered by bulk loads
+#define GNT_RELEASE_STACK 256 // Nibbles queued on the stack by teardown walks before spilling into the nodes
+#define GNT_PASS_TASKS 8 // Subtries a parallel pass splits the trie into per thread, so that threads done early take over the rest
+#define GNT_COMBINE_BATCH 64 // Writes a combiner sorts and applies at once
+#define GNT_COMBINE_ROUNDS 8 // Batches a combiner takes before handing the shard over
+#define GNT_EVICT_SLACK 16 // Eviction frees a sixteenth of the budget past it, so that it runs once per batch of writes
+#define GNT_REPLICA_RECHECK 1024 // Replica reads between two lookups of the NUMA node a thread runs on
+
+#define GNT_IMAGE_MAGIC "GNT2"
+#define GNT_LINE_SIZE 64 // Cache line size that slabs and image records are aligned to
+#define GNT_IMAGE_ORDER 0x01020304u // Images and journals saved on a host of different endianness read it back in another order and are refused
+#define GNT_IMAGE_FLAGS (GNT_FLAG_COMPRESS | GNT_FLAG_FIXED_WIDTH) // Flags that shape the saved nibbles and nodes
+#define GNT_JOURNAL_MAGIC "GNTJ" // Followed by GNT_IMAGE_ORDER, then by the records
+#define GNT_JOURNAL_HEADER 8
 
 #define GNT_MUTEX_CREATE(gnt)   (thrd_success == mtx_init(&gnt->mutex, mtx_plain))
 #define GLL_MUTEX_DESTROY(gnt)  (mtx_destroy(&gnt->mutex))
+#ifdef GNT_INSTRUMENT
+#define GNT_MUTEX_LOCK(gnt)     (_gnt_probe_lock(gnt->trie, &gnt->mutex))
+#else
 #define GNT_MUTEX_LOCK(gnt)     (mtx_lock(&gnt->mutex))
+#endif
+#define GNT_MUTEX_TRYLOCK(gnt)  (thrd_success == mtx_trylock(&gnt->mutex))
 #define GNT_MUTEX_UNLOCK(gnt)   (mtx_unlock(&gnt->mutex))
 
+#define GNT_READ_LOCK(trie, shard)      (_gnt_read_lock(trie, shard))
+#define GNT_READ_UNLOCK(trie, shard)    (_gnt_read_unlock(trie, shard))
+#define GNT_WRITE_LOCK(trie, shard)     (_gnt_write_lock(trie, shard))
+#define GNT_WRITE_UNLOCK(trie, shard)   (_gnt_write_unlock(trie, shard))
+
+#define GNT_SHARD(trie, high_nibble)    (&(trie)->shards[(high_nibble) & (trie)->mask])
+
+#define GNT_WRITER              (1u << 31) // Set in readers while a writer holds or awaits the trie
+#define GNT_REFERENCED          (1u << 1) // Set in occupied by searches, cleared when eviction passes over the node
+
+#ifdef GNT_INSTRUMENT
+#define GNT_PROBE_BEGIN()               uint64_t _gnt_probe_start = _gnt_probe_begin()
+#define GNT_PROBE_END(trie, op)         (_gnt_probe_end(trie, op, _gnt_probe_start))
+#define GNT_PROBE_ACQUIRE(trie)         (atomic_fetch_add_explicit(&(trie)->probe.locks, 1, memory_order_relaxed))
+#define GNT_PROBE_WAIT_BEGIN()          uint64_t _gnt_probe_wait = _gnt_probe_clock()
+#define GNT_PROBE_WAIT_END(trie)        (_gnt_probe_contended(trie, _gnt_probe_wait))
+#define GNT_PROBE_LEVEL()               (_gnt_probe.levels++)
+#define GNT_PROBE_ALLOCATION()          (_gnt_probe.allocations++)
+#else
+#define GNT_PROBE_BEGIN()               ((void) 0)
+#define GNT_PROBE_END(trie, op)         ((void) 0)
+#define GNT_PROBE_ACQUIRE(trie)         ((void) 0)
+#define GNT_PROBE_WAIT_BEGIN()          ((void) 0)
+#define GNT_PROBE_WAIT_END(trie)        ((void) 0)
+#define GNT_PROBE_LEVEL()               ((void) 0)
+#define GNT_PROBE_ALLOCATION()          ((void) 0)
+#endif
+
 typedef struct gnt_node gnt_node_t;
 
 typedef struct gnt_nibble gnt_nibble_t;
 typedef struct gnt_nibble // Represents the first 4 bits of a byte
 {
-    uint8_t children;
-    gnt_node_t* nodes[16];
+    uint16_t map; // Low nibbles present in nodes, their count is its popcount
+    uint8_t capacity;
+    uint32_t generation; // Version the nibble and its nodes were written in, snapshots of earlier versions may share them
+    gnt_node_t* nodes[]; // Ordered by low nibble, indexed by their rank in map
 } gnt_nibble_t;
 
 typedef struct gnt_node // Represents the last 4 bits of a byte
 {
-    bool occupied;
-    uint8_t children;
+    uint8_t occupied; // Holds data, GNT_REFERENCED marks it as searched since eviction last passed over it
+    uint8_t capacity;
+    uint16_t map; // High nibbles present in nibbles, their count is its popcount
+    uint8_t length; // Number of compressed bytes stored in prefix
+    gnt_byte_t prefix[GNT_PREFIX_SIZE]; // Bytes following this node before its data and children
     gnt_data_t data;
-    gnt_nibble_t* nibbles[16];
+    gnt_nibble_t* nibbles[]; // Ordered by high nibble, indexed by their rank in map
 } gnt_node_t;
 
-typedef struct gnt_trie
+typedef struct gnt_slab gnt_slab_t;
+typedef struct gnt_slab // Header of a block of pooled objects
+{
+    gnt_slab_t* next;
+} gnt_slab_t;
+
+typedef struct gnt_pool // Objects of a single size, carved from slabs
+{
+    void* released; // Free list threaded through the first word of released objects
+    gnt_slab_t* slabs;
+    char* cursor;
+    char* end;
+    size_t size;
+    size_t bytes; // Size of the next slab
+} gnt_pool_t;
+
+typedef struct gnt_tally // Counters kept up to date by the writers of a shard
+{
+    size_t nibbles;
+    size_t nodes;
+    size_t values;
+    size_t slots; // Child slots allocated, used or not
+    size_t key_bytes; // Total length of the stored keys
+    size_t bytes; // Memory taken by slabs
+} gnt_tally_t;
+
+typedef struct gnt_retired // Nibble, node or data replaced while snapshots may still read it
+{
+    uintptr_t object;
+    uint32_t generation; // Version that replaced it, it is reclaimed once no open snapshot is older
+    uint8_t kind;
+} gnt_retired_t;
+
+typedef struct gnt_request // Write published to the thread combining those of a shard, lives on the stack of its caller
+{
+    struct gnt_request* next;
+    const gnt_byte_t* bytes;
+    gnt_index_t length;
+    gnt_data_t data;
+    gnt_op_t op; // GNT_OP_INSERT or GNT_OP_DELETE
+    gnt_status_t status;
+    atomic_bool done; // Set by the combiner once status is final, the request is not touched past it
+} gnt_request_t;
+
+typedef struct gnt_shard // Guards and allocates the root subtries mapped to it
 {
     mtx_t mutex;
-    uint8_t children;
+    atomic_uint readers;
+    _Atomic(gnt_request_t*) requests; // Writes published while the shard was busy, newest first
+    gnt_trie_t* trie;
+    gnt_tally_t tally;
+    gnt_byte_t* pending; // Keys deleted lazily and not compacted yet, each followed by its length
+    size_t pending_size;
+    size_t pending_capacity;
+    gnt_retired_t* retired; // Oldest first
+    size_t retired_size;
+    size_t retired_capacity;
+    uint64_t epoch; // Nibbles and nodes allocated or released, hints taken before the last one are stale
+    size_t used; // Bytes of nibbles and nodes in use
+    gnt_byte_t* hand; // Key the eviction clock last stopped at, the sweep resumes past it
+    size_t hand_length;
+    size_t hand_capacity;
+    gnt_pool_t pools[GNT_POOL_CLASSES];
+} gnt_shard_t;
+
+#ifdef GNT_INSTRUMENT
+typedef struct gnt_probe // Metrics shared by the threads using an instrumented trie
+{
+    atomic_size_t locks;
+    atomic_size_t contended;
+    _Atomic uint64_t wait_ns;
+    atomic_size_t operations[GNT_OPS];
+    atomic_size_t latency[GNT_OPS][GNT_LATENCY_BUCKETS];
+    atomic_size_t levels[GNT_OPS];
+    atomic_size_t allocations[GNT_OPS];
+} gnt_probe_t;
+
+typedef struct gnt_scope // Measures of the operation in progress on a thread
+{
+    uint64_t waited;
+    size_t levels;
+    size_t allocations;
+} gnt_scope_t;
+
+static _Thread_local gnt_scope_t _gnt_probe;
+#endif
+
+typedef struct gnt_journal // Log of the writes since the last checkpoint, records are buffered and synced in groups
+{
+    mtx_t mutex; // Writers of different shards append at once
+    int fd;
+    gnt_status_t status; // -1 once the log couldn't be written, every later write fails as well
+    size_t sync_bytes;
+    uint64_t sync_ns;
+    uint64_t synced; // Time of the last sync
+    char* buffer; // Records not written yet
+    size_t size;
+    size_t capacity;
+} gnt_journal_t;
+
+typedef struct gnt_trie
+{
+    _Atomic uint8_t children;
     gnt_nibble_t* nibbles[16];
     gnt_accessor_t accessor;
+    gnt_span_accessor_t span_accessor;
     gnt_deallocator_t deallocator;
+    gnt_allocator_t allocator;
+    gnt_releaser_t releaser;
+    gnt_flags_t flags;
+    uint8_t mask; // Maps a root slot to its shard
+    const char* base; // Start of the image of a mapped or frozen trie, children then hold offsets from it
+    size_t size;
+    void* block; // Allocation holding the image of a frozen trie, NULL when mapped
+    gnt_observer_t observer;
+    gnt_node_t** roots; // Node reached by each first byte of a key, only with GNT_FLAG_WIDE_ROOT
+    uint32_t generation; // Version being written, a snapshot keeps the one before and starts the next
+    gnt_trie_t* origin; // Trie a snapshot was taken of, NULL otherwise
+    gnt_trie_t* snapshots; // Open snapshots newest first, for a snapshot the ones taken before it
+    gnt_journal_t* journal; // Log every write is appended to, NULL without one
+    size_t budget; // Bytes of nibbles and nodes kept before cold keys are evicted, 0 without a bound
+    atomic_size_t used; // Bytes of nibbles and nodes in use, only counted with a budget
+    gnt_replicas_t* replicas; // Read replicas marked stale by every writer, NULL without
+#ifdef GNT_INSTRUMENT
+    gnt_probe_t probe;
+#endif
+    gnt_shard_t shards[]; // One per root slot when sharded, a single one otherwise
 } gnt_trie_t;
 
+typedef struct gnt_span // Contiguous bytes of a key
+{
+    const gnt_byte_t* bytes;
+    gnt_index_t length;
+    gnt_byte_t* heap; // Holds keys gathered byte by byte that outgrew buffer
+    gnt_byte_t buffer[GNT_SPAN_BUFFER];
+} gnt_span_t;
+
+typedef struct gnt_lane // A key walked by a batched search
+{
+    gnt_span_t span;
+    gnt_index_t index;
+    gnt_node_t* node; // Last node reached, NULL once the key is known to be missing
+    gnt_nibble_t* nibble; // Nibble to visit next, NULL when node is
+    size_t position; // Index of the key in the batch
+} gnt_lane_t;
+
+typedef uint64_t gnt_vector_t __attribute__((vector_size(GNT_BATCH_WIDTH * sizeof(uint64_t)))); // A word per key of a batch, lowered to the SIMD units of the target or to scalar code
+
+typedef struct gnt_path // Nodes along the last key reached by a bulk load or through a hint
+{
+    gnt_node_t*** slots;
+    gnt_index_t* indexes; // Bytes of the key consumed once past each node
+    uint8_t depth;
+    uint8_t capacity;
+} gnt_path_t;
+
+typedef struct gnt_image // Header of a saved or frozen trie, its nibbles and nodes follow in breadth-first order
+{
+    char magic[4];
+    uint32_t order;
+    uint16_t node_size; // Layout of the saving build, images are only read back by a compatible one
+    uint16_t nibble_size;
+    gnt_flags_t flags;
+    uint64_t size;
+    uint64_t nibbles[16]; // Offsets of the root nibbles, 0 when absent
+} gnt_image_t;
+
+typedef struct gnt_writer // Image being built by gnt_save or gnt_freeze
+{
+    gnt_trie_t* trie;
+    char* block; // Allocation holding the image
+    char* bytes; // Cache-line aligned start of the image within block
+    size_t size;
+    size_t capacity;
+    uint64_t* queue; // Offsets of the records in breadth-first order
+    size_t queued;
+    size_t queue_capacity;
+    gnt_allocator_t allocator; // Allocates block, along with releaser
+    gnt_releaser_t releaser;
+} gnt_writer_t;
+
+typedef struct gnt_cut // Top of the branch that a delete removes
+{
+    gnt_nibble_t** nibble; // Slot of the nibble holding the first node removed
+    gnt_node_t** slot;
+    gnt_node_t** parent; // Slot of the node holding the nibble, NULL at the root
+    gnt_byte_t byte; // Key byte leading to the first node removed
+} gnt_cut_t;
+
+typedef struct gnt_release // Root subtrie whose data is released by one thread
+{
+    gnt_nibble_t* nibble;
+    gnt_deallocator_t deallocator;
+} gnt_release_t;
+
+typedef struct gnt_task // Subtrie walked by a thread of a parallel pass
+{
+    gnt_node_t* node; // NULL for the whole trie
+    gnt_index_t depth;
+    gnt_byte_t key[GNT_CURSOR_KEY_MAX]; // Bytes leading to the node
+} gnt_task_t;
+
+typedef struct gnt_pass // Parallel pass, shared by its threads
+{
+    gnt_trie_t* trie;
+    gnt_mapper_t mapper;
+    gnt_task_t* tasks;
+    size_t count;
+    atomic_size_t next; // First task not yet taken by a thread
+    atomic_bool stop;
+} gnt_pass_t;
+
+typedef struct gnt_worker // Thread of a parallel pass
+{
+    gnt_pass_t* pass;
+    void* context;
+} gnt_worker_t;
+
+typedef struct gnt_load // Keys inserted by one thread of a bulk load
+{
+    gnt_trie_t* trie;
+    const gnt_key_t* keys;
+    const gnt_data_t* data;
+    size_t count;
+    gnt_status_t status;
+} gnt_load_t;
+
+typedef struct gnt_join // Merge of src into dst, or filter of dst by src
+{
+    gnt_trie_t* dst;
+    gnt_trie_t* src;
+    gnt_shard_t* shard; // Shard of dst owning the root subtrie being walked
+    gnt_conflict_t conflict;
+    void* context;
+    bool intersect;
+    gnt_byte_t* key; // Bytes of the node being walked
+    size_t capacity;
+    gnt_status_t status;
+} gnt_join_t;
+
+typedef struct gnt_replica // Frozen copy of the trie read by the threads of one NUMA node, on a cache line of its own
+{
+    _Alignas(GNT_LINE_SIZE) _Atomic(gnt_trie_t*) frozen; // NULL until first built
+    atomic_uint readers[2]; // Pins taken on each side, a refresh flips the side and waits for the other to drain
+    atomic_uint side;
+    atomic_bool stale; // Set by writers, cleared by the refresh starting after them
+    _Atomic uint64_t refreshed; // Time of the last refresh in nanoseconds
+    mtx_t mutex; // Held by the thread refreshing the replica
+} gnt_replica_t;
+
+typedef struct gnt_replicas
+{
+    gnt_trie_t* trie;
+    gnt_allocator_t* allocators; // One per replica, NULL to allocate as the trie does
+    gnt_releaser_t releaser;
+    uint64_t lag; // Nanoseconds between two refreshes of a replica
+    uint32_t nodes;
+    gnt_replica_t* replicas;
+} gnt_replicas_t;
+
+typedef struct gnt_locality // NUMA node the thread last ran on
+{
+    uint32_t node;
+    uint32_t reads; // Left until the node is looked up again
+} gnt_locality_t;
+
+static _Thread_local gnt_locality_t _gnt_locality;
+
 enum
 {
-    END,
     CONTINUE,
-    STOP
+    STOP,
+    MISSING
 };
 
-static gnt_status_t _gnt_accessor_default(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index);
-static void _gnt_destroy_recursive_nibbles(gnt_nibble_t** nibbles, uint8_t children, gnt_deallocator_t deallocator);
-static void _gnt_destroy_recursive_nodes(gnt_node_t** nodes, uint8_t children, gnt_deallocator_t deallocator);
-static gnt_status_t _gnt_delete_recursive(gnt_byte_t* byte, gnt_nibble_t** nibbles, gnt_key_t key, gnt_index_t index, gnt_accessor_t accessor, gnt_deallocator_t deallocator);
+enum // Kinds of journal records, each is followed by the key length, the key, the data of inserts and a checksum
+{
+    GNT_JOURNAL_INSERT = 1,
+    GNT_JOURNAL_DELETE,
+    GNT_JOURNAL_CLEAR
+};
 
-gnt_trie_t* gnt_create(gnt_cfg_t* cfg)
+enum // How the nodes of dst are matched against src by a filter
 {
-    gnt_accessor_t accessor;
-    gnt_deallocator_t deallocator;
-    
-    if (cfg)
-    {
-        accessor = cfg->accessor ? cfg->accessor : _gnt_accessor_default;
-        deallocator = cfg->deallocator;
-    }
-    else
-    {
-        accessor = _gnt_accessor_default;
-        deallocator = NULL;
-    }
-    
-    gnt_trie_t* trie = calloc(1, sizeof(gnt_trie_t));
-    
-    if (trie)
-    {
-        if (!GNT_MUTEX_CREATE(trie))
-        {
-            free(trie);
-            return NULL;
-        }
+    GNT_JOIN_EXACT, // src has a node holding the same bytes
+    GNT_JOIN_NONE, // src holds no key below
+    GNT_JOIN_LOOKUP // Compressed prefixes diverge, keys are searched in src one by one
+};
 
-        trie->accessor = accessor;
-        trie->deallocator = deallocator;
-    }
+enum
+{
+    GNT_RETIRED_NIBBLE,
+    GNT_RETIRED_NODE,
+    GNT_RETIRED_DATA
+};
+
+static gnt_status_t _gnt_accessor_default(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index);
+static gnt_status_t _gnt_span_load(gnt_trie_t* trie, gnt_span_t* span, gnt_key_t key);
+static void _gnt_span_release(gnt_trie_t* trie, gnt_span_t* span);
+static gnt_status_t _gnt_lane_load(gnt_trie_t* trie, gnt_lane_t* lane, const gnt_key_t* keys, size_t position);
+static gnt_status_t _gnt_combine(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data, gnt_op_t op);
+static void _gnt_combine_requests(gnt_trie_t* trie, gnt_shard_t* shard);
+static void _gnt_lock_all(gnt_trie_t* trie, bool write);
+static void _gnt_unlock_all(gnt_trie_t* trie, bool write);
+static void _gnt_lock_pair(gnt_trie_t* dst, gnt_trie_t* src, bool write);
+static void _gnt_unlock_pair(gnt_trie_t* dst, gnt_trie_t* src, bool write);
+static gnt_node_t* _gnt_reserve(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_path_t* path);
+static gnt_status_t _gnt_insert(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data, gnt_path_t* path);
+static gnt_node_t* _gnt_search(gnt_trie_t* trie, const gnt_byte_t* bytes, gnt_index_t length);
+static gnt_node_t* _gnt_search_path(gnt_trie_t* trie, const gnt_byte_t* bytes, gnt_index_t length, gnt_path_t* path);
+static uint8_t _gnt_hint_resume(gnt_hint_t* hint, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, bool write);
+static void _gnt_hint_keep(gnt_hint_t* hint, gnt_shard_t* shard, gnt_path_t* path, const gnt_byte_t* bytes, gnt_index_t length, bool write);
+static gnt_status_t _gnt_delete(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length);
+static gnt_status_t _gnt_remove(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, bool lazy);
+static size_t _gnt_compact_shard(gnt_trie_t* trie, gnt_shard_t* shard, size_t budget);
+static void _gnt_evict(gnt_trie_t* trie, gnt_shard_t* shard);
+static gnt_node_t* _gnt_evict_next(gnt_trie_t* trie, gnt_shard_t* shard, gnt_node_t* parent, size_t depth, bool bounded);
+static void _gnt_evict_largest(gnt_trie_t* trie, gnt_shard_t* shard);
+static gnt_status_t _gnt_join_key(gnt_join_t* join, size_t length);
+static void _gnt_join_adopt(gnt_shard_t* shard, gnt_shard_t* from);
+static gnt_data_t _gnt_join_resolve(gnt_join_t* join, gnt_index_t length, gnt_data_t kept, gnt_data_t incoming);
+static void _gnt_join_log(gnt_join_t* join, gnt_node_t* node, size_t depth);
+static void _gnt_join_log_nibble(gnt_join_t* join, gnt_nibble_t* nibble, gnt_byte_t high_nibble, size_t depth);
+static void _gnt_join_drop(gnt_join_t* join, gnt_node_t* node, size_t depth);
+static void _gnt_join_nibble(gnt_join_t* join, gnt_nibble_t** slot, gnt_nibble_t* nibble, gnt_byte_t high_nibble, size_t depth);
+static void _gnt_join_node(gnt_join_t* join, gnt_node_t** slot, gnt_node_t* node, size_t depth);
+static void _gnt_join_insert(gnt_join_t* join, gnt_node_t* node, size_t depth);
+static gnt_status_t _gnt_filter(gnt_trie_t* dst, gnt_trie_t* src, bool intersect);
+static void _gnt_filter_nibble(gnt_join_t* join, gnt_nibble_t** slot, gnt_nibble_t* other, gnt_byte_t high_nibble, size_t depth, uint8_t mode);
+static void _gnt_filter_node(gnt_join_t* join, gnt_node_t** slot, gnt_node_t* other, size_t depth, uint8_t mode);
+static bool _gnt_search_step(gnt_trie_t* trie, gnt_lane_t* lane);
+static void _gnt_search_group(gnt_trie_t* trie, const void* keys, uint8_t width, gnt_data_t* data, uint64_t* found, size_t first, uint8_t count);
+static gnt_status_t _gnt_search_batch_integer(gnt_trie_t* trie, const void* keys, uint8_t width, gnt_data_t* data, uint64_t* found, size_t count);
+static int _gnt_bulk_load(void* load);
+static void* _gnt_flatten_reserve(gnt_writer_t* writer, size_t size, uint64_t* offset);
+static uint64_t _gnt_flatten_record(gnt_writer_t* writer, void* source, bool nibble);
+static gnt_status_t _gnt_flatten(gnt_writer_t* writer);
+static gnt_trie_t* _gnt_adopt(const char* base, size_t size, gnt_cfg_t* cfg);
+static gnt_trie_t* _gnt_freeze(gnt_trie_t* trie, gnt_allocator_t allocator, gnt_releaser_t releaser);
+static uint32_t _gnt_numa_node(void);
+static gnt_status_t _gnt_replica_refresh(gnt_replicas_t* replicas, gnt_replica_t* replica);
+static void _gnt_replicas_release(gnt_replicas_t* replicas, uint32_t count);
+static void _gnt_stats_walk(gnt_trie_t* trie, gnt_node_t* parent, gnt_index_t depth, gnt_stats_t* stats, gnt_tally_t* tally);
+static gnt_status_t _gnt_write_all(int fd, const char* bytes, size_t size);
+static gnt_status_t _gnt_journal_open(gnt_trie_t* trie, gnt_cfg_t* cfg, off_t end);
+static gnt_status_t _gnt_journal_reset(gnt_journal_t* journal);
+static gnt_status_t _gnt_journal_append(gnt_trie_t* trie, uint8_t kind, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data);
+static gnt_status_t _gnt_journal_flush(gnt_journal_t* journal);
+static gnt_status_t _gnt_journal_close(gnt_trie_t* trie);
+static gnt_status_t _gnt_journal_replay(gnt_trie_t* trie, const char* path, off_t* end);
+static gnt_status_t _gnt_restore(gnt_trie_t* trie, gnt_trie_t* image, gnt_node_t* parent, gnt_byte_t** key, size_t* capacity, size_t depth);
+static gnt_status_t _gnt_sync_directory(gnt_trie_t* trie, const char* path);
+static gnt_node_t* _gnt_cursor_after(gnt_cursor_t* cursor, gnt_node_t* parent, gnt_index_t depth, const gnt_byte_t* target, gnt_index_t length, bool inclusive);
+static gnt_node_t* _gnt_cursor_before(gnt_cursor_t* cursor, gnt_node_t* parent, gnt_index_t depth, const gnt_byte_t* target, gnt_index_t length);
+static gnt_status_t _gnt_cursor_move(gnt_cursor_t* cursor, const gnt_byte_t* target, gnt_index_t length, bool forward, bool inclusive);
+static bool _gnt_visit(gnt_trie_t* trie, gnt_byte_t* key, gnt_node_t* parent, gnt_index_t depth, gnt_visitor_t visitor, void* context);
+static bool _gnt_map(gnt_trie_t* trie, gnt_byte_t* key, gnt_node_t* parent, gnt_index_t depth, gnt_mapper_t mapper, void* context, atomic_bool* stop);
+static size_t _gnt_partition(gnt_pass_t* pass, size_t target, void* context);
+static int _gnt_pass(void* worker);
+static void _gnt_release(gnt_trie_t* trie);
+static int _gnt_release_subtrie(void* release);
+static gnt_node_t** _gnt_locate(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_cut_t* cut);
+static void _gnt_prune(gnt_shard_t* shard, gnt_node_t** slot, gnt_cut_t* cut, bool compress);
+static gnt_status_t _gnt_defer(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length);
+static gnt_nibble_t* _gnt_copy(gnt_shard_t* shard, gnt_nibble_t** slot);
+static gnt_nibble_t* _gnt_own_root(gnt_shard_t* shard, gnt_byte_t high_nibble);
+static gnt_status_t _gnt_own_subtrie(gnt_shard_t* shard, gnt_nibble_t* nibble);
+static gnt_status_t _gnt_own_all(gnt_trie_t* trie);
+static gnt_status_t _gnt_discard(gnt_trie_t* trie, gnt_shard_t* shard, gnt_data_t data);
+static gnt_status_t _gnt_retire_reserve(gnt_shard_t* shard, size_t count);
+static void _gnt_reclaim(gnt_trie_t* trie);
+static void* _gnt_pool_alloc(gnt_shard_t* shard, uint8_t class);
+static void _gnt_pool_release(gnt_shard_t* shard, uint8_t class, void* object);
+static void _gnt_pool_destroy(gnt_shard_t* shard);
+static gnt_nibble_t* _gnt_nibble_alloc(gnt_shard_t* shard, uint8_t capacity);
+static gnt_node_t* _gnt_node_alloc(gnt_shard_t* shard, uint8_t capacity);
+static gnt_nibble_t* _gnt_nibble_resize(gnt_shard_t* shard, gnt_nibble_t* nibble, uint8_t capacity);
+static gnt_node_t* _gnt_node_resize(gnt_shard_t* shard, gnt_node_t* node, uint8_t capacity);
+static void _gnt_nibble_free(gnt_shard_t* shard, gnt_nibble_t* nibble);
+static void _gnt_node_free(gnt_shard_t* shard, gnt_node_t* node);
+static gnt_nibble_t** _gnt_nibble_attach(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble);
+static gnt_node_t** _gnt_node_attach(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble);
+static gnt_nibble_t** _gnt_nibble_link(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble, gnt_nibble_t* nibble);
+static gnt_node_t** _gnt_node_link(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble, gnt_node_t* node);
+static void _gnt_nibble_detach(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble);
+static void _gnt_node_detach(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble);
+static gnt_node_t* _gnt_split(gnt_shard_t* shard, gnt_node_t** slot, uint8_t length);
+static void _gnt_merge(gnt_shard_t* shard, gnt_node_t** slot);
+#ifdef GNT_INSTRUMENT
+static int _gnt_probe_lock(gnt_trie_t* trie, mtx_t* mutex);
+static void _gnt_probe_contended(gnt_trie_t* trie, uint64_t start);
+static void _gnt_probe_end(gnt_trie_t* trie, gnt_op_t op, uint64_t start);
+#endif
+
+#ifdef GNT_INSTRUMENT
+static GNT_FORCE_INLINE uint64_t _gnt_probe_clock(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
     
-    return trie;
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
 }
 
-gnt_status_t gnt_destroy(gnt_trie_t* trie)
+static GNT_FORCE_INLINE uint64_t _gnt_probe_begin(void)
 {
-    if (!trie) return -1;
-    
-    _gnt_destroy_recursive_nibbles(trie->nibbles, trie->children, trie->deallocator);
+    _gnt_probe = (gnt_scope_t) {0};
     
-    GLL_MUTEX_DESTROY(trie);
-    free(trie);
-    
-    return 0;
+    return _gnt_probe_clock();
 }
+#endif
 
-gnt_status_t gnt_insert(gnt_trie_t* trie, gnt_key_t key, gnt_data_t data)
+static GNT_FORCE_INLINE void _gnt_read_lock(gnt_trie_t* trie, gnt_shard_t* shard)
 {
-    if (!trie) return -1;
-    GNT_MUTEX_LOCK(trie);
+    // Mapped, frozen and snapshot tries never change, reading them takes no lock
+    if (trie->base || trie->origin)
+    {
+        return;
+    }
     
-    gnt_nibble_t** nibbles = trie->nibbles;
-    gnt_node_t** nodes;
-    gnt_node_t* node;
-    gnt_byte_t byte;
-    gnt_index_t index = 0;
-    uint8_t* children = &(trie->children);
+    if (!(trie->flags & GNT_FLAG_RWLOCK))
+    {
+        GNT_MUTEX_LOCK(shard);
+        return;
+    }
+    
+    GNT_PROBE_ACQUIRE(trie);
     
-    while (0 == trie->accessor(&byte, key, index++))
+    // Readers announce themselves and back off while a writer holds or awaits the shard
+    if (atomic_fetch_add(&shard->readers, 1) & GNT_WRITER)
     {
-        gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(byte);
-        gnt_byte_t low_nibble = GNT_LOW_NIBBLE(byte);
+        GNT_PROBE_WAIT_BEGIN();
         
-        if (!nibbles[high_nibble])
+        do
         {
-            nibbles[high_nibble] = calloc(1, sizeof(gnt_nibble_t));
-            (*children)++;
+            atomic_fetch_sub(&shard->readers, 1);
+            
+            while (atomic_load_explicit(&shard->readers, memory_order_relaxed) & GNT_WRITER)
+            {
+                thrd_yield();
+            }
         }
-
-        nodes = nibbles[high_nibble]->nodes;
-        children = &(nibbles[high_nibble]->children);
+        while (atomic_fetch_add(&shard->readers, 1) & GNT_WRITER);
         
-        if (!nodes[low_nibble])
-        {
-            nodes[low_nibble] = calloc(1, sizeof(gnt_node_t));
-            (*children)++;
-        }
+        GNT_PROBE_WAIT_END(trie);
+    }
+}
 
-        nibbles = nodes[low_nibble]->nibbles;
-        node = nodes[low_nibble];
-        children = &(node->children);
+static GNT_FORCE_INLINE void _gnt_read_unlock(gnt_trie_t* trie, gnt_shard_t* shard)
+{
+    if (trie->base || trie->origin)
+    {
+        return;
     }
     
-    if (node->occupied && trie->deallocator)
+    if (!(trie->flags & GNT_FLAG_RWLOCK))
     {
-        trie->deallocator(node->data);
+        GNT_MUTEX_UNLOCK(shard);
+        return;
     }
     
-    node->data = data;
-    node->occupied = true;
-
-    GNT_MUTEX_UNLOCK(trie);
-    return 0;
+    atomic_fetch_sub_explicit(&shard->readers, 1, memory_order_release);
 }
 
-gnt_data_t gnt_search(gnt_trie_t* trie, gnt_key_t key)
+static GNT_FORCE_INLINE void _gnt_write_drain(gnt_trie_t* trie, gnt_shard_t* shard)
 {
-    if (!trie) return -1;
-    GNT_MUTEX_LOCK(trie);
-    
-    gnt_nibble_t** nibbles = trie->nibbles;
-    gnt_node_t** nodes;
-    gnt_node_t* node;
-    gnt_byte_t byte;
-    gnt_index_t index = 0;
-    
-    while (0 == trie->accessor(&byte, key, index++))
+    if (trie->flags & GNT_FLAG_RWLOCK)
     {
-        gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(byte);
-        gnt_byte_t low_nibble = GNT_LOW_NIBBLE(byte);
-        
-        if (!nibbles[high_nibble])
-        {
-            GNT_MUTEX_UNLOCK(trie);
-            return 0;
-        }
-
-        nodes = nibbles[high_nibble]->nodes;
-        
-        if (!nodes[low_nibble])
+        // Writers are serialized by the mutex, they only have to wait for the readers to drain
+        if (atomic_fetch_or(&shard->readers, GNT_WRITER) != 0)
         {
-            GNT_MUTEX_UNLOCK(trie);
-            return 0;
+            GNT_PROBE_WAIT_BEGIN();
+            
+            while (atomic_load_explicit(&shard->readers, memory_order_acquire) != GNT_WRITER)
+            {
+                thrd_yield();
+            }
+            
+            GNT_PROBE_WAIT_END(trie);
         }
-
-        nibbles = nodes[low_nibble]->nibbles;
-        node = nodes[low_nibble];
     }
+}
 
-    gnt_data_t data = node->data;
-
-    GNT_MUTEX_UNLOCK(trie);
-    return data;
+static GNT_FORCE_INLINE void _gnt_write_lock(gnt_trie_t* trie, gnt_shard_t* shard)
+{
+    GNT_MUTEX_LOCK(shard);
+    _gnt_write_drain(trie, shard);
 }
 
-gnt_status_t gnt_delete(gnt_trie_t* trie, gnt_key_t key)
+static GNT_FORCE_INLINE bool _gnt_write_trylock(gnt_trie_t* trie, gnt_shard_t* shard)
 {
-    if (!trie) return -1;
-    GNT_MUTEX_LOCK(trie);
+    if (!GNT_MUTEX_TRYLOCK(shard))
+    {
+        return false;
+    }
     
-    uint8_t child_byte;
+    GNT_PROBE_ACQUIRE(trie);
+    _gnt_write_drain(trie, shard);
     
-    if (CONTINUE == _gnt_delete_recursive(&child_byte, trie->nibbles, key, 0, trie->accessor, trie->deallocator))
+    return true;
+}
+
+static GNT_FORCE_INLINE void _gnt_replicas_mark(gnt_replicas_t* replicas)
+{
+    // Flags are only written when they change, so that readers keep their replica's line cached between refreshes
+    for (uint32_t i = 0; i < replicas->nodes; i++)
     {
-        if (trie->children)
+        if (!atomic_load_explicit(&replicas->replicas[i].stale, memory_order_relaxed))
         {
-            free(trie->nibbles[GNT_HIGH_NIBBLE(child_byte)]);
-            trie->nibbles[GNT_HIGH_NIBBLE(child_byte)] = NULL;
-            trie->children--;
+            atomic_store(&replicas->replicas[i].stale, true);
         }
     }
-    
-    GNT_MUTEX_UNLOCK(trie);
-    return 0;
 }
 
-gnt_status_t gnt_accessor_string(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index)
+static GNT_FORCE_INLINE gnt_replica_t* _gnt_replica_local(gnt_replicas_t* replicas)
 {
-    char* str = (char*) key;
-    
-    if (index >= strlen(str))
+    // Threads seldom move to another node, it is only looked up again every GNT_REPLICA_RECHECK reads
+    if (!_gnt_locality.reads--)
     {
-        return -1;
+        _gnt_locality.node = _gnt_numa_node();
+        _gnt_locality.reads = GNT_REPLICA_RECHECK;
     }
     
-    *byte = str[index];
-    return 0;
+    return &replicas->replicas[_gnt_locality.node % replicas->nodes];
 }
 
-static gnt_status_t _gnt_accessor_default(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index)
+static GNT_FORCE_INLINE void _gnt_write_unlock(gnt_trie_t* trie, gnt_shard_t* shard)
 {
-    uint8_t digits = 0;
-    gnt_key_t temp = key;
-
-    do
+    bool over = false;
+    
+    // Writers leaving the trie over budget evict from their shard before readers come back, snapshots pin every node
+    if (trie->budget && atomic_load_explicit(&trie->used, memory_order_relaxed) > trie->budget && !trie->snapshots)
     {
-        digits++;
-        temp >>= 8; // division by 256
-    } while (temp > 0);
-
-    if (index >= digits)
+        _gnt_evict(trie, shard);
+        over = trie->mask && atomic_load_explicit(&trie->used, memory_order_relaxed) > trie->budget;
+    }
+    
+    // Marked while the shard is still held, a refresh locking it afterwards sees the write
+    if (trie->replicas)
     {
-        return -1;
+        _gnt_replicas_mark(trie->replicas);
     }
-
-    for (uint8_t i = 0; i < digits - index - 1; i++)
+    
+    if (trie->flags & GNT_FLAG_RWLOCK)
     {
-        key >>= 8; // division by 256
+        atomic_fetch_and_explicit(&shard->readers, ~GNT_WRITER, memory_order_release);
+    }
+    
+    GNT_MUTEX_UNLOCK(shard);
+    
+    // A shard too small to bring the trie back under budget leaves the rest to the largest one
+    if (over)
+    {
+        _gnt_evict_largest(trie, shard);
     }
-
-    *byte = key & 255; // modulo 256
-    return 0;
 }
 
-static void _gnt_destroy_recursive_nibbles(gnt_nibble_t** nibbles, uint8_t children, gnt_deallocator_t deallocator)
+static GNT_FORCE_INLINE void _gnt_touch(gnt_trie_t* trie, gnt_node_t* node)
 {
-    for (uint8_t i = 0; children && i < 16; i++)
+    // Readers may mark the same node at once, the bit is only ever added to a node holding data
+    if (trie->budget && node && true == __atomic_load_n(&node->occupied, __ATOMIC_RELAXED) && !trie->snapshots)
     {
-        if (nibbles[i])
-        {
-            _gnt_destroy_recursive_nodes(nibbles[i]->nodes, nibbles[i]->children, deallocator);
-            free(nibbles[i]);
-            nibbles[i] = 0;
-            children--;
-        }
+        __atomic_fetch_or(&node->occupied, GNT_REFERENCED, __ATOMIC_RELAXED);
     }
 }
 
-static void _gnt_destroy_recursive_nodes(gnt_node_t** nodes, uint8_t children, gnt_deallocator_t deallocator)
+static GNT_FORCE_INLINE const gnt_byte_t* _gnt_encode(gnt_byte_t* bytes, uint64_t key, uint8_t width, bool fixed, gnt_index_t* length)
 {
-    for (uint8_t i = 0; children && i < 16; i++)
+    // Width is constant at every call site, so the shifts below unroll into constant ones
+    for (uint8_t i = 0; i < width; i++)
     {
-        if (nodes[i])
-        {
-            _gnt_destroy_recursive_nibbles(nodes[i]->nibbles, nodes[i]->children, deallocator);
-            
-            if (deallocator)
-            {
-                deallocator(nodes[i]->data);
-            }
-            
-            free(nodes[i]);
-            nodes[i] = 0;
-            children--;
-        }
+        bytes[i] = GNT_SELECT_KEY_BYTE(key, (width - 1 - i)) & 255; // modulo 256
     }
+    
+    // Without a fixed width, leading zero bytes are dropped and zero is kept as a single byte
+    *length = fixed ? width : (key ? (gnt_index_t) (71 - __builtin_clzll(key)) / 8 : 1);
+    
+    return bytes + width - *length;
 }
 
-static gnt_status_t _gnt_delete_recursive(gnt_byte_t* byte, gnt_nibble_t** nibbles, gnt_key_t key, gnt_index_t index, gnt_accessor_t accessor, gnt_deallocator_t deallocator)
+static GNT_FORCE_INLINE gnt_status_t _gnt_insert_integer(gnt_trie_t* trie, uint64_t key, uint8_t width, gnt_data_t data)
 {
-    if (0 != accessor(byte, key, index))
-    {
-        return END;
-    }
+    if (!trie) return -1;
     
-    gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(*byte);
-    gnt_byte_t low_nibble = GNT_LOW_NIBBLE(*byte);
+    gnt_byte_t buffer[sizeof(uint64_t)];
+    gnt_index_t length;
+    const gnt_byte_t* bytes = _gnt_encode(buffer, key, width, trie->flags & GNT_FLAG_FIXED_WIDTH, &length);
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(bytes[0]));
     
-    gnt_nibble_t* nibble = nibbles[high_nibble];
-    gnt_node_t* node = nibble->nodes[low_nibble];
+    GNT_PROBE_BEGIN();
+    gnt_status_t status;
     
-    uint8_t child_byte = 0;
-    gnt_status_t status = _gnt_delete_recursive(&child_byte, node->nibbles, key, index + 1, accessor, deallocator);
-
-    if (STOP == status)
+    if (trie->flags & GNT_FLAG_COMBINING)
     {
-        return STOP;
+        status = _gnt_combine(trie, shard, bytes, length, data, GNT_OP_INSERT);
     }
-    
-    if (END == status)
+    else
     {
-        if (deallocator)
-        {
-            deallocator(node->data);
-        }
-        
-        node->data = 0;
-        node->occupied = false;
-        
-        if (node->children)
-        {
-            return STOP;
-        }
+        GNT_WRITE_LOCK(trie, shard);
+        status = _gnt_insert(trie, shard, bytes, length, data, NULL);
+        GNT_WRITE_UNLOCK(trie, shard);
     }
     
-    free(node->nibbles[GNT_HIGH_NIBBLE(child_byte)]);
-    node->nibbles[GNT_HIGH_NIBBLE(child_byte)] = NULL;
+    GNT_PROBE_END(trie, GNT_OP_INSERT);
+    
+    return status;
+}
+
+static GNT_FORCE_INLINE gnt_data_t _gnt_search_integer(gnt_trie_t* trie, uint64_t key, uint8_t width)
+{
+    if (!trie) return -1;
+    
+    gnt_byte_t buffer[sizeof(uint64_t)];
+    gnt_index_t length;
+    const gnt_byte_t* bytes = _gnt_encode(buffer, key, width, trie->flags & GNT_FLAG_FIXED_WIDTH, &length);
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(bytes[0]));
+    
+    GNT_PROBE_BEGIN();
+    GNT_READ_LOCK(trie, shard);
+    gnt_node_t* node = _gnt_search(trie, bytes, length);
+    gnt_data_t data = node ? node->data : 0;
+    GNT_READ_UNLOCK(trie, shard);
+    GNT_PROBE_END(trie, GNT_OP_SEARCH);
+    
+    return data;
+}
+
+static GNT_FORCE_INLINE gnt_status_t _gnt_delete_integer(gnt_trie_t* trie, uint64_t key, uint8_t width)
+{
+    if (!trie) return -1;
+    
+    gnt_byte_t buffer[sizeof(uint64_t)];
+    gnt_index_t length;
+    const gnt_byte_t* bytes = _gnt_encode(buffer, key, width, trie->flags & GNT_FLAG_FIXED_WIDTH, &length);
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(bytes[0]));
     
-    if (node->children)
+    GNT_PROBE_BEGIN();
+    gnt_status_t status;
+    
+    if (trie->flags & GNT_FLAG_COMBINING)
     {
-        node->children--;
+        status = _gnt_combine(trie, shard, bytes, length, 0, GNT_OP_DELETE);
     }
-    
-    if (node->children)
+    else
     {
-        return STOP;
+        GNT_WRITE_LOCK(trie, shard);
+        status = MISSING == _gnt_delete(trie, shard, bytes, length) ? -1 : 0;
+        GNT_WRITE_UNLOCK(trie, shard);
     }
     
-    free(nibble->nodes[low_nibble]);
-    nibble->nodes[low_nibble] = NULL;
-    nibble->children--;
+    GNT_PROBE_END(trie, GNT_OP_DELETE);
+    
+    return status;
+}
+
+static GNT_FORCE_INLINE int _gnt_compare(const gnt_byte_t* a, gnt_index_t a_length, const gnt_byte_t* b, gnt_index_t b_length)
+{
+    int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+    
+    // A key orders before the longer keys it is a prefix of
+    return order ? order : (a_length > b_length) - (a_length < b_length);
+}
+
+static GNT_FORCE_INLINE uint8_t _gnt_match(gnt_node_t* node, const gnt_byte_t* bytes, gnt_index_t length)
+{
+    uint8_t matched = 0;
     
-    if (nibble->children)
+    while (matched < node->length && matched < length && bytes[matched] == node->prefix[matched])
     {
-        return STOP;
+        matched++;
     }
     
-    return CONTINUE;
+    return matched;
+}
+
+static GNT_FORCE_INLINE gnt_nibble_t** _gnt_nibble_slot(gnt_node_t* node, gnt_byte_t high_nibble)
+{
+    return (node->map & GNT_BIT(high_nibble)) ? &node->nibbles[GNT_RANK(node->map, high_nibble)] : NULL;
+}
+
+static GNT_FORCE_INLINE gnt_node_t** _gnt_node_slot(gnt_nibble_t* nibble, gnt_byte_t low_nibble)
+{
+    return (nibble->map & GNT_BIT(low_nibble)) ? &nibble->nodes[GNT_RANK(nibble->map, low_nibble)] : NULL;
+}
+
+static GNT_FORCE_INLINE void* _gnt_resolve(gnt_trie_t* trie, void* child)
+{
+    // Children of a mapped image are stored as offsets from its start, 0 standing for none
+    return trie->base && child ? (void*) (trie->base + (uintptr_t) child) : child;
+}
+
+static GNT_FORCE_INLINE gnt_nibble_t* _gnt_nibble_get(gnt_trie_t* trie, gnt_node_t* node, gnt_byte_t high_nibble)
+{
+    gnt_nibble_t** slot = node ? _gnt_nibble_slot(node, high_nibble) : &trie->nibbles[high_nibble];
+    return slot ? _gnt_resolve(trie, *slot) : NULL;
+}
+
+static GNT_FORCE_INLINE gnt_node_t* _gnt_node_get(gnt_trie_t* trie, gnt_nibble_t* nibble, gnt_byte_t low_nibble)
+{
+    gnt_node_t** slot = _gnt_node_slot(nibble, low_nibble);
+    return slot ? _gnt_resolve(trie, *slot) : NULL;
+}
+
+static GNT_FORCE_INLINE uint64_t _gnt_journal_clock(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static GNT_FORCE_INLINE uint32_t _gnt_checksum(const char* bytes, size_t size)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ (uint8_t) bytes[i]) * 16777619u;
+    }
+    
+    return hash;
+}
+
+static GNT_FORCE_INLINE bool _gnt_map_node(gnt_trie_t* trie, const gnt_byte_t* key, gnt_index_t depth, gnt_node_t* node, gnt_mapper_t mapper, void* context)
+{
+    gnt_data_t data = node->data;
+    
+    if (0 != mapper(key, depth, &node->data, context))
+    {
+        return true;
+    }
+    
+    // Values changed in place are logged like inserts, a log that can't be written anymore stops the pass
+    return trie->journal && data != node->data && 0 != _gnt_journal_append(trie, GNT_JOURNAL_INSERT, key, depth, node->data);
+}
+
+static GNT_FORCE_INLINE void _gnt_root_refresh(gnt_trie_t* trie, gnt_byte_t byte)
+{
+    // Only writes to keys starting with the byte can replace the node below it, they refresh it once done
+    if (trie->roots)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, NULL, GNT_HIGH_NIBBLE(byte));
+        trie->roots[byte] = nibble ? _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(byte)) : NULL;
+    }
+}
+
+static GNT_FORCE_INLINE gnt_nibble_t* _gnt_own(gnt_shard_t* shard, gnt_nibble_t** slot)
+{
+    gnt_trie_t* trie = shard->trie;
+    
+    // Without open snapshots, or once copied in this version, a nibble and its nodes are written in place
+    if (!trie->snapshots || (*slot)->generation == trie->generation)
+    {
+        return *slot;
+    }
+    
+    return _gnt_copy(shard, slot);
+}
+
+gnt_trie_t* gnt_create(gnt_cfg_t* cfg)
+{
+    gnt_accessor_t accessor;
+    gnt_span_accessor_t span_accessor;
+    gnt_deallocator_t deallocator;
+    gnt_allocator_t allocator;
+    gnt_releaser_t releaser;
+    gnt_flags_t flags;
+    gnt_observer_t observer;
+    
+    if (cfg)
+    {
+        accessor = cfg->accessor ? cfg->accessor : _gnt_accessor_default;
+        span_accessor = cfg->span_accessor;
+        deallocator = cfg->deallocator;
+        allocator = cfg->allocator && cfg->releaser ? cfg->allocator : malloc;
+        releaser = cfg->allocator && cfg->releaser ? cfg->releaser : free;
+        flags = cfg->flags;
+        observer = cfg->observer;
+    }
+    else
+    {
+        accessor = _gnt_accessor_default;
+        span_accessor = NULL;
+        deallocator = NULL;
+        allocator = malloc;
+        releaser = free;
+        flags = 0;
+        observer = NULL;
+    }
+    
+    uint8_t shards = (flags & GNT_FLAG_SHARDED) ? 16 : 1;
+    size_t roots = (flags & GNT_FLAG_WIDE_ROOT) ? 256 * sizeof(gnt_node_t*) : 0;
+    gnt_trie_t* trie = allocator(sizeof(gnt_trie_t) + shards * sizeof(gnt_shard_t) + roots);
+    
+    if (trie)
+    {
+        memset(trie, 0, sizeof(gnt_trie_t) + shards * sizeof(gnt_shard_t) + roots);
+        
+        for (uint8_t i = 0; i < shards; i++)
+        {
+            gnt_shard_t* shard = &trie->shards[i];
+            
+            if (!GNT_MUTEX_CREATE(shard))
+            {
+                while (i--)
+                {
+                    GLL_MUTEX_DESTROY((&trie->shards[i]));
+                }
+                
+                releaser(trie);
+                return NULL;
+            }
+            
+            atomic_init(&shard->readers, 0);
+            shard->trie = trie;
+            
+            for (uint8_t class = 0; class < GNT_POOL_CLASSES; class++)
+            {
+                shard->pools[class].size = class < 5 ? GNT_NIBBLE_SIZE(1u << class) : GNT_NODE_SIZE(class > 5 ? 1u << (class - 6) : 0);
+                shard->pools[class].bytes = GNT_SLAB_MIN;
+            }
+        }
+        
+        atomic_init(&trie->children, 0);
+        trie->accessor = accessor;
+        trie->span_accessor = span_accessor;
+        trie->deallocator = deallocator;
+        trie->allocator = allocator;
+        trie->releaser = releaser;
+        trie->flags = flags;
+        trie->mask = shards - 1;
+        trie->observer = observer;
+        trie->roots = roots ? (gnt_node_t**) &trie->shards[shards] : NULL;
+        trie->budget = cfg ? cfg->budget : 0;
+        atomic_init(&trie->used, 0);
+        
+        // A log left with records belongs to gnt_recover, a fresh trie only starts an empty one
+        if (cfg && cfg->journal && 0 != _gnt_journal_open(trie, cfg, 0))
+        {
+            gnt_destroy(trie);
+            return NULL;
+        }
+    }
+    
+    return trie;
+}
+
+gnt_status_t gnt_destroy(gnt_trie_t* trie)
+{
+    if (!trie || (!trie->origin && trie->snapshots) || trie->replicas) return -1;
+    
+    gnt_status_t status = trie->journal ? _gnt_journal_close(trie) : 0;
+    
+    if (trie->origin)
+    {
+        gnt_trie_t* origin = trie->origin;
+        gnt_trie_t** link = &origin->snapshots;
+        
+        _gnt_lock_all(origin, true);
+        
+        while (*link != trie)
+        {
+            link = &(*link)->snapshots;
+        }
+        
+        *link = trie->snapshots;
+        trie->snapshots = NULL;
+        _gnt_reclaim(origin);
+        
+        _gnt_unlock_all(origin, true);
+    }
+    else if (trie->block)
+    {
+        trie->releaser(trie->block);
+    }
+    else if (trie->base)
+    {
+        munmap((void*) trie->base, trie->size);
+    }
+    
+    else
+    {
+        _gnt_release(trie);
+    }
+    
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        if (trie->shards[i].pending)
+        {
+            trie->releaser(trie->shards[i].pending);
+        }
+        
+        if (trie->shards[i].retired)
+        {
+            trie->releaser(trie->shards[i].retired);
+        }
+        
+        if (trie->shards[i].hand)
+        {
+            trie->releaser(trie->shards[i].hand);
+        }
+        
+        _gnt_pool_destroy(&trie->shards[i]);
+        GLL_MUTEX_DESTROY((&trie->shards[i]));
+    }
+    
+    trie->releaser(trie);
+    
+    return status;
+}
+
+gnt_status_t gnt_clear(gnt_trie_t* trie)
+{
+    if (!trie || trie->base || trie->origin) return -1;
+    
+    _gnt_lock_all(trie, true);
+    
+    // Open snapshots still read the nodes
+    if (trie->snapshots)
+    {
+        _gnt_unlock_all(trie, true);
+        return -1;
+    }
+    
+    _gnt_release(trie);
+    
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        gnt_shard_t* shard = &trie->shards[i];
+        
+        if (shard->pending)
+        {
+            trie->releaser(shard->pending);
+        }
+        
+        shard->pending = NULL;
+        shard->pending_size = 0;
+        shard->pending_capacity = 0;
+        shard->hand_length = 0;
+        shard->used = 0;
+        shard->tally = (gnt_tally_t) {0};
+        shard->epoch++;
+        _gnt_pool_destroy(shard);
+    }
+    
+    memset(trie->nibbles, 0, sizeof(trie->nibbles));
+    atomic_store(&trie->children, 0);
+    atomic_store(&trie->used, 0);
+    
+    if (trie->roots)
+    {
+        memset(trie->roots, 0, 256 * sizeof(gnt_node_t*));
+    }
+    
+    gnt_status_t status = trie->journal ? _gnt_journal_append(trie, GNT_JOURNAL_CLEAR, NULL, 0, 0) : 0;
+    
+    _gnt_unlock_all(trie, true);
+    
+    return status;
+}
+
+gnt_status_t gnt_insert(gnt_trie_t* trie, gnt_key_t key, gnt_data_t data)
+{
+    if (!trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return -1;
+    }
+    
+    gnt_status_t status = gnt_insert_bytes(trie, span.bytes, span.length, data);
+    _gnt_span_release(trie, &span);
+    
+    return status;
+}
+
+gnt_data_t gnt_search(gnt_trie_t* trie, gnt_key_t key)
+{
+    if (!trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return 0;
+    }
+    
+    gnt_data_t data = gnt_search_bytes(trie, span.bytes, span.length);
+    _gnt_span_release(trie, &span);
+    
+    return data;
+}
+
+gnt_data_t gnt_search_ex(gnt_trie_t* trie, gnt_key_t key, bool* found)
+{
+    if (found) *found = false;
+    if (!trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return 0;
+    }
+    
+    gnt_data_t data = 0;
+    
+    if (span.length)
+    {
+        gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(span.bytes[0]));
+        
+        GNT_PROBE_BEGIN();
+        GNT_READ_LOCK(trie, shard);
+        gnt_node_t* node = _gnt_search(trie, span.bytes, span.length);
+        
+        if (node && node->occupied)
+        {
+            data = node->data;
+            
+            if (found) *found = true;
+        }
+        
+        GNT_READ_UNLOCK(trie, shard);
+        GNT_PROBE_END(trie, GNT_OP_SEARCH);
+    }
+    
+    _gnt_span_release(trie, &span);
+    
+    return data;
+}
+
+gnt_status_t gnt_update(gnt_trie_t* trie, gnt_key_t key, gnt_updater_t updater, void* context)
+{
+    if (!trie || !updater) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return -1;
+    }
+    
+    if (!span.length)
+    {
+        _gnt_span_release(trie, &span);
+        return -1;
+    }
+    
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(span.bytes[0]));
+    
+    GNT_WRITE_LOCK(trie, shard);
+    
+    // Reaches or creates the node in the same descent, the updater then works on its data in place
+    gnt_node_t* node = _gnt_reserve(trie, shard, span.bytes, span.length, NULL);
+    
+    if (node)
+    {
+        bool found = node->occupied;
+        
+        if (!found)
+        {
+            node->data = 0;
+            shard->tally.values++;
+            shard->tally.key_bytes += span.length;
+        }
+        
+        updater(&node->data, found, context);
+        
+        // An update is a use of the key, it keeps or gains its second chance against eviction
+        node->occupied |= true;
+        _gnt_touch(trie, node);
+    }
+    
+    _gnt_root_refresh(trie, span.bytes[0]);
+    
+    gnt_status_t status = !node ? -1 : (trie->journal ? _gnt_journal_append(trie, GNT_JOURNAL_INSERT, span.bytes, span.length, node->data) : 0);
+    
+    GNT_WRITE_UNLOCK(trie, shard);
+    
+    _gnt_span_release(trie, &span);
+    
+    return status;
+}
+
+gnt_status_t gnt_delete(gnt_trie_t* trie, gnt_key_t key)
+{
+    if (!trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return -1;
+    }
+    
+    gnt_status_t status = gnt_delete_bytes(trie, span.bytes, span.length);
+    _gnt_span_release(trie, &span);
+    
+    return status;
+}
+
+gnt_status_t gnt_insert_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_data_t data)
+{
+    if (!trie || !bytes || !length) return -1;
+    
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(*(const gnt_byte_t*) bytes));
+    
+    GNT_PROBE_BEGIN();
+    gnt_status_t status;
+    
+    if (trie->flags & GNT_FLAG_COMBINING)
+    {
+        status = _gnt_combine(trie, shard, bytes, length, data, GNT_OP_INSERT);
+    }
+    else
+    {
+        GNT_WRITE_LOCK(trie, shard);
+        status = _gnt_insert(trie, shard, bytes, length, data, NULL);
+        GNT_WRITE_UNLOCK(trie, shard);
+    }
+    
+    GNT_PROBE_END(trie, GNT_OP_INSERT);
+    
+    return status;
+}
+
+gnt_data_t gnt_search_bytes(gnt_trie_t* trie, const void* bytes, size_t length)
+{
+    if (!trie) return -1;
+    if (!bytes || !length) return 0;
+    
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(*(const gnt_byte_t*) bytes));
+    
+    GNT_PROBE_BEGIN();
+    GNT_READ_LOCK(trie, shard);
+    gnt_node_t* node = _gnt_search(trie, bytes, length);
+    gnt_data_t data = node ? node->data : 0;
+    GNT_READ_UNLOCK(trie, shard);
+    GNT_PROBE_END(trie, GNT_OP_SEARCH);
+    
+    return data;
+}
+
+gnt_status_t gnt_delete_bytes(gnt_trie_t* trie, const void* bytes, size_t length)
+{
+    if (!trie || !bytes || !length) return -1;
+    
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(*(const gnt_byte_t*) bytes));
+    
+    GNT_PROBE_BEGIN();
+    gnt_status_t status;
+    
+    if (trie->flags & GNT_FLAG_COMBINING)
+    {
+        status = _gnt_combine(trie, shard, bytes, length, 0, GNT_OP_DELETE);
+    }
+    else
+    {
+        GNT_WRITE_LOCK(trie, shard);
+        status = MISSING == _gnt_delete(trie, shard, bytes, length) ? -1 : 0;
+        GNT_WRITE_UNLOCK(trie, shard);
+    }
+    
+    GNT_PROBE_END(trie, GNT_OP_DELETE);
+    
+    return status;
+}
+
+gnt_status_t gnt_compact(gnt_trie_t* trie, size_t budget)
+{
+    if (!trie) return -1;
+    
+    size_t pruned = 0;
+    bool left = false;
+    
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        gnt_shard_t* shard = &trie->shards[i];
+        
+        GNT_WRITE_LOCK(trie, shard);
+        
+        if (!budget || pruned < budget)
+        {
+            pruned += _gnt_compact_shard(trie, shard, budget ? budget - pruned : 0);
+        }
+        
+        left |= shard->pending_size != 0;
+        
+        GNT_WRITE_UNLOCK(trie, shard);
+    }
+    
+    return left ? 1 : 0;
+}
+
+gnt_status_t gnt_insert_u32(gnt_trie_t* trie, uint32_t key, gnt_data_t data)
+{
+    return _gnt_insert_integer(trie, key, sizeof(uint32_t), data);
+}
+
+gnt_data_t gnt_search_u32(gnt_trie_t* trie, uint32_t key)
+{
+    return _gnt_search_integer(trie, key, sizeof(uint32_t));
+}
+
+gnt_status_t gnt_delete_u32(gnt_trie_t* trie, uint32_t key)
+{
+    return _gnt_delete_integer(trie, key, sizeof(uint32_t));
+}
+
+gnt_status_t gnt_insert_u64(gnt_trie_t* trie, uint64_t key, gnt_data_t data)
+{
+    return _gnt_insert_integer(trie, key, sizeof(uint64_t), data);
+}
+
+gnt_data_t gnt_search_u64(gnt_trie_t* trie, uint64_t key)
+{
+    return _gnt_search_integer(trie, key, sizeof(uint64_t));
+}
+
+gnt_status_t gnt_delete_u64(gnt_trie_t* trie, uint64_t key)
+{
+    return _gnt_delete_integer(trie, key, sizeof(uint64_t));
+}
+
+gnt_status_t gnt_hint_init(gnt_hint_t* hint, gnt_trie_t* trie)
+{
+    if (!hint || !trie) return -1;
+    
+    hint->trie = trie;
+    hint->epoch = 0;
+    hint->depth = 0;
+    hint->length = 0;
+    hint->written = false;
+    
+    return 0;
+}
+
+gnt_status_t gnt_hint_insert(gnt_hint_t* hint, gnt_key_t key, gnt_data_t data)
+{
+    if (!hint || !hint->trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(hint->trie, &span, key))
+    {
+        return -1;
+    }
+    
+    gnt_status_t status = gnt_hint_insert_bytes(hint, span.bytes, span.length, data);
+    _gnt_span_release(hint->trie, &span);
+    
+    return status;
+}
+
+gnt_data_t gnt_hint_search(gnt_hint_t* hint, gnt_key_t key)
+{
+    if (!hint || !hint->trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(hint->trie, &span, key))
+    {
+        return 0;
+    }
+    
+    gnt_data_t data = gnt_hint_search_bytes(hint, span.bytes, span.length);
+    _gnt_span_release(hint->trie, &span);
+    
+    return data;
+}
+
+gnt_status_t gnt_hint_insert_bytes(gnt_hint_t* hint, const void* bytes, size_t length, gnt_data_t data)
+{
+    if (!hint || !hint->trie || !bytes || !length) return -1;
+    
+    gnt_trie_t* trie = hint->trie;
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(*(const gnt_byte_t*) bytes));
+    gnt_path_t path = {hint->slots, hint->indexes, 0, GNT_HINT_DEPTH};
+    
+    GNT_PROBE_BEGIN();
+    GNT_WRITE_LOCK(trie, shard);
+    path.depth = _gnt_hint_resume(hint, shard, bytes, length, true);
+    gnt_status_t status = _gnt_insert(trie, shard, bytes, length, data, &path);
+    _gnt_hint_keep(hint, shard, 0 == status ? &path : NULL, bytes, length, true);
+    GNT_WRITE_UNLOCK(trie, shard);
+    GNT_PROBE_END(trie, GNT_OP_INSERT);
+    
+    return status;
+}
+
+gnt_data_t gnt_hint_search_bytes(gnt_hint_t* hint, const void* bytes, size_t length)
+{
+    if (!hint || !hint->trie) return -1;
+    if (!bytes || !length) return 0;
+    
+    gnt_trie_t* trie = hint->trie;
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(*(const gnt_byte_t*) bytes));
+    gnt_path_t path = {hint->slots, hint->indexes, 0, GNT_HINT_DEPTH};
+    
+    GNT_PROBE_BEGIN();
+    GNT_READ_LOCK(trie, shard);
+    path.depth = _gnt_hint_resume(hint, shard, bytes, length, false);
+    gnt_node_t* node = _gnt_search_path(trie, bytes, length, &path);
+    gnt_data_t data = node ? node->data : 0;
+    _gnt_hint_keep(hint, shard, &path, bytes, length, false);
+    GNT_READ_UNLOCK(trie, shard);
+    GNT_PROBE_END(trie, GNT_OP_SEARCH);
+    
+    return data;
+}
+
+gnt_status_t gnt_hint_insert_u64(gnt_hint_t* hint, uint64_t key, gnt_data_t data)
+{
+    if (!hint || !hint->trie) return -1;
+    
+    gnt_byte_t buffer[sizeof(uint64_t)];
+    gnt_index_t length;
+    const gnt_byte_t* bytes = _gnt_encode(buffer, key, sizeof(uint64_t), hint->trie->flags & GNT_FLAG_FIXED_WIDTH, &length);
+    
+    return gnt_hint_insert_bytes(hint, bytes, length, data);
+}
+
+gnt_data_t gnt_hint_search_u64(gnt_hint_t* hint, uint64_t key)
+{
+    if (!hint || !hint->trie) return -1;
+    
+    gnt_byte_t buffer[sizeof(uint64_t)];
+    gnt_index_t length;
+    const gnt_byte_t* bytes = _gnt_encode(buffer, key, sizeof(uint64_t), hint->trie->flags & GNT_FLAG_FIXED_WIDTH, &length);
+    
+    return gnt_hint_search_bytes(hint, bytes, length);
+}
+
+gnt_status_t gnt_bulk_load(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count)
+{
+    if (!trie || (count && (!keys || !data))) return -1;
+    
+    gnt_load_t load = {trie, keys, data, count, 0};
+    
+    _gnt_lock_all(trie, true);
+    _gnt_bulk_load(&load);
+    _gnt_unlock_all(trie, true);
+    
+    return load.status;
+}
+
+gnt_status_t gnt_bulk_load_parallel(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count)
+{
+    if (!trie || (count && (!keys || !data))) return -1;
+    
+    // Shards have their own pools, without them the subtries would race on allocation
+    if (!(trie->flags & GNT_FLAG_SHARDED))
+    {
+        return gnt_bulk_load(trie, keys, data, count);
+    }
+    
+    gnt_load_t loads[16];
+    thrd_t threads[16];
+    bool started[16] = {false};
+    uint8_t runs = 0;
+    uint16_t seen = 0;
+    gnt_byte_t last = 0;
+    gnt_span_t span;
+    
+    // Sorted keys come in one run per root slot, each run is loaded by its own thread
+    for (size_t i = 0; i < count; i++)
+    {
+        if (0 != _gnt_span_load(trie, &span, keys[i]))
+        {
+            return -1;
+        }
+        
+        if (!span.length)
+        {
+            _gnt_span_release(trie, &span);
+            return -1;
+        }
+        
+        gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(span.bytes[0]);
+        _gnt_span_release(trie, &span);
+        
+        if (runs && high_nibble == last)
+        {
+            loads[runs - 1].count++;
+            continue;
+        }
+        
+        if (seen & GNT_BIT(high_nibble))
+        {
+            return gnt_bulk_load(trie, keys, data, count); // Unsorted, the runs would overlap
+        }
+        
+        seen |= GNT_BIT(high_nibble);
+        last = high_nibble;
+        loads[runs++] = (gnt_load_t) {trie, keys + i, data + i, 1, 0};
+    }
+    
+    gnt_status_t status = 0;
+    
+    _gnt_lock_all(trie, true);
+    
+    for (uint8_t i = 0; i < runs; i++)
+    {
+        started[i] = thrd_success == thrd_create(&threads[i], _gnt_bulk_load, &loads[i]);
+        
+        if (!started[i])
+        {
+            _gnt_bulk_load(&loads[i]);
+        }
+    }
+    
+    for (uint8_t i = 0; i < runs; i++)
+    {
+        if (started[i])
+        {
+            thrd_join(threads[i], NULL);
+        }
+        
+        if (0 != loads[i].status)
+        {
+            status = -1;
+        }
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    return status;
+}
+
+gnt_status_t gnt_insert_batch(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count)
+{
+    if (!trie || (count && (!keys || !data))) return -1;
+    
+    gnt_status_t status = 0;
+    gnt_span_t span;
+    
+    _gnt_lock_all(trie, true);
+    
+    for (size_t i = 0; i < count && 0 == status; i++)
+    {
+        if (0 != _gnt_span_load(trie, &span, keys[i]))
+        {
+            status = -1;
+            break;
+        }
+        
+        status = span.length ? _gnt_insert(trie, GNT_SHARD(trie, GNT_HIGH_NIBBLE(span.bytes[0])), span.bytes, span.length, data[i], NULL) : -1;
+        _gnt_span_release(trie, &span);
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    return status;
+}
+
+gnt_status_t gnt_search_batch(gnt_trie_t* trie, const gnt_key_t* keys, gnt_data_t* data, bool* found, size_t count)
+{
+    if (!trie || (count && (!keys || !data))) return -1;
+    
+    gnt_lane_t lanes[GNT_BATCH_WIDTH];
+    uint8_t active = 0;
+    size_t next = 0;
+    gnt_status_t status = 0;
+    
+    _gnt_lock_all(trie, false);
+    
+    // Walks up to GNT_BATCH_WIDTH keys in lockstep, each step touches memory prefetched by the previous one
+    while (active < GNT_BATCH_WIDTH && next < count && 0 == status)
+    {
+        status = _gnt_lane_load(trie, &lanes[active], keys, next++);
+        
+        // Only lanes whose key was loaded are walked
+        if (0 == status)
+        {
+            active++;
+        }
+    }
+    
+    while (active)
+    {
+        for (uint8_t i = 0; i < active; i++)
+        {
+            gnt_lane_t* lane = &lanes[i];
+            
+            if (!_gnt_search_step(trie, lane))
+            {
+                continue;
+            }
+            
+            data[lane->position] = lane->node ? lane->node->data : 0;
+            _gnt_touch(trie, lane->node);
+            
+            if (found)
+            {
+                found[lane->position] = lane->node && lane->node->occupied;
+            }
+            
+            _gnt_span_release(trie, &lane->span);
+            
+            if (next < count && 0 == status)
+            {
+                status = _gnt_lane_load(trie, lane, keys, next++);
+                
+                if (0 == status)
+                {
+                    continue;
+                }
+            }
+            
+            // Lanes are retired once the keys run out or one of them fails to load, the others finish their walk
+            *lane = lanes[--active];
+            i--;
+        }
+    }
+    
+    _gnt_unlock_all(trie, false);
+    
+    return status;
+}
+
+gnt_status_t gnt_search_batch_u32(gnt_trie_t* trie, const uint32_t* keys, gnt_data_t* data, uint64_t* found, size_t count)
+{
+    return _gnt_search_batch_integer(trie, keys, sizeof(uint32_t), data, found, count);
+}
+
+gnt_status_t gnt_search_batch_u64(gnt_trie_t* trie, const uint64_t* keys, gnt_data_t* data, uint64_t* found, size_t count)
+{
+    return _gnt_search_batch_integer(trie, keys, sizeof(uint64_t), data, found, count);
+}
+
+gnt_status_t gnt_delete_batch(gnt_trie_t* trie, const gnt_key_t* keys, bool* found, size_t count)
+{
+    if (!trie || (count && !keys) || trie->base || trie->origin) return -1;
+    
+    gnt_status_t status = 0;
+    gnt_span_t span;
+    
+    _gnt_lock_all(trie, true);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        gnt_status_t deleted = MISSING;
+        
+        if (0 != _gnt_span_load(trie, &span, keys[i]))
+        {
+            status = -1;
+        }
+        else
+        {
+            if (span.length)
+            {
+                deleted = _gnt_delete(trie, GNT_SHARD(trie, GNT_HIGH_NIBBLE(span.bytes[0])), span.bytes, span.length);
+            }
+            
+            _gnt_span_release(trie, &span);
+        }
+        
+        if (found)
+        {
+            found[i] = MISSING != deleted;
+        }
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    return status;
+}
+
+gnt_status_t gnt_cursor_init(gnt_cursor_t* cursor, gnt_trie_t* trie)
+{
+    if (!cursor || !trie) return -1;
+    
+    cursor->trie = trie;
+    cursor->positioned = false;
+    cursor->length = 0;
+    cursor->data = 0;
+    
+    return 0;
+}
+
+gnt_status_t gnt_seek(gnt_cursor_t* cursor, gnt_key_t key)
+{
+    if (!cursor || !cursor->trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(cursor->trie, &span, key))
+    {
+        return -1;
+    }
+    
+    gnt_status_t status = gnt_seek_bytes(cursor, span.bytes, span.length);
+    _gnt_span_release(cursor->trie, &span);
+    
+    return status;
+}
+
+gnt_status_t gnt_seek_bytes(gnt_cursor_t* cursor, const void* bytes, size_t length)
+{
+    if (!cursor || !cursor->trie || (length && !bytes)) return -1;
+    
+    gnt_trie_t* trie = cursor->trie;
+    gnt_byte_t target[GNT_CURSOR_KEY_MAX];
+    
+    // Keys stored past the cut are skipped anyway, and every other key above it is also above the full target
+    bool inclusive = length <= GNT_CURSOR_KEY_MAX;
+    length = inclusive ? length : GNT_CURSOR_KEY_MAX;
+    
+    memcpy(target, bytes, length);
+    
+    _gnt_lock_all(trie, false);
+    gnt_status_t status = _gnt_cursor_move(cursor, target, length, true, inclusive);
+    _gnt_unlock_all(trie, false);
+    
+    return status;
+}
+
+gnt_status_t gnt_next(gnt_cursor_t* cursor)
+{
+    if (!cursor || !cursor->trie) return -1;
+    
+    gnt_trie_t* trie = cursor->trie;
+    gnt_byte_t target[GNT_CURSOR_KEY_MAX];
+    gnt_index_t length = cursor->positioned ? cursor->length : 0;
+    
+    memcpy(target, cursor->key, length);
+    
+    _gnt_lock_all(trie, false);
+    gnt_status_t status = _gnt_cursor_move(cursor, target, length, true, false);
+    _gnt_unlock_all(trie, false);
+    
+    return status;
+}
+
+gnt_status_t gnt_prev(gnt_cursor_t* cursor)
+{
+    if (!cursor || !cursor->trie) return -1;
+    
+    gnt_trie_t* trie = cursor->trie;
+    gnt_byte_t target[GNT_CURSOR_KEY_MAX];
+    gnt_index_t length = cursor->length;
+    bool positioned = cursor->positioned;
+    
+    memcpy(target, cursor->key, positioned ? length : 0);
+    
+    _gnt_lock_all(trie, false);
+    gnt_status_t status = _gnt_cursor_move(cursor, positioned ? target : NULL, length, false, false);
+    _gnt_unlock_all(trie, false);
+    
+    return status;
+}
+
+gnt_status_t gnt_range(gnt_trie_t* trie, gnt_key_t lo, gnt_key_t hi, gnt_visitor_t visitor, void* context)
+{
+    if (!trie || !visitor) return -1;
+    
+    gnt_span_t low, high;
+    gnt_cursor_t cursor;
+    
+    if (0 != _gnt_span_load(trie, &low, lo))
+    {
+        return -1;
+    }
+    
+    if (0 != _gnt_span_load(trie, &high, hi))
+    {
+        _gnt_span_release(trie, &low);
+        return -1;
+    }
+    
+    gnt_cursor_init(&cursor, trie);
+    
+    bool inclusive = low.length <= GNT_CURSOR_KEY_MAX;
+    gnt_index_t length = inclusive ? low.length : GNT_CURSOR_KEY_MAX;
+    
+    _gnt_lock_all(trie, false);
+    
+    gnt_status_t status = _gnt_cursor_move(&cursor, low.bytes, length, true, inclusive);
+    
+    while (0 == status)
+    {
+        gnt_index_t common = cursor.length < high.length ? cursor.length : high.length;
+        int order = memcmp(cursor.key, high.bytes, common);
+        
+        if (order > 0 || (0 == order && cursor.length > high.length))
+        {
+            break;
+        }
+        
+        if (0 != visitor(cursor.key, cursor.length, cursor.data, context))
+        {
+            break;
+        }
+        
+        gnt_byte_t target[GNT_CURSOR_KEY_MAX];
+        memcpy(target, cursor.key, cursor.length);
+        status = _gnt_cursor_move(&cursor, target, cursor.length, true, false);
+    }
+    
+    _gnt_unlock_all(trie, false);
+    
+    _gnt_span_release(trie, &high);
+    _gnt_span_release(trie, &low);
+    
+    return 0;
+}
+
+gnt_data_t gnt_longest_prefix(gnt_trie_t* trie, gnt_key_t key, gnt_index_t* matched)
+{
+    if (matched) *matched = 0;
+    if (!trie) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, key))
+    {
+        return 0;
+    }
+    
+    gnt_data_t data = gnt_longest_prefix_bytes(trie, span.bytes, span.length, matched);
+    _gnt_span_release(trie, &span);
+    
+    return data;
+}
+
+gnt_data_t gnt_longest_prefix_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_index_t* matched)
+{
+    if (matched) *matched = 0;
+    if (!trie) return -1;
+    if (!bytes || !length) return 0;
+    
+    const gnt_byte_t* key = bytes;
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(key[0]));
+    gnt_node_t* node = NULL;
+    gnt_node_t* deepest = NULL;
+    gnt_index_t index = 0;
+    gnt_index_t depth = 0;
+    
+    GNT_READ_LOCK(trie, shard);
+    
+    // Every prefix of the key lies on its search path, the last occupied node reached is the longest one stored
+    while (index < length)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, node, GNT_HIGH_NIBBLE(key[index]));
+        
+        if (!nibble || !(node = _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(key[index]))))
+        {
+            break;
+        }
+        
+        index++;
+        
+        if (node->length > length - index || 0 != memcmp(node->prefix, key + index, node->length))
+        {
+            break;
+        }
+        
+        index += node->length;
+        
+        if (node->occupied)
+        {
+            deepest = node;
+            depth = index;
+        }
+    }
+    
+    gnt_data_t data = deepest ? deepest->data : 0;
+    
+    GNT_READ_UNLOCK(trie, shard);
+    
+    if (matched) *matched = depth;
+    
+    return data;
+}
+
+gnt_status_t gnt_prefix_foreach(gnt_trie_t* trie, gnt_key_t prefix, gnt_visitor_t visitor, void* context)
+{
+    if (!trie || !visitor) return -1;
+    
+    gnt_span_t span;
+    
+    if (0 != _gnt_span_load(trie, &span, prefix))
+    {
+        return -1;
+    }
+    
+    gnt_status_t status = gnt_prefix_foreach_bytes(trie, span.bytes, span.length, visitor, context);
+    _gnt_span_release(trie, &span);
+    
+    return status;
+}
+
+gnt_status_t gnt_prefix_foreach_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_visitor_t visitor, void* context)
+{
+    if (!trie || !visitor || (length && !bytes)) return -1;
+    if (length > GNT_CURSOR_KEY_MAX) return 0;
+    
+    const gnt_byte_t* prefix = bytes;
+    gnt_byte_t key[GNT_CURSOR_KEY_MAX];
+    gnt_node_t* node = NULL;
+    gnt_index_t index = 0;
+    
+    // An empty prefix matches every key, otherwise only the subtrie of its first byte is involved
+    if (!length)
+    {
+        _gnt_lock_all(trie, false);
+        _gnt_visit(trie, key, NULL, 0, visitor, context);
+        _gnt_unlock_all(trie, false);
+        return 0;
+    }
+    
+    gnt_shard_t* shard = GNT_SHARD(trie, GNT_HIGH_NIBBLE(prefix[0]));
+    
+    GNT_READ_LOCK(trie, shard);
+    
+    while (index < length)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, node, GNT_HIGH_NIBBLE(prefix[index]));
+        
+        if (!nibble || !(node = _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(prefix[index]))))
+        {
+            node = NULL;
+            break;
+        }
+        
+        key[index] = prefix[index];
+        index++;
+        
+        // The prefix may end within the bytes compressed in this node, in which case its whole subtrie matches
+        gnt_index_t rest = length - index;
+        
+        if (0 != memcmp(node->prefix, prefix + index, node->length < rest ? node->length : rest) || index + node->length > GNT_CURSOR_KEY_MAX)
+        {
+            node = NULL;
+            break;
+        }
+        
+        memcpy(key + index, node->prefix, node->length);
+        index += node->length;
+    }
+    
+    if (node)
+    {
+        _gnt_visit(trie, key, node, index, visitor, context);
+    }
+    
+    GNT_READ_UNLOCK(trie, shard);
+    
+    return 0;
+}
+
+gnt_status_t gnt_foreach(gnt_trie_t* trie, gnt_mapper_t mapper, void* context)
+{
+    if (!trie || !mapper || trie->base || trie->origin) return -1;
+    
+    atomic_bool stop = false;
+    gnt_byte_t key[GNT_CURSOR_KEY_MAX];
+    
+    _gnt_lock_all(trie, true);
+    
+    gnt_status_t status = _gnt_own_all(trie);
+    
+    if (0 == status)
+    {
+        _gnt_map(trie, key, NULL, 0, mapper, context, &stop);
+        status = trie->journal ? trie->journal->status : 0;
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    return status;
+}
+
+gnt_status_t gnt_parallel_foreach(gnt_trie_t* trie, size_t threads, gnt_mapper_t mapper, gnt_reducer_t reducer, void** contexts)
+{
+    if (!trie || !threads || !mapper || trie->base || trie->origin) return -1;
+    
+    if (1 == threads)
+    {
+        return gnt_foreach(trie, mapper, contexts ? contexts[0] : NULL);
+    }
+    
+    size_t target = threads * GNT_PASS_TASKS;
+    
+    // Splitting never leaves more than a node's worth of tasks over the target
+    gnt_pass_t pass = {trie, mapper, trie->allocator((target + 256) * sizeof(gnt_task_t)), 0, 0, false};
+    gnt_worker_t* workers = trie->allocator(threads * (sizeof(gnt_worker_t) + sizeof(thrd_t) + sizeof(bool)));
+    
+    if (!pass.tasks || !workers)
+    {
+        if (pass.tasks) trie->releaser(pass.tasks);
+        if (workers) trie->releaser(workers);
+        return -1;
+    }
+    
+    thrd_t* handles = (thrd_t*) (workers + threads);
+    bool* started = (bool*) (handles + threads);
+    
+    _gnt_lock_all(trie, true);
+    
+    // Data shared with snapshots is copied beforehand, the threads would otherwise race on the pools
+    if (0 != _gnt_own_all(trie))
+    {
+        _gnt_unlock_all(trie, true);
+        trie->releaser(pass.tasks);
+        trie->releaser(workers);
+        return -1;
+    }
+    
+    pass.count = _gnt_partition(&pass, target, contexts ? contexts[0] : NULL);
+    
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers[i] = (gnt_worker_t) {&pass, contexts ? contexts[i] : NULL};
+        started[i] = i && thrd_success == thrd_create(&handles[i], _gnt_pass, &workers[i]);
+    }
+    
+    // The calling thread takes part, and also runs the threads that could not be started once the tasks are taken
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (!started[i])
+        {
+            _gnt_pass(&workers[i]);
+        }
+    }
+    
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (started[i])
+        {
+            thrd_join(handles[i], NULL);
+        }
+    }
+    
+    gnt_status_t status = trie->journal ? trie->journal->status : 0;
+    
+    _gnt_unlock_all(trie, true);
+    
+    // Partial results are folded into the first context in thread order once all threads are done
+    for (size_t i = 1; reducer && contexts && i < threads; i++)
+    {
+        reducer(contexts[0], contexts[i]);
+    }
+    
+    trie->releaser(pass.tasks);
+    trie->releaser(workers);
+    
+    return status;
+}
+
+gnt_status_t gnt_merge(gnt_trie_t* dst, gnt_trie_t* src, gnt_conflict_t conflict, void* context)
+{
+    if (!dst || !src || dst == src || dst->base || dst->origin || src->base || src->origin) return -1;
+    
+    // The nibbles and nodes of src change hands with the slabs they live in, and integer keys keep the width they were stored at
+    if (dst->allocator != src->allocator || dst->releaser != src->releaser || dst->mask != src->mask
+        || (dst->flags & GNT_IMAGE_FLAGS) != (src->flags & GNT_IMAGE_FLAGS))
+    {
+        return -1;
+    }
+    
+    gnt_join_t join = {dst, src, NULL, conflict, context, false, NULL, 0, 0};
+    
+    _gnt_lock_pair(dst, src, true);
+    
+    if (dst->snapshots || src->snapshots)
+    {
+        _gnt_unlock_pair(dst, src, true);
+        return -1;
+    }
+    
+    for (uint8_t i = 0; i <= dst->mask; i++)
+    {
+        _gnt_compact_shard(src, &src->shards[i], 0);
+        _gnt_join_adopt(&dst->shards[i], &src->shards[i]);
+    }
+    
+    // Grafted nibbles keep the version they were written in, later snapshots of dst must see them as older
+    if (dst->generation < src->generation)
+    {
+        dst->generation = src->generation;
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* nibble = src->nibbles[high_nibble];
+        
+        if (!nibble)
+        {
+            continue;
+        }
+        
+        join.shard = GNT_SHARD(dst, high_nibble);
+        
+        if (dst->nibbles[high_nibble])
+        {
+            _gnt_join_nibble(&join, &dst->nibbles[high_nibble], nibble, high_nibble, 0);
+            continue;
+        }
+        
+        dst->nibbles[high_nibble] = nibble;
+        atomic_fetch_add(&dst->children, 1);
+        
+        for (gnt_byte_t low_nibble = 0; low_nibble < 16; low_nibble++)
+        {
+            _gnt_root_refresh(dst, GNT_MAKE_BYTE(high_nibble, low_nibble));
+        }
+        
+        _gnt_join_log_nibble(&join, nibble, high_nibble, 0);
+    }
+    
+    memset(src->nibbles, 0, sizeof(src->nibbles));
+    atomic_store(&src->children, 0);
+    
+    if (src->roots)
+    {
+        memset(src->roots, 0, 256 * sizeof(gnt_node_t*));
+    }
+    
+    for (uint16_t byte = 0; dst->roots && byte < 256; byte++)
+    {
+        _gnt_root_refresh(dst, (gnt_byte_t) byte);
+    }
+    
+    if (src->journal && 0 != _gnt_journal_append(src, GNT_JOURNAL_CLEAR, NULL, 0, 0))
+    {
+        join.status = -1;
+    }
+    
+    if (join.key)
+    {
+        dst->releaser(join.key);
+    }
+    
+    _gnt_unlock_pair(dst, src, true);
+    
+    return join.status;
+}
+
+gnt_status_t gnt_intersect(gnt_trie_t* dst, gnt_trie_t* src)
+{
+    return _gnt_filter(dst, src, true);
+}
+
+gnt_status_t gnt_difference(gnt_trie_t* dst, gnt_trie_t* src)
+{
+    return _gnt_filter(dst, src, false);
+}
+
+gnt_status_t gnt_save(gnt_trie_t* trie, int fd)
+{
+    if (!trie || fd < 0) return -1;
+    
+    gnt_writer_t writer = {.trie = trie, .allocator = trie->allocator, .releaser = trie->releaser};
+    
+    _gnt_lock_all(trie, false);
+    gnt_status_t status = _gnt_flatten(&writer);
+    _gnt_unlock_all(trie, false);
+    
+    if (0 == status)
+    {
+        status = _gnt_write_all(fd, writer.bytes, writer.size);
+    }
+    
+    if (writer.queue) trie->releaser(writer.queue);
+    if (writer.block) writer.releaser(writer.block);
+    
+    return status;
+}
+
+gnt_trie_t* gnt_open_mapped(const char* path, gnt_cfg_t* cfg)
+{
+    if (!path) return NULL;
+    
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    
+    if (0 != fstat(fd, &info) || (size_t) info.st_size < sizeof(gnt_image_t))
+    {
+        close(fd);
+        return NULL;
+    }
+    
+    // The mapping outlives the descriptor, and every process opening the same image shares its pages
+    const char* base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    
+    if (MAP_FAILED == base)
+    {
+        return NULL;
+    }
+    
+    gnt_trie_t* trie = _gnt_adopt(base, info.st_size, cfg);
+    
+    if (!trie)
+    {
+        munmap((void*) base, info.st_size);
+    }
+    
+    return trie;
+}
+
+gnt_status_t gnt_checkpoint(gnt_trie_t* trie, const char* path)
+{
+    if (!trie || !path || trie->base || trie->origin) return -1;
+    
+    size_t length = strlen(path);
+    char* temporary = trie->allocator(length + sizeof(".tmp"));
+    
+    if (!temporary)
+    {
+        return -1;
+    }
+    
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+    
+    gnt_writer_t writer = {.trie = trie, .allocator = trie->allocator, .releaser = trie->releaser};
+    
+    // Writers wait until the image is in place, the log then starts over from it
+    _gnt_lock_all(trie, true);
+    gnt_status_t status = _gnt_flatten(&writer);
+    
+    if (0 == status)
+    {
+        int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        
+        status = fd >= 0 && 0 == _gnt_write_all(fd, writer.bytes, writer.size) && 0 == fsync(fd) ? 0 : -1;
+        
+        if (fd >= 0 && 0 != close(fd))
+        {
+            status = -1;
+        }
+        
+        // The previous checkpoint stays whole until the new one replaces it at once
+        status = 0 == status && 0 == rename(temporary, path) ? _gnt_sync_directory(trie, path) : -1;
+        
+        if (0 != status)
+        {
+            unlink(temporary);
+        }
+    }
+    
+    // Every record so far is in the image, a log that failed is usable again
+    if (0 == status && trie->journal)
+    {
+        mtx_lock(&trie->journal->mutex);
+        status = _gnt_journal_reset(trie->journal);
+        mtx_unlock(&trie->journal->mutex);
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    if (writer.queue) trie->releaser(writer.queue);
+    if (writer.block) writer.releaser(writer.block);
+    trie->releaser(temporary);
+    
+    return status;
+}
+
+gnt_trie_t* gnt_recover(const char* path, gnt_cfg_t* cfg)
+{
+    if (!cfg || !cfg->journal) return NULL;
+    
+    gnt_cfg_t replayed = *cfg;
+    replayed.journal = NULL;
+    
+    gnt_trie_t* trie = gnt_create(&replayed);
+    gnt_status_t status = 0;
+    off_t end = 0;
+    
+    if (!trie)
+    {
+        return NULL;
+    }
+    
+    // Without a checkpoint yet, the log holds every write since the trie was created
+    if (path && 0 == access(path, F_OK))
+    {
+        gnt_trie_t* image = gnt_open_mapped(path, &replayed);
+        size_t capacity = GNT_SPAN_BUFFER;
+        gnt_byte_t* key = trie->allocator(capacity);
+        
+        status = image && key ? _gnt_restore(trie, image, NULL, &key, &capacity, 0) : -1;
+        
+        if (key) trie->releaser(key);
+        if (image) gnt_destroy(image);
+    }
+    
+    if (0 == status)
+    {
+        status = _gnt_journal_replay(trie, cfg->journal, &end);
+    }
+    
+    // Appending resumes right after the last whole record
+    if (0 == status)
+    {
+        status = _gnt_journal_open(trie, cfg, end);
+    }
+    
+    if (0 != status)
+    {
+        gnt_destroy(trie);
+        return NULL;
+    }
+    
+    return trie;
+}
+
+gnt_status_t gnt_sync(gnt_trie_t* trie)
+{
+    if (!trie) return -1;
+    
+    if (!trie->journal)
+    {
+        return 0;
+    }
+    
+    mtx_lock(&trie->journal->mutex);
+    gnt_status_t status = _gnt_journal_flush(trie->journal);
+    mtx_unlock(&trie->journal->mutex);
+    
+    return status;
+}
+
+gnt_trie_t* gnt_freeze(gnt_trie_t* trie)
+{
+    if (!trie) return NULL;
+    
+    return _gnt_freeze(trie, trie->allocator, trie->releaser);
+}
+
+gnt_trie_t* gnt_snapshot(gnt_trie_t* trie)
+{
+    if (!trie || trie->base || trie->origin) return NULL;
+    
+    gnt_cfg_t cfg = {trie->accessor, trie->span_accessor, NULL, trie->allocator, trie->releaser, trie->flags & (GNT_IMAGE_FLAGS | GNT_FLAG_WIDE_ROOT), trie->observer, NULL, 0, 0, 0};
+    gnt_trie_t* snapshot = gnt_create(&cfg);
+    
+    if (!snapshot)
+    {
+        return NULL;
+    }
+    
+    gnt_tally_t* tally = &snapshot->shards[0].tally;
+    
+    _gnt_lock_all(trie, true);
+    
+    // The snapshot keeps the current version, writers copy what they change in it from now on
+    memcpy(snapshot->nibbles, trie->nibbles, sizeof(trie->nibbles));
+    atomic_store(&snapshot->children, atomic_load(&trie->children));
+    
+    if (trie->roots)
+    {
+        memcpy(snapshot->roots, trie->roots, 256 * sizeof(gnt_node_t*));
+    }
+    
+    // Its memory stays with the trie, only the shape is counted
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        gnt_tally_t* shard = &trie->shards[i].tally;
+        
+        tally->nibbles += shard->nibbles;
+        tally->nodes += shard->nodes;
+        tally->values += shard->values;
+        tally->slots += shard->slots;
+        tally->key_bytes += shard->key_bytes;
+        
+        // Paths held by hints now lead into the snapshot, writes have to copy them out of it first
+        trie->shards[i].epoch++;
+    }
+    
+    snapshot->generation = trie->generation++;
+    snapshot->origin = trie;
+    snapshot->snapshots = trie->snapshots;
+    trie->snapshots = snapshot;
+    
+    _gnt_unlock_all(trie, true);
+    
+    return snapshot;
+}
+
+gnt_replicas_t* gnt_replicas_create(gnt_trie_t* trie, const gnt_replicas_cfg_t* cfg)
+{
+    if (!trie || !cfg || !cfg->nodes || (cfg->allocators && !cfg->releaser) || trie->base || trie->origin) return NULL;
+    
+    size_t allocators = cfg->allocators ? cfg->nodes * sizeof(gnt_allocator_t) : 0;
+    size_t size = sizeof(gnt_replicas_t) + allocators + GNT_LINE_SIZE + cfg->nodes * sizeof(gnt_replica_t);
+    gnt_replicas_t* replicas = trie->allocator(size);
+    
+    if (!replicas)
+    {
+        return NULL;
+    }
+    
+    memset(replicas, 0, size);
+    
+    // Each replica starts on a cache line, so that the pins taken on one node never share a line with another
+    char* line = (char*) (replicas + 1) + allocators;
+    line += (GNT_LINE_SIZE - (uintptr_t) line % GNT_LINE_SIZE) % GNT_LINE_SIZE;
+    
+    replicas->trie = trie;
+    replicas->allocators = cfg->allocators ? memcpy(replicas + 1, cfg->allocators, allocators) : NULL;
+    replicas->releaser = cfg->releaser;
+    replicas->lag = (uint64_t) cfg->lag_ms * 1000000u;
+    replicas->nodes = cfg->nodes;
+    replicas->replicas = (gnt_replica_t*) line;
+    
+    for (uint32_t i = 0; i < cfg->nodes; i++)
+    {
+        gnt_replica_t* replica = &replicas->replicas[i];
+        
+        if (!GNT_MUTEX_CREATE(replica))
+        {
+            _gnt_replicas_release(replicas, i);
+            return NULL;
+        }
+        
+        // Built by the first thread of their node that reads them
+        atomic_init(&replica->frozen, NULL);
+        atomic_init(&replica->readers[0], 0);
+        atomic_init(&replica->readers[1], 0);
+        atomic_init(&replica->side, 0);
+        atomic_init(&replica->stale, true);
+        atomic_init(&replica->refreshed, 0);
+    }
+    
+    _gnt_lock_all(trie, true);
+    
+    bool replicated = trie->replicas;
+    
+    if (!replicated)
+    {
+        trie->replicas = replicas;
+    }
+    
+    _gnt_unlock_all(trie, true);
+    
+    if (replicated)
+    {
+        _gnt_replicas_release(replicas, replicas->nodes);
+        return NULL;
+    }
+    
+    return replicas;
+}
+
+gnt_status_t gnt_replicas_destroy(gnt_replicas_t* replicas)
+{
+    if (!replicas) return -1;
+    
+    gnt_trie_t* trie = replicas->trie;
+    
+    _gnt_lock_all(trie, true);
+    trie->replicas = NULL;
+    _gnt_unlock_all(trie, true);
+    
+    _gnt_replicas_release(replicas, replicas->nodes);
+    
+    return 0;
+}
+
+gnt_status_t gnt_replicas_enter(gnt_replicas_t* replicas, gnt_pin_t* pin)
+{
+    if (!replicas || !pin) return -1;
+    
+    gnt_replica_t* replica = _gnt_replica_local(replicas);
+    
+    // One reader of a stale replica refreshes it, the others keep reading the previous copy meanwhile
+    if (atomic_load_explicit(&replica->stale, memory_order_relaxed)
+        && _gnt_journal_clock() - atomic_load_explicit(&replica->refreshed, memory_order_relaxed) >= replicas->lag
+        && GNT_MUTEX_TRYLOCK(replica))
+    {
+        if (atomic_load(&replica->stale))
+        {
+            _gnt_replica_refresh(replicas, replica);
+        }
+        
+        GNT_MUTEX_UNLOCK(replica);
+    }
+    
+    pin->side = atomic_load(&replica->side);
+    atomic_fetch_add(&replica->readers[pin->side], 1);
+    
+    // Read after the pin is counted, a refresh that replaced the copy waits for it
+    gnt_trie_t* frozen = atomic_load(&replica->frozen);
+    
+    pin->trie = frozen ? frozen : replicas->trie;
+    pin->replica = replica;
+    
+    return 0;
+}
+
+gnt_status_t gnt_replicas_exit(gnt_pin_t* pin)
+{
+    if (!pin || !pin->replica) return -1;
+    
+    gnt_replica_t* replica = pin->replica;
+    
+    atomic_fetch_sub_explicit(&replica->readers[pin->side], 1, memory_order_release);
+    pin->replica = NULL;
+    
+    return 0;
+}
+
+gnt_data_t gnt_replicas_search(gnt_replicas_t* replicas, gnt_key_t key)
+{
+    gnt_pin_t pin;
+    
+    if (0 != gnt_replicas_enter(replicas, &pin))
+    {
+        return -1;
+    }
+    
+    gnt_data_t data = gnt_search(pin.trie, key);
+    gnt_replicas_exit(&pin);
+    
+    return data;
+}
+
+gnt_data_t gnt_replicas_search_bytes(gnt_replicas_t* replicas, const void* bytes, size_t length)
+{
+    gnt_pin_t pin;
+    
+    if (0 != gnt_replicas_enter(replicas, &pin))
+    {
+        return -1;
+    }
+    
+    gnt_data_t data = gnt_search_bytes(pin.trie, bytes, length);
+    gnt_replicas_exit(&pin);
+    
+    return data;
+}
+
+gnt_status_t gnt_replicas_sync(gnt_replicas_t* replicas)
+{
+    if (!replicas) return -1;
+    
+    gnt_status_t status = 0;
+    
+    for (uint32_t i = 0; i < replicas->nodes; i++)
+    {
+        gnt_replica_t* replica = &replicas->replicas[i];
+        
+        mtx_lock(&replica->mutex);
+        
+        if (atomic_load(&replica->stale) && 0 != _gnt_replica_refresh(replicas, replica))
+        {
+            status = -1;
+        }
+        
+        GNT_MUTEX_UNLOCK(replica);
+    }
+    
+    return status;
+}
+
+gnt_status_t gnt_stats(gnt_trie_t* trie, gnt_stats_t* stats, bool shape)
+{
+    if (!trie || !stats) return -1;
+    
+    gnt_tally_t tally = {0};
+    
+    memset(stats, 0, sizeof(gnt_stats_t));
+    
+    _gnt_lock_all(trie, false);
+    
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        gnt_tally_t* shard = &trie->shards[i].tally;
+        
+        tally.nibbles += shard->nibbles;
+        tally.nodes += shard->nodes;
+        tally.values += shard->values;
+        tally.slots += shard->slots;
+        tally.key_bytes += shard->key_bytes;
+        tally.bytes += shard->bytes;
+        stats->live += trie->shards[i].used;
+    }
+    
+    if (shape)
+    {
+        gnt_tally_t walked = {0};
+        _gnt_stats_walk(trie, NULL, 0, stats, &walked);
+    }
+    
+    // Every node fills one slot of its nibble, and every nibble below the root one slot of its node
+    size_t used = tally.nodes + tally.nibbles - atomic_load(&trie->children);
+    
+    _gnt_unlock_all(trie, false);
+    
+    stats->nibbles = tally.nibbles;
+    stats->nodes = tally.nodes;
+    stats->values = tally.values;
+    stats->bytes = sizeof(gnt_trie_t) + (trie->mask + 1) * sizeof(gnt_shard_t) + (trie->roots ? 256 * sizeof(gnt_node_t*) : 0) + tally.bytes + trie->size;
+    stats->wasted = (tally.slots - used) * sizeof(void*);
+    stats->average_depth = tally.values ? (double) tally.key_bytes / tally.values : 0;
+    
+    return 0;
+}
+
+gnt_status_t gnt_metrics(gnt_trie_t* trie, gnt_metrics_t* metrics)
+{
+    if (!trie || !metrics) return -1;
+    
+#ifdef GNT_INSTRUMENT
+    gnt_probe_t* probe = &trie->probe;
+    
+    metrics->locks = atomic_load_explicit(&probe->locks, memory_order_relaxed);
+    metrics->contended = atomic_load_explicit(&probe->contended, memory_order_relaxed);
+    metrics->wait_ns = atomic_load_explicit(&probe->wait_ns, memory_order_relaxed);
+    
+    for (uint8_t op = 0; op < GNT_OPS; op++)
+    {
+        metrics->operations[op] = atomic_load_explicit(&probe->operations[op], memory_order_relaxed);
+        metrics->levels[op] = atomic_load_explicit(&probe->levels[op], memory_order_relaxed);
+        metrics->allocations[op] = atomic_load_explicit(&probe->allocations[op], memory_order_relaxed);
+        
+        for (uint8_t bucket = 0; bucket < GNT_LATENCY_BUCKETS; bucket++)
+        {
+            metrics->latency[op][bucket] = atomic_load_explicit(&probe->latency[op][bucket], memory_order_relaxed);
+        }
+    }
+    
+    return 0;
+#else
+    memset(metrics, 0, sizeof(gnt_metrics_t));
+    
+    return -1;
+#endif
+}
+
+gnt_status_t gnt_accessor_string(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index)
+{
+    char* str = (char*) key;
+    
+    if (index >= strlen(str))
+    {
+        return -1;
+    }
+    
+    *byte = str[index];
+    return 0;
+}
+
+gnt_status_t gnt_span_accessor_string(const gnt_byte_t** bytes, gnt_index_t* length, gnt_key_t key)
+{
+    *bytes = (const gnt_byte_t*) key;
+    *length = strlen((const char*) key);
+    return 0;
+}
+
+static gnt_status_t _gnt_accessor_default(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index)
+{
+    uint8_t digits = 0;
+    gnt_key_t temp = key;
+
+    do
+    {
+        digits++;
+        temp >>= 8; // division by 256
+    } while (temp > 0);
+
+    if (index >= digits)
+    {
+        return -1;
+    }
+
+    for (uint8_t i = 0; i < digits - index - 1; i++)
+    {
+        key >>= 8; // division by 256
+    }
+
+    *byte = key & 255; // modulo 256
+    return 0;
+}
+
+static gnt_status_t _gnt_span_load(gnt_trie_t* trie, gnt_span_t* span, gnt_key_t key)
+{
+    span->heap = NULL;
+    
+    if (trie->span_accessor)
+    {
+        return trie->span_accessor(&span->bytes, &span->length, key);
+    }
+    
+    if (_gnt_accessor_default == trie->accessor)
+    {
+        span->bytes = _gnt_encode(span->buffer, key, sizeof(gnt_key_t), trie->flags & GNT_FLAG_FIXED_WIDTH, &span->length);
+        return 0;
+    }
+    
+    if (gnt_accessor_string == trie->accessor)
+    {
+        return gnt_span_accessor_string(&span->bytes, &span->length, key);
+    }
+    
+    // Other accessors are gathered byte by byte, long keys spill from the buffer to the heap
+    gnt_byte_t* bytes = span->buffer;
+    gnt_index_t capacity = GNT_SPAN_BUFFER;
+    gnt_index_t length = 0;
+    
+    while (0 == trie->accessor(&bytes[length], key, length))
+    {
+        if (++length == capacity)
+        {
+            gnt_byte_t* grown = trie->allocator(capacity * 2);
+            
+            if (!grown)
+            {
+                _gnt_span_release(trie, span);
+                return -1;
+            }
+            
+            memcpy(grown, bytes, length);
+            _gnt_span_release(trie, span);
+            span->heap = bytes = grown;
+            capacity *= 2;
+        }
+    }
+    
+    span->bytes = bytes;
+    span->length = length;
+    return 0;
+}
+
+static void _gnt_span_release(gnt_trie_t* trie, gnt_span_t* span)
+{
+    if (span->heap)
+    {
+        trie->releaser(span->heap);
+        span->heap = NULL;
+    }
+}
+
+static gnt_status_t _gnt_lane_load(gnt_trie_t* trie, gnt_lane_t* lane, const gnt_key_t* keys, size_t position)
+{
+    lane->index = 0;
+    lane->node = NULL;
+    lane->nibble = NULL;
+    lane->position = position;
+    
+    return _gnt_span_load(trie, &lane->span, keys[position]);
+}
+
+static gnt_status_t _gnt_combine(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data, gnt_op_t op)
+{
+    // An idle shard is written directly, the writes published meanwhile are applied before leaving it
+    if (_gnt_write_trylock(trie, shard))
+    {
+        gnt_status_t status = GNT_OP_INSERT == op ? _gnt_insert(trie, shard, bytes, length, data, NULL) : (MISSING == _gnt_delete(trie, shard, bytes, length) ? -1 : 0);
+        _gnt_combine_requests(trie, shard);
+        GNT_WRITE_UNLOCK(trie, shard);
+        
+        return status;
+    }
+    
+    gnt_request_t request = {NULL, bytes, length, data, op, -1, false};
+    gnt_request_t* head = atomic_load_explicit(&shard->requests, memory_order_relaxed);
+    
+    do
+    {
+        request.next = head;
+    }
+    while (!atomic_compare_exchange_weak_explicit(&shard->requests, &head, &request, memory_order_release, memory_order_relaxed));
+    
+    // Whichever waiter gets the shard applies every write published so far, the others only watch their own
+    while (!atomic_load_explicit(&request.done, memory_order_acquire))
+    {
+        if (_gnt_write_trylock(trie, shard))
+        {
+            _gnt_combine_requests(trie, shard);
+            GNT_WRITE_UNLOCK(trie, shard);
+        }
+        else
+        {
+            thrd_yield();
+        }
+    }
+    
+    return request.status;
+}
+
+static void _gnt_combine_requests(gnt_trie_t* trie, gnt_shard_t* shard)
+{
+    gnt_request_t* batch[GNT_COMBINE_BATCH];
+    gnt_node_t** slots[GNT_PATH_DEPTH];
+    gnt_index_t indexes[GNT_PATH_DEPTH];
+    
+    for (uint8_t round = 0; round < GNT_COMBINE_ROUNDS && atomic_load_explicit(&shard->requests, memory_order_relaxed); round++)
+    {
+        gnt_request_t* list = atomic_exchange_explicit(&shard->requests, NULL, memory_order_acquire);
+        
+        while (list)
+        {
+            size_t count = 0;
+            
+            // Sorts the batch by key so that each write resumes from the nodes shared with the previous one
+            while (list && count < GNT_COMBINE_BATCH)
+            {
+                gnt_request_t* request = list;
+                list = list->next;
+                size_t i = count++;
+                
+                while (i && _gnt_compare(batch[i - 1]->bytes, batch[i - 1]->length, request->bytes, request->length) > 0)
+                {
+                    batch[i] = batch[i - 1];
+                    i--;
+                }
+                
+                batch[i] = request;
+            }
+            
+            gnt_path_t path = {slots, indexes, 0, GNT_PATH_DEPTH};
+            
+            for (size_t i = 0; i < count; i++)
+            {
+                gnt_request_t* request = batch[i];
+                gnt_index_t common = 0;
+                
+                if (i)
+                {
+                    while (common < request->length && common < batch[i - 1]->length && request->bytes[common] == batch[i - 1]->bytes[common])
+                    {
+                        common++;
+                    }
+                }
+                
+                while (path.depth && path.indexes[path.depth - 1] > common)
+                {
+                    path.depth--;
+                }
+                
+                if (GNT_OP_INSERT == request->op)
+                {
+                    request->status = _gnt_insert(trie, shard, request->bytes, request->length, request->data, &path);
+                }
+                else
+                {
+                    request->status = MISSING == _gnt_delete(trie, shard, request->bytes, request->length) ? -1 : 0;
+                }
+                
+                // Deletes and failed inserts may have released nodes along the path
+                if (GNT_OP_INSERT != request->op || 0 != request->status)
+                {
+                    path.depth = 0;
+                }
+            }
+            
+            for (size_t i = 0; i < count; i++)
+            {
+                atomic_store_explicit(&batch[i]->done, true, memory_order_release);
+            }
+        }
+    }
+}
+
+static void _gnt_lock_all(gnt_trie_t* trie, bool write)
+{
+    // Shards are always taken in ascending order so that batches never deadlock each other, and the tries of a pair
+    // in ascending address order by _gnt_lock_pair
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        if (write)
+        {
+            GNT_WRITE_LOCK(trie, &trie->shards[i]);
+        }
+        else
+        {
+            GNT_READ_LOCK(trie, &trie->shards[i]);
+        }
+    }
+}
+
+static void _gnt_unlock_all(gnt_trie_t* trie, bool write)
+{
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        if (write)
+        {
+            GNT_WRITE_UNLOCK(trie, &trie->shards[i]);
+        }
+        else
+        {
+            GNT_READ_UNLOCK(trie, &trie->shards[i]);
+        }
+    }
+}
+
+static void _gnt_lock_pair(gnt_trie_t* dst, gnt_trie_t* src, bool write)
+{
+    // Calls on the same two tries in opposite directions take them in the same order
+    if ((uintptr_t) dst < (uintptr_t) src)
+    {
+        _gnt_lock_all(dst, true);
+        _gnt_lock_all(src, write);
+    }
+    else
+    {
+        _gnt_lock_all(src, write);
+        _gnt_lock_all(dst, true);
+    }
+}
+
+static void _gnt_unlock_pair(gnt_trie_t* dst, gnt_trie_t* src, bool write)
+{
+    _gnt_unlock_all(src, write);
+    _gnt_unlock_all(dst, true);
+}
+
+static gnt_node_t* _gnt_reserve(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_path_t* path)
+{
+    gnt_nibble_t** nibble = NULL;
+    gnt_node_t** slot = NULL;
+    gnt_node_t* node = NULL;
+    gnt_index_t index = 0;
+    
+    // Mapped images and snapshots are read-only
+    if (trie->base || trie->origin)
+    {
+        return NULL;
+    }
+    
+    // Resumes from the deepest node kept from the previous key, whose bytes are a prefix of this one
+    if (path && path->depth)
+    {
+        slot = path->slots[path->depth - 1];
+        node = *slot;
+        index = path->indexes[path->depth - 1];
+    }
+    
+    while (index < length)
+    {
+        gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(bytes[index]);
+        gnt_byte_t low_nibble = GNT_LOW_NIBBLE(bytes[index]);
+        index++;
+        GNT_PROBE_LEVEL();
+        
+        if (!node)
+        {
+            nibble = &trie->nibbles[high_nibble];
+            
+            if (!*nibble)
+            {
+                if (!(*nibble = _gnt_nibble_alloc(shard, 1)))
+                {
+                    return NULL;
+                }
+                
+                atomic_fetch_add(&trie->children, 1);
+            }
+            else if (!_gnt_own_root(shard, high_nibble))
+            {
+                return NULL;
+            }
+        }
+        else if (!(nibble = _gnt_nibble_slot(node, high_nibble)))
+        {
+            if (!(nibble = _gnt_nibble_attach(shard, slot, high_nibble)))
+            {
+                return NULL;
+            }
+        }
+        else if (!_gnt_own(shard, nibble))
+        {
+            return NULL;
+        }
+        
+        if (!(slot = _gnt_node_slot(*nibble, low_nibble)))
+        {
+            if (!(slot = _gnt_node_attach(shard, nibble, low_nibble)))
+            {
+                return NULL;
+            }
+            
+            node = *slot;
+            
+            if (trie->flags & GNT_FLAG_COMPRESS)
+            {
+                // The remainder of the key is new, store as much of it as fits in this node
+                node->length = length - index < GNT_PREFIX_SIZE ? length - index : GNT_PREFIX_SIZE;
+                memcpy(node->prefix, bytes + index, node->length);
+                index += node->length;
+            }
+        }
+        else
+        {
+            node = *slot;
+            
+            uint8_t matched = _gnt_match(node, bytes + index, length - index);
+            index += matched;
+            
+            if (matched < node->length && !(node = _gnt_split(shard, slot, matched)))
+            {
+                return NULL;
+            }
+        }
+        
+        // A slot only moves when a sibling is attached next to it, by a key diverging above it that pops it first
+        if (path && path->depth < path->capacity)
+        {
+            path->slots[path->depth] = slot;
+            path->indexes[path->depth++] = index;
+        }
+    }
+    
+    return node;
+}
+
+static gnt_status_t _gnt_insert(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data, gnt_path_t* path)
+{
+    gnt_node_t* node = _gnt_reserve(trie, shard, bytes, length, path);
+    
+    _gnt_root_refresh(trie, bytes[0]);
+    
+    if (!node)
+    {
+        return -1;
+    }
+    
+    if (!node->occupied)
+    {
+        shard->tally.values++;
+        shard->tally.key_bytes += length;
+    }
+    else if (0 != _gnt_discard(trie, shard, node->data))
+    {
+        return -1;
+    }
+    
+    node->data = data;
+    node->occupied |= true; // Overwrites keep the second chance the key had
+    
+    return trie->journal ? _gnt_journal_append(trie, GNT_JOURNAL_INSERT, bytes, length, data) : 0;
+}
+
+static gnt_node_t* _gnt_search(gnt_trie_t* trie, const gnt_byte_t* bytes, gnt_index_t length)
+{
+    gnt_nibble_t* nibble;
+    gnt_node_t* node = NULL;
+    gnt_index_t index = 0;
+    
+    while (index < length)
+    {
+        gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(bytes[index]);
+        gnt_byte_t low_nibble = GNT_LOW_NIBBLE(bytes[index]);
+        GNT_PROBE_LEVEL();
+        
+        // The wide root reaches the node below the first byte in a single load
+        if (!index++ && trie->roots)
+        {
+            if (!(node = trie->roots[bytes[0]]))
+            {
+                return NULL;
+            }
+        }
+        else if (!(nibble = _gnt_nibble_get(trie, node, high_nibble)) || !(node = _gnt_node_get(trie, nibble, low_nibble)))
+        {
+            return NULL;
+        }
+        
+        if (node->length)
+        {
+            if (node->length > length - index || 0 != memcmp(node->prefix, bytes + index, node->length))
+            {
+                return NULL;
+            }
+            
+            index += node->length;
+        }
+    }
+    
+    _gnt_touch(trie, node);
+    
+    return node;
+}
+
+static gnt_node_t* _gnt_search_path(gnt_trie_t* trie, const gnt_byte_t* bytes, gnt_index_t length, gnt_path_t* path)
+{
+    gnt_node_t** slot;
+    gnt_node_t* node = NULL;
+    gnt_index_t index = 0;
+    
+    // Resumes from the deepest node kept from the previous key, whose bytes are a prefix of this one
+    if (path->depth)
+    {
+        node = _gnt_resolve(trie, *path->slots[path->depth - 1]);
+        index = path->indexes[path->depth - 1];
+    }
+    
+    while (index < length)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, node, GNT_HIGH_NIBBLE(bytes[index]));
+        GNT_PROBE_LEVEL();
+        
+        if (!nibble || !(slot = _gnt_node_slot(nibble, GNT_LOW_NIBBLE(bytes[index]))))
+        {
+            return NULL;
+        }
+        
+        node = _gnt_resolve(trie, *slot);
+        index++;
+        
+        if (node->length)
+        {
+            if (node->length > length - index || 0 != memcmp(node->prefix, bytes + index, node->length))
+            {
+                return NULL;
+            }
+            
+            index += node->length;
+        }
+        
+        if (path->depth < path->capacity)
+        {
+            path->slots[path->depth] = slot;
+            path->indexes[path->depth++] = index;
+        }
+    }
+    
+    _gnt_touch(trie, node);
+    
+    return node;
+}
+
+static uint8_t _gnt_hint_resume(gnt_hint_t* hint, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, bool write)
+{
+    // Any nibble or node allocated or released in the shard since may have moved a slot of the path
+    if (hint->epoch != shard->epoch)
+    {
+        return 0;
+    }
+    
+    // A path taken by a search may run through nibbles still shared with a snapshot, writes have to copy them first
+    if (write && !hint->written && shard->trie->snapshots)
+    {
+        return 0;
+    }
+    
+    gnt_index_t common = 0;
+    uint8_t depth = hint->depth;
+    
+    while (common < length && common < hint->length && bytes[common] == hint->key[common])
+    {
+        common++;
+    }
+    
+    while (depth && hint->indexes[depth - 1] > common)
+    {
+        depth--;
+    }
+    
+    return depth;
+}
+
+static void _gnt_hint_keep(gnt_hint_t* hint, gnt_shard_t* shard, gnt_path_t* path, const gnt_byte_t* bytes, gnt_index_t length, bool write)
+{
+    hint->epoch = shard->epoch;
+    hint->written = write;
+    hint->length = length < GNT_HINT_DEPTH ? length : GNT_HINT_DEPTH;
+    hint->depth = path ? path->depth : 0;
+    memcpy(hint->key, bytes, hint->length);
+    
+    // Nodes past the bytes remembered can't be matched against the next key
+    while (hint->depth && hint->indexes[hint->depth - 1] > hint->length)
+    {
+        hint->depth--;
+    }
+}
+
+static gnt_status_t _gnt_join_key(gnt_join_t* join, size_t length)
+{
+    if (length <= join->capacity)
+    {
+        return 0;
+    }
+    
+    gnt_byte_t* grown = join->dst->allocator(2 * length);
+    
+    if (!grown)
+    {
+        join->status = -1;
+        return -1;
+    }
+    
+    if (join->key)
+    {
+        memcpy(grown, join->key, join->capacity);
+        join->dst->releaser(join->key);
+    }
+    
+    join->key = grown;
+    join->capacity = 2 * length;
+    
+    return 0;
+}
+
+static void _gnt_join_adopt(gnt_shard_t* shard, gnt_shard_t* from)
+{
+    gnt_trie_t* trie = shard->trie;
+    
+    // Slabs are only released as a whole, so they move along with every object carved from them
+    for (uint8_t class = 0; class < GNT_POOL_CLASSES; class++)
+    {
+        gnt_pool_t* pool = &shard->pools[class];
+        gnt_pool_t* source = &from->pools[class];
+        
+        if (source->slabs)
+        {
+            gnt_slab_t* last = source->slabs;
+            
+            while (last->next)
+            {
+                last = last->next;
+            }
+            
+            last->next = pool->slabs;
+            pool->slabs = source->slabs;
+        }
+        
+        if (source->released)
+        {
+            void** last = source->released;
+            
+            while (*last)
+            {
+                last = *last;
+            }
+            
+            *last = pool->released;
+            pool->released = source->released;
+        }
+        
+        *source = (gnt_pool_t) {.size = source->size, .bytes = GNT_SLAB_MIN};
+    }
+    
+    shard->tally.nibbles += from->tally.nibbles;
+    shard->tally.nodes += from->tally.nodes;
+    shard->tally.values += from->tally.values;
+    shard->tally.slots += from->tally.slots;
+    shard->tally.key_bytes += from->tally.key_bytes;
+    shard->tally.bytes += from->tally.bytes;
+    shard->used += from->used;
+    
+    if (trie->budget)
+    {
+        atomic_fetch_add_explicit(&trie->used, from->used, memory_order_relaxed);
+    }
+    
+    if (from->trie->budget)
+    {
+        atomic_fetch_sub_explicit(&from->trie->used, from->used, memory_order_relaxed);
+    }
+    
+    from->tally = (gnt_tally_t) {0};
+    from->used = 0;
+    from->hand_length = 0;
+    from->epoch++;
+    shard->epoch++;
+}
+
+static gnt_data_t _gnt_join_resolve(gnt_join_t* join, gnt_index_t length, gnt_data_t kept, gnt_data_t incoming)
+{
+    gnt_data_t data = join->conflict ? join->conflict(join->key, length, kept, incoming, join->context) : incoming;
+    
+    // The caller releases kept when it is replaced
+    if (data != incoming && incoming != kept && 0 != _gnt_discard(join->dst, join->shard, incoming))
+    {
+        join->status = -1;
+    }
+    
+    return data;
+}
+
+static void _gnt_join_log(gnt_join_t* join, gnt_node_t* node, size_t depth)
+{
+    if (!join->dst->journal)
+    {
+        return;
+    }
+    
+    if (node->occupied && 0 != _gnt_journal_append(join->dst, GNT_JOURNAL_INSERT, join->key, depth, node->data))
+    {
+        join->status = -1;
+    }
+    
+    for (uint16_t map = node->map; map; map &= map - 1)
+    {
+        _gnt_join_log_nibble(join, node->nibbles[GNT_RANK(node->map, GNT_FIRST(map))], GNT_FIRST(map), depth);
+    }
+}
+
+static void _gnt_join_log_nibble(gnt_join_t* join, gnt_nibble_t* nibble, gnt_byte_t high_nibble, size_t depth)
+{
+    if (!join->dst->journal)
+    {
+        return;
+    }
+    
+    // Grafted keys never went through an insert of dst, so the log learns of them here
+    for (uint16_t map = nibble->map; map; map &= map - 1)
+    {
+        gnt_node_t* node = nibble->nodes[GNT_RANK(nibble->map, GNT_FIRST(map))];
+        size_t length = depth + 1 + node->length;
+        
+        if (0 != _gnt_join_key(join, length))
+        {
+            return;
+        }
+        
+        join->key[depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(map));
+        memcpy(join->key + depth + 1, node->prefix, node->length);
+        _gnt_join_log(join, node, length);
+    }
+}
+
+static void _gnt_join_drop(gnt_join_t* join, gnt_node_t* node, size_t depth)
+{
+    gnt_shard_t* shard = join->shard;
+    
+    // A branch of src that could not be linked into dst, its keys are lost
+    if (node->occupied)
+    {
+        _gnt_discard(join->dst, shard, node->data);
+        shard->tally.values--;
+        shard->tally.key_bytes -= depth;
+    }
+    
+    for (uint8_t i = 0; i < GNT_CHILDREN(node); i++)
+    {
+        gnt_nibble_t* nibble = node->nibbles[i];
+        
+        for (uint8_t j = 0; j < GNT_CHILDREN(nibble); j++)
+        {
+            _gnt_join_drop(join, nibble->nodes[j], depth + 1 + nibble->nodes[j]->length);
+        }
+        
+        _gnt_nibble_free(shard, nibble);
+    }
+    
+    _gnt_node_free(shard, node);
+    join->status = -1;
+}
+
+static void _gnt_join_nibble(gnt_join_t* join, gnt_nibble_t** slot, gnt_nibble_t* nibble, gnt_byte_t high_nibble, size_t depth)
+{
+    gnt_shard_t* shard = join->shard;
+    
+    for (uint16_t map = nibble->map; map; map &= map - 1)
+    {
+        gnt_byte_t low_nibble = GNT_FIRST(map);
+        gnt_node_t* node = nibble->nodes[GNT_RANK(nibble->map, low_nibble)];
+        size_t length = depth + 1 + node->length;
+        
+        if (0 != _gnt_join_key(join, length))
+        {
+            _gnt_join_drop(join, node, length);
+            continue;
+        }
+        
+        join->key[depth] = GNT_MAKE_BYTE(high_nibble, low_nibble);
+        memcpy(join->key + depth + 1, node->prefix, node->length);
+        
+        gnt_node_t** target = _gnt_node_slot(*slot, low_nibble);
+        
+        if (!target)
+        {
+            if (!_gnt_node_link(shard, slot, low_nibble, node))
+            {
+                _gnt_join_drop(join, node, length);
+                continue;
+            }
+            
+            _gnt_root_refresh(join->dst, join->key[0]);
+            _gnt_join_log(join, node, length);
+        }
+        else if ((*target)->length == node->length && 0 == memcmp((*target)->prefix, node->prefix, node->length))
+        {
+            _gnt_join_node(join, target, node, length);
+        }
+        else
+        {
+            // Compressed prefixes that diverge are not lined up node by node, the keys below are inserted instead
+            _gnt_join_insert(join, node, length);
+        }
+    }
+    
+    _gnt_nibble_free(shard, nibble);
+}
+
+static void _gnt_join_node(gnt_join_t* join, gnt_node_t** slot, gnt_node_t* node, size_t depth)
+{
+    gnt_shard_t* shard = join->shard;
+    gnt_node_t* into = *slot;
+    
+    if (node->occupied)
+    {
+        if (into->occupied)
+        {
+            gnt_data_t data = _gnt_join_resolve(join, depth, into->data, node->data);
+            
+            if (data != into->data && 0 != _gnt_discard(join->dst, shard, into->data))
+            {
+                join->status = -1;
+            }
+            
+            into->data = data;
+            shard->tally.values--;
+            shard->tally.key_bytes -= depth;
+        }
+        else
+        {
+            into->data = node->data;
+            into->occupied = true;
+        }
+        
+        if (join->dst->journal && 0 != _gnt_journal_append(join->dst, GNT_JOURNAL_INSERT, join->key, depth, into->data))
+        {
+            join->status = -1;
+        }
+    }
+    
+    for (uint16_t map = node->map; map; map &= map - 1)
+    {
+        gnt_byte_t high_nibble = GNT_FIRST(map);
+        gnt_nibble_t* nibble = node->nibbles[GNT_RANK(node->map, high_nibble)];
+        gnt_nibble_t** target = _gnt_nibble_slot(*slot, high_nibble);
+        
+        if (target)
+        {
+            _gnt_join_nibble(join, target, nibble, high_nibble, depth);
+        }
+        else if (_gnt_nibble_link(shard, slot, high_nibble, nibble))
+        {
+            _gnt_root_refresh(join->dst, join->key[0]);
+            _gnt_join_log_nibble(join, nibble, high_nibble, depth);
+        }
+        else
+        {
+            for (uint8_t j = 0; j < GNT_CHILDREN(nibble); j++)
+            {
+                _gnt_join_drop(join, nibble->nodes[j], depth + 1 + nibble->nodes[j]->length);
+            }
+            
+            _gnt_nibble_free(shard, nibble);
+        }
+    }
+    
+    _gnt_node_free(shard, node);
+}
+
+static void _gnt_join_insert(gnt_join_t* join, gnt_node_t* node, size_t depth)
+{
+    gnt_shard_t* shard = join->shard;
+    
+    if (node->occupied)
+    {
+        gnt_node_t* found = _gnt_search(join->dst, join->key, depth);
+        gnt_data_t data = node->data;
+        
+        if (found && found->occupied)
+        {
+            data = _gnt_join_resolve(join, depth, found->data, node->data);
+        }
+        
+        // Inserting replaces and releases the data dst held
+        if ((!found || !found->occupied || data != found->data) && 0 != _gnt_insert(join->dst, shard, join->key, depth, data, NULL))
+        {
+            _gnt_discard(join->dst, shard, data);
+            join->status = -1;
+        }
+        
+        // The key was counted with the tally taken over from src, the insert counted it again
+        shard->tally.values--;
+        shard->tally.key_bytes -= depth;
+    }
+    
+    for (uint16_t map = node->map; map; map &= map - 1)
+    {
+        gnt_byte_t high_nibble = GNT_FIRST(map);
+        gnt_nibble_t* nibble = node->nibbles[GNT_RANK(node->map, high_nibble)];
+        
+        for (uint16_t low = nibble->map; low; low &= low - 1)
+        {
+            gnt_node_t* child = nibble->nodes[GNT_RANK(nibble->map, GNT_FIRST(low))];
+            size_t length = depth + 1 + child->length;
+            
+            if (0 != _gnt_join_key(join, length))
+            {
+                _gnt_join_drop(join, child, length);
+                continue;
+            }
+            
+            join->key[depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(low));
+            memcpy(join->key + depth + 1, child->prefix, child->length);
+            _gnt_join_insert(join, child, length);
+        }
+        
+        _gnt_nibble_free(shard, nibble);
+    }
+    
+    _gnt_node_free(shard, node);
+}
+
+static gnt_status_t _gnt_filter(gnt_trie_t* dst, gnt_trie_t* src, bool intersect)
+{
+    if (!dst || !src || dst == src || dst->base || dst->origin) return -1;
+    
+    gnt_join_t join = {dst, src, NULL, NULL, NULL, intersect, NULL, 0, 0};
+    
+    _gnt_lock_pair(dst, src, false);
+    
+    // Open snapshots still read the nodes
+    if (dst->snapshots)
+    {
+        _gnt_unlock_pair(dst, src, false);
+        return -1;
+    }
+    
+    // Branches of lazy deletes are pruned first, the walk then only meets nodes holding keys or leading to some
+    for (uint8_t i = 0; i <= dst->mask; i++)
+    {
+        _gnt_compact_shard(dst, &dst->shards[i], 0);
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* other = _gnt_nibble_get(src, NULL, high_nibble);
+        
+        // A difference leaves alone what src has nothing of
+        if (!dst->nibbles[high_nibble] || (!other && !intersect))
+        {
+            continue;
+        }
+        
+        join.shard = GNT_SHARD(dst, high_nibble);
+        _gnt_filter_nibble(&join, &dst->nibbles[high_nibble], other, high_nibble, 0, other ? GNT_JOIN_EXACT : GNT_JOIN_NONE);
+        
+        if (!GNT_CHILDREN(dst->nibbles[high_nibble]))
+        {
+            _gnt_nibble_free(join.shard, dst->nibbles[high_nibble]);
+            dst->nibbles[high_nibble] = NULL;
+            atomic_fetch_sub(&dst->children, 1);
+        }
+    }
+    
+    for (uint16_t byte = 0; dst->roots && byte < 256; byte++)
+    {
+        _gnt_root_refresh(dst, (gnt_byte_t) byte);
+    }
+    
+    if (join.key)
+    {
+        dst->releaser(join.key);
+    }
+    
+    _gnt_unlock_pair(dst, src, false);
+    
+    return join.status;
+}
+
+static void _gnt_filter_nibble(gnt_join_t* join, gnt_nibble_t** slot, gnt_nibble_t* other, gnt_byte_t high_nibble, size_t depth, uint8_t mode)
+{
+    gnt_shard_t* shard = join->shard;
+    
+    // Walked from the last node, so that detaching one leaves the rank of those still ahead unchanged
+    for (uint16_t map = (*slot)->map; map; map &= ~GNT_BIT(GNT_LAST(map)))
+    {
+        gnt_byte_t low_nibble = GNT_LAST(map);
+        gnt_node_t** target = _gnt_node_slot(*slot, low_nibble);
+        gnt_node_t* node = *target;
+        gnt_node_t* match = NULL;
+        uint8_t next = mode;
+        size_t length = depth + 1 + node->length;
+        
+        if (GNT_JOIN_EXACT == mode)
+        {
+            match = _gnt_node_get(join->src, other, low_nibble);
+            
+            if (!match)
+            {
+                next = GNT_JOIN_NONE;
+            }
+            else if (match->length != node->length || 0 != memcmp(match->prefix, node->prefix, node->length))
+            {
+                next = GNT_JOIN_LOOKUP;
+            }
+        }
+        
+        if ((GNT_JOIN_NONE == next && !join->intersect) || 0 != _gnt_join_key(join, length))
+        {
+            continue;
+        }
+        
+        join->key[depth] = GNT_MAKE_BYTE(high_nibble, low_nibble);
+        memcpy(join->key + depth + 1, node->prefix, node->length);
+        _gnt_filter_node(join, target, match, length, next);
+        
+        if (!(*target)->occupied && !GNT_CHILDREN(*target))
+        {
+            _gnt_node_free(shard, *target);
+            _gnt_node_detach(shard, slot, low_nibble);
+        }
+    }
+}
+
+static void _gnt_filter_node(gnt_join_t* join, gnt_node_t** slot, gnt_node_t* other, size_t depth, uint8_t mode)
+{
+    gnt_shard_t* shard = join->shard;
+    gnt_node_t* node = *slot;
+    
+    if (node->occupied)
+    {
+        bool held = false;
+        
+        if (GNT_JOIN_EXACT == mode)
+        {
+            held = other->occupied;
+        }
+        else if (GNT_JOIN_LOOKUP == mode)
+        {
+            gnt_node_t* found = _gnt_search(join->src, join->key, depth);
+            held = found && found->occupied;
+        }
+        
+        // Keys are emptied in place, the walk prunes their branches on its way back up
+        if (held != join->intersect)
+        {
+            if (0 != _gnt_discard(join->dst, shard, node->data))
+            {
+                join->status = -1;
+            }
+            
+            node->data = 0;
+            node->occupied = false;
+            shard->tally.values--;
+            shard->tally.key_bytes -= depth;
+            
+            if (join->dst->journal && 0 != _gnt_journal_append(join->dst, GNT_JOURNAL_DELETE, join->key, depth, 0))
+            {
+                join->status = -1;
+            }
+        }
+    }
+    
+    for (uint16_t map = node->map; map; map &= ~GNT_BIT(GNT_LAST(map)))
+    {
+        gnt_byte_t high_nibble = GNT_LAST(map);
+        gnt_nibble_t** target = _gnt_nibble_slot(*slot, high_nibble);
+        gnt_nibble_t* match = GNT_JOIN_EXACT == mode ? _gnt_nibble_get(join->src, other, high_nibble) : NULL;
+        uint8_t next = GNT_JOIN_EXACT == mode && !match ? GNT_JOIN_NONE : mode;
+        
+        if (GNT_JOIN_NONE == next && !join->intersect)
+        {
+            continue;
+        }
+        
+        _gnt_filter_nibble(join, target, match, high_nibble, depth, next);
+        
+        if (!GNT_CHILDREN(*target))
+        {
+            _gnt_nibble_free(shard, *target);
+            _gnt_nibble_detach(shard, slot, high_nibble);
+        }
+    }
+    
+    if (!(*slot)->occupied && 1 == GNT_CHILDREN(*slot) && (join->dst->flags & GNT_FLAG_COMPRESS))
+    {
+        _gnt_merge(shard, slot);
+    }
+}
+
+static bool _gnt_search_step(gnt_trie_t* trie, gnt_lane_t* lane)
+{
+    const gnt_byte_t* bytes = lane->span.bytes;
+    gnt_index_t length = lane->span.length;
+    
+    if (lane->nibble)
+    {
+        lane->node = _gnt_node_get(trie, lane->nibble, GNT_LOW_NIBBLE(bytes[lane->index - 1]));
+        lane->nibble = NULL;
+        
+        if (!lane->node)
+        {
+            return true;
+        }
+        
+        __builtin_prefetch(lane->node);
+        return false;
+    }
+    
+    if (!lane->index && length && trie->roots)
+    {
+        lane->index = 1;
+        
+        if (!(lane->node = trie->roots[bytes[0]]))
+        {
+            return true;
+        }
+        
+        __builtin_prefetch(lane->node);
+        return false;
+    }
+    
+    gnt_node_t* node = lane->node;
+    
+    if (node && node->length)
+    {
+        if (node->length > length - lane->index || 0 != memcmp(node->prefix, bytes + lane->index, node->length))
+        {
+            lane->node = NULL;
+            return true;
+        }
+        
+        lane->index += node->length;
+    }
+    
+    if (lane->index == length)
+    {
+        return true;
+    }
+    
+    gnt_byte_t high_nibble = GNT_HIGH_NIBBLE(bytes[lane->index]);
+    gnt_nibble_t* nibble = _gnt_nibble_get(trie, node, high_nibble);
+    
+    lane->index++;
+    
+    if (!nibble)
+    {
+        lane->node = NULL;
+        return true;
+    }
+    
+    lane->nibble = nibble;
+    __builtin_prefetch(lane->nibble);
+    
+    return false;
+}
+
+static void _gnt_search_group(gnt_trie_t* trie, const void* keys, uint8_t width, gnt_data_t* data, uint64_t* found, size_t first, uint8_t count)
+{
+    gnt_vector_t bits = {0}; // Unread bytes of each key, left-aligned so that the next one is always the top byte
+    gnt_vector_t remaining = {0};
+    gnt_nibble_t* nibbles[GNT_BATCH_WIDTH];
+    gnt_node_t* nodes[GNT_BATCH_WIDTH] = {NULL};
+    uint32_t active = (1u << count) - 1;
+    bool fixed = trie->flags & GNT_FLAG_FIXED_WIDTH;
+    bool wide = trie->roots;
+    
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint64_t key = 4 == width ? ((const uint32_t*) keys)[first + i] : ((const uint64_t*) keys)[first + i];
+        uint8_t length = fixed ? width : (key ? (71 - __builtin_clzll(key)) / 8 : 1);
+        
+        // Same bytes as _gnt_encode, read from the top of the word instead of a buffer
+        bits[i] = key << (64 - 8 * length);
+        remaining[i] = length;
+        data[first + i] = 0;
+    }
+    
+    while (active)
+    {
+        gnt_vector_t high = bits >> 60;
+        gnt_vector_t low = (bits >> 56) & 0x0F;
+        
+        if (wide)
+        {
+            gnt_vector_t top = bits >> 56;
+            
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (!(nodes[i] = trie->roots[top[i]]))
+                {
+                    active &= ~(1u << i);
+                    continue;
+                }
+                
+                __builtin_prefetch(nodes[i]);
+            }
+            
+            wide = false;
+        }
+        else
+        {
+            // Each pass issues the loads of every lane before the first one is used, overlapping their misses
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (!(active & (1u << i)))
+                {
+                    continue;
+                }
+                
+                if (!(nibbles[i] = _gnt_nibble_get(trie, nodes[i], high[i])))
+                {
+                    active &= ~(1u << i);
+                    continue;
+                }
+                
+                __builtin_prefetch(nibbles[i]);
+            }
+            
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (!(active & (1u << i)))
+                {
+                    continue;
+                }
+                
+                if (!(nodes[i] = _gnt_node_get(trie, nibbles[i], low[i])))
+                {
+                    active &= ~(1u << i);
+                    continue;
+                }
+                
+                __builtin_prefetch(nodes[i]);
+            }
+        }
+        
+        bits <<= 8;
+        remaining -= 1;
+        
+        gnt_vector_t consumed = {0};
+        
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (!(active & (1u << i)))
+            {
+                continue;
+            }
+            
+            gnt_node_t* node = nodes[i];
+            
+            if (node->length)
+            {
+                uint8_t matched = 0;
+                
+                while (matched < node->length && matched < remaining[i] && node->prefix[matched] == (gnt_byte_t) (bits[i] >> (56 - 8 * matched)))
+                {
+                    matched++;
+                }
+                
+                if (matched < node->length)
+                {
+                    active &= ~(1u << i);
+                    continue;
+                }
+                
+                // At most 7 bytes are left once the byte leading to the node is read, so the shift stays in range
+                consumed[i] = node->length;
+            }
+            
+            if (remaining[i] == consumed[i])
+            {
+                if (node->occupied)
+                {
+                    data[first + i] = node->data;
+                    _gnt_touch(trie, node);
+                    
+                    if (found) found[(first + i) / 64] |= 1ull << ((first + i) % 64);
+                }
+                
+                active &= ~(1u << i);
+            }
+        }
+        
+        bits <<= consumed * 8;
+        remaining -= consumed;
+    }
+}
+
+static gnt_status_t _gnt_search_batch_integer(gnt_trie_t* trie, const void* keys, uint8_t width, gnt_data_t* data, uint64_t* found, size_t count)
+{
+    if (!trie || (count && (!keys || !data))) return -1;
+    
+    if (found)
+    {
+        memset(found, 0, (count + 63) / 64 * sizeof(uint64_t));
+    }
+    
+    _gnt_lock_all(trie, false);
+    
+    for (size_t first = 0; first < count; first += GNT_BATCH_WIDTH)
+    {
+        _gnt_search_group(trie, keys, width, data, found, first, count - first < GNT_BATCH_WIDTH ? count - first : GNT_BATCH_WIDTH);
+    }
+    
+    _gnt_unlock_all(trie, false);
+    
+    return 0;
+}
+
+static int _gnt_bulk_load(void* load)
+{
+    gnt_load_t* run = load;
+    gnt_trie_t* trie = run->trie;
+    gnt_span_t spans[2];
+    gnt_span_t* previous = NULL;
+    gnt_node_t** slots[GNT_PATH_DEPTH];
+    gnt_index_t indexes[GNT_PATH_DEPTH];
+    gnt_path_t path = {slots, indexes, 0, GNT_PATH_DEPTH};
+    
+    run->status = 0;
+    
+    for (size_t i = 0; i < run->count; i++)
+    {
+        gnt_span_t* span = &spans[i & 1];
+        
+        if (0 != _gnt_span_load(trie, span, run->keys[i]))
+        {
+            run->status = -1;
+            break;
+        }
+        
+        if (!span->length)
+        {
+            _gnt_span_release(trie, span);
+            run->status = -1;
+            break;
+        }
+        
+        // Keeps only the nodes shared with the previous key instead of descending again from the root
+        gnt_index_t common = 0;
+        
+        if (previous)
+        {
+            while (common < span->length && common < previous->length && span->bytes[common] == previous->bytes[common])
+            {
+                common++;
+            }
+            
+            _gnt_span_release(trie, previous);
+        }
+        
+        while (path.depth && path.indexes[path.depth - 1] > common)
+        {
+            path.depth--;
+        }
+        
+        previous = span;
+        
+        if (0 != _gnt_insert(trie, GNT_SHARD(trie, GNT_HIGH_NIBBLE(span->bytes[0])), span->bytes, span->length, run->data[i], &path))
+        {
+            run->status = -1;
+            break;
+        }
+    }
+    
+    if (previous)
+    {
+        _gnt_span_release(trie, previous);
+    }
+    
+    return run->status;
+}
+
+static gnt_node_t* _gnt_cursor_after(gnt_cursor_t* cursor, gnt_node_t* parent, gnt_index_t depth, const gnt_byte_t* target, gnt_index_t length, bool inclusive)
+{
+    gnt_trie_t* trie = cursor->trie;
+    unsigned int start = 0;
+    
+    // While target is set, the key built so far equals its first depth bytes
+    if (target && depth == length)
+    {
+        if (parent && parent->occupied && inclusive)
+        {
+            cursor->length = depth;
+            return parent;
+        }
+        
+        target = NULL; // Every descendant is greater than target
+    }
+    else if (target)
+    {
+        start = target[depth];
+    }
+    else if (parent && parent->occupied)
+    {
+        cursor->length = depth;
+        return parent;
+    }
+    
+    for (unsigned int byte = start; byte < 256 && depth < GNT_CURSOR_KEY_MAX; byte++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, GNT_HIGH_NIBBLE(byte));
+        gnt_node_t* node;
+        
+        if (!nibble)
+        {
+            byte |= 0x0F; // Skips the rest of the missing nibble
+            continue;
+        }
+        
+        if (!(node = _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(byte))) || depth + 1 + node->length > GNT_CURSOR_KEY_MAX)
+        {
+            continue;
+        }
+        
+        const gnt_byte_t* bound = target && byte == start ? target : NULL;
+        
+        if (bound)
+        {
+            gnt_index_t rest = length - depth - 1;
+            int order = memcmp(node->prefix, target + depth + 1, node->length < rest ? node->length : rest);
+            
+            if (order < 0)
+            {
+                continue;
+            }
+            
+            if (order > 0 || node->length > rest)
+            {
+                bound = NULL; // Greater than target, or extends it
+            }
+        }
+        
+        cursor->key[depth] = (gnt_byte_t) byte;
+        memcpy(&cursor->key[depth + 1], node->prefix, node->length);
+        
+        gnt_node_t* found = _gnt_cursor_after(cursor, node, depth + 1 + node->length, bound, length, inclusive);
+        
+        if (found)
+        {
+            return found;
+        }
+    }
+    
+    return NULL;
+}
+
+static gnt_node_t* _gnt_cursor_before(gnt_cursor_t* cursor, gnt_node_t* parent, gnt_index_t depth, const gnt_byte_t* target, gnt_index_t length)
+{
+    gnt_trie_t* trie = cursor->trie;
+    int end = 255;
+    
+    // While target is set, the key built so far equals its first depth bytes
+    if (target && depth == length)
+    {
+        return NULL; // Equal to target and descendants are greater
+    }
+    else if (target)
+    {
+        end = target[depth];
+    }
+    
+    // Descendants come after their parent, so they are visited first when going backward
+    for (int byte = end; byte >= 0 && depth < GNT_CURSOR_KEY_MAX; byte--)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, GNT_HIGH_NIBBLE(byte));
+        gnt_node_t* node;
+        
+        if (!nibble)
+        {
+            byte &= 0xF0; // Skips the rest of the missing nibble
+            continue;
+        }
+        
+        if (!(node = _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(byte))) || depth + 1 + node->length > GNT_CURSOR_KEY_MAX)
+        {
+            continue;
+        }
+        
+        const gnt_byte_t* bound = target && byte == end ? target : NULL;
+        
+        if (bound)
+        {
+            gnt_index_t rest = length - depth - 1;
+            int order = memcmp(node->prefix, target + depth + 1, node->length < rest ? node->length : rest);
+            
+            if (order > 0 || (0 == order && node->length > rest))
+            {
+                continue; // Greater than target, or extends it
+            }
+            
+            if (order < 0)
+            {
+                bound = NULL;
+            }
+        }
+        
+        cursor->key[depth] = (gnt_byte_t) byte;
+        memcpy(&cursor->key[depth + 1], node->prefix, node->length);
+        
+        gnt_node_t* found = _gnt_cursor_before(cursor, node, depth + 1 + node->length, bound, length);
+        
+        if (found)
+        {
+            return found;
+        }
+    }
+    
+    if (parent && parent->occupied)
+    {
+        cursor->length = depth;
+        return parent;
+    }
+    
+    return NULL;
+}
+
+static gnt_status_t _gnt_cursor_move(gnt_cursor_t* cursor, const gnt_byte_t* target, gnt_index_t length, bool forward, bool inclusive)
+{
+    // Target must not alias the cursor key, which is rebuilt along the walk
+    gnt_node_t* node = forward ? _gnt_cursor_after(cursor, NULL, 0, target, length, inclusive) : _gnt_cursor_before(cursor, NULL, 0, target, length);
+    
+    cursor->positioned = node;
+    cursor->data = node ? node->data : 0;
+    
+    if (!node)
+    {
+        cursor->length = 0;
+        return -1;
+    }
+    
+    return 0;
+}
+
+static bool _gnt_visit(gnt_trie_t* trie, gnt_byte_t* key, gnt_node_t* parent, gnt_index_t depth, gnt_visitor_t visitor, void* context)
+{
+    if (parent && parent->occupied && 0 != visitor(key, depth, parent->data, context))
+    {
+        return true;
+    }
+    
+    if (depth == GNT_CURSOR_KEY_MAX)
+    {
+        return false;
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, high_nibble);
+        
+        if (!nibble)
+        {
+            continue;
+        }
+        
+        uint8_t rank = 0;
+        
+        for (uint16_t map = nibble->map; map; map &= map - 1, rank++)
+        {
+            gnt_node_t* node = _gnt_resolve(trie, nibble->nodes[rank]);
+            
+            if (depth + 1 + node->length > GNT_CURSOR_KEY_MAX)
+            {
+                continue;
+            }
+            
+            key[depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(map));
+            memcpy(key + depth + 1, node->prefix, node->length);
+            
+            if (_gnt_visit(trie, key, node, depth + 1 + node->length, visitor, context))
+            {
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+static bool _gnt_map(gnt_trie_t* trie, gnt_byte_t* key, gnt_node_t* parent, gnt_index_t depth, gnt_mapper_t mapper, void* context, atomic_bool* stop)
+{
+    if (atomic_load_explicit(stop, memory_order_relaxed))
+    {
+        return true;
+    }
+    
+    if (parent && parent->occupied && _gnt_map_node(trie, key, depth, parent, mapper, context))
+    {
+        atomic_store_explicit(stop, true, memory_order_relaxed);
+        return true;
+    }
+    
+    if (depth == GNT_CURSOR_KEY_MAX)
+    {
+        return false;
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, high_nibble);
+        
+        if (!nibble)
+        {
+            continue;
+        }
+        
+        uint8_t rank = 0;
+        
+        for (uint16_t map = nibble->map; map; map &= map - 1, rank++)
+        {
+            gnt_node_t* node = nibble->nodes[rank];
+            
+            if (depth + 1 + node->length > GNT_CURSOR_KEY_MAX)
+            {
+                continue;
+            }
+            
+            key[depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(map));
+            memcpy(key + depth + 1, node->prefix, node->length);
+            
+            if (_gnt_map(trie, key, node, depth + 1 + node->length, mapper, context, stop))
+            {
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
+static size_t _gnt_partition(gnt_pass_t* pass, size_t target, void* context)
+{
+    gnt_task_t* tasks = pass->tasks;
+    size_t head = 0;
+    size_t count = 1;
+    
+    tasks[0].node = NULL;
+    tasks[0].depth = 0;
+    
+    // Subtries are split breadth-first, so a skewed trie is split deeper below its heavier branches
+    while (head < count && count - head < target && !atomic_load_explicit(&pass->stop, memory_order_relaxed))
+    {
+        // Tasks already split are dropped from the front when the children of one more might not fit
+        if (count > target)
+        {
+            memmove(tasks, tasks + head, (count - head) * sizeof(gnt_task_t));
+            count -= head;
+            head = 0;
+        }
+        
+        gnt_task_t* task = &tasks[head++];
+        gnt_node_t* parent = task->node;
+        
+        // The parent's own data is mapped here, its children become tasks of their own
+        if (parent && parent->occupied && _gnt_map_node(pass->trie, task->key, task->depth, parent, pass->mapper, context))
+        {
+            atomic_store_explicit(&pass->stop, true, memory_order_relaxed);
+            break;
+        }
+        
+        if (task->depth == GNT_CURSOR_KEY_MAX)
+        {
+            continue;
+        }
+        
+        for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+        {
+            gnt_nibble_t* nibble = _gnt_nibble_get(pass->trie, parent, high_nibble);
+            
+            if (!nibble)
+            {
+                continue;
+            }
+            
+            uint8_t rank = 0;
+            
+            for (uint16_t map = nibble->map; map; map &= map - 1, rank++)
+            {
+                gnt_node_t* node = nibble->nodes[rank];
+                gnt_index_t depth = task->depth + 1 + node->length;
+                
+                if (depth > GNT_CURSOR_KEY_MAX)
+                {
+                    continue;
+                }
+                
+                gnt_task_t* child = &tasks[count++];
+                
+                child->node = node;
+                child->depth = depth;
+                memcpy(child->key, task->key, task->depth);
+                child->key[task->depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(map));
+                memcpy(child->key + task->depth + 1, node->prefix, node->length);
+            }
+        }
+    }
+    
+    if (head)
+    {
+        memmove(tasks, tasks + head, (count - head) * sizeof(gnt_task_t));
+    }
+    
+    return count - head;
+}
+
+static int _gnt_pass(void* worker)
+{
+    gnt_pass_t* pass = ((gnt_worker_t*) worker)->pass;
+    void* context = ((gnt_worker_t*) worker)->context;
+    gnt_byte_t key[GNT_CURSOR_KEY_MAX];
+    
+    // Tasks are taken one at a time, so threads that finish early keep taking on the remaining subtries
+    for (size_t i; (i = atomic_fetch_add_explicit(&pass->next, 1, memory_order_relaxed)) < pass->count;)
+    {
+        gnt_task_t* task = &pass->tasks[i];
+        
+        memcpy(key, task->key, task->depth);
+        
+        if (_gnt_map(pass->trie, key, task->node, task->depth, pass->mapper, context, &pass->stop))
+        {
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+static void* _gnt_flatten_reserve(gnt_writer_t* writer, size_t size, uint64_t* offset)
+{
+    uint64_t start = writer->size;
+    
+    // Records that fit in a cache line never straddle two
+    if (size <= GNT_LINE_SIZE && start % GNT_LINE_SIZE + size > GNT_LINE_SIZE)
+    {
+        start += GNT_LINE_SIZE - start % GNT_LINE_SIZE;
+    }
+    
+    if (start + size > writer->capacity)
+    {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : GNT_SLAB_MAX;
+        
+        while (capacity < start + size)
+        {
+            capacity *= 2;
+        }
+        
+        char* block = writer->allocator(capacity + GNT_LINE_SIZE - 1);
+        
+        if (!block)
+        {
+            return NULL;
+        }
+        
+        // Offsets are cache-line aligned relative to the image, so the image itself is too
+        char* bytes = block + (GNT_LINE_SIZE - (uintptr_t) block % GNT_LINE_SIZE) % GNT_LINE_SIZE;
+        
+        if (writer->block)
+        {
+            memcpy(bytes, writer->bytes, writer->size);
+            writer->releaser(writer->block);
+        }
+        
+        writer->block = block;
+        writer->bytes = bytes;
+        writer->capacity = capacity;
+    }
+    
+    memset(writer->bytes + writer->size, 0, start + size - writer->size);
+    writer->size = start + size;
+    *offset = start;
+    
+    return writer->bytes + start;
+}
+
+static uint64_t _gnt_flatten_record(gnt_writer_t* writer, void* source, bool nibble)
+{
+    gnt_trie_t* trie = writer->trie;
+    gnt_nibble_t* from_nibble = source;
+    gnt_node_t* from_node = source;
+    uint8_t children = nibble ? GNT_CHILDREN(from_nibble) : GNT_CHILDREN(from_node);
+    uint64_t offset;
+    
+    if (writer->queued == writer->queue_capacity)
+    {
+        size_t capacity = writer->queue_capacity ? writer->queue_capacity * 2 : GNT_SLAB_MIN;
+        uint64_t* queue = trie->allocator(capacity * sizeof(uint64_t));
+        
+        if (!queue)
+        {
+            return 0;
+        }
+        
+        if (writer->queue)
+        {
+            memcpy(queue, writer->queue, writer->queued * sizeof(uint64_t));
+            trie->releaser(writer->queue);
+        }
+        
+        writer->queue = queue;
+        writer->queue_capacity = capacity;
+    }
+    
+    void* record = _gnt_flatten_reserve(writer, nibble ? GNT_NIBBLE_SIZE(children) : GNT_NODE_SIZE(children), &offset);
+    
+    if (!record)
+    {
+        return 0;
+    }
+    
+    // Records are sized to their children exactly, whose slots hold the source children until the record is dequeued
+    if (nibble)
+    {
+        gnt_nibble_t* to = record;
+        to->map = from_nibble->map;
+        to->capacity = children;
+        
+        for (uint8_t i = 0; i < children; i++)
+        {
+            to->nodes[i] = _gnt_resolve(trie, from_nibble->nodes[i]);
+        }
+    }
+    else
+    {
+        gnt_node_t* to = record;
+        to->occupied = from_node->occupied ? true : false;
+        to->capacity = children;
+        to->length = from_node->length;
+        to->map = from_node->map;
+        to->data = from_node->occupied ? from_node->data : 0;
+        memcpy(to->prefix, from_node->prefix, from_node->length);
+        
+        for (uint8_t i = 0; i < children; i++)
+        {
+            to->nibbles[i] = _gnt_resolve(trie, from_node->nibbles[i]);
+        }
+    }
+    
+    writer->queue[writer->queued++] = offset;
+    
+    return offset;
+}
+
+static gnt_status_t _gnt_flatten(gnt_writer_t* writer)
+{
+    gnt_trie_t* trie = writer->trie;
+    gnt_image_t image;
+    uint64_t offset;
+    
+    memset(&image, 0, sizeof(gnt_image_t));
+    
+    if (!_gnt_flatten_reserve(writer, sizeof(gnt_image_t), &offset))
+    {
+        return -1;
+    }
+    
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, NULL, i);
+        
+        if (nibble && !(image.nibbles[i] = _gnt_flatten_record(writer, nibble, true)))
+        {
+            return -1;
+        }
+    }
+    
+    // Breadth-first, levels alternate between nibbles and nodes and the upper ones share a few cache lines
+    size_t level = writer->queued;
+    bool nibbles = true;
+    
+    for (size_t head = 0; head < writer->queued; head++)
+    {
+        if (head == level)
+        {
+            level = writer->queued;
+            nibbles = !nibbles;
+        }
+        
+        uint64_t parent = writer->queue[head];
+        uint16_t map = nibbles ? ((gnt_nibble_t*) (writer->bytes + parent))->map : ((gnt_node_t*) (writer->bytes + parent))->map;
+        uint8_t children = (uint8_t) __builtin_popcount(map);
+        
+        for (uint8_t i = 0; i < children; i++)
+        {
+            // Reserving may move the image, records are reached again through their offset
+            void** slot = nibbles ? (void**) &((gnt_nibble_t*) (writer->bytes + parent))->nodes[i] : (void**) &((gnt_node_t*) (writer->bytes + parent))->nibbles[i];
+            uint64_t child = _gnt_flatten_record(writer, *slot, !nibbles);
+            
+            if (!child)
+            {
+                return -1;
+            }
+            
+            slot = nibbles ? (void**) &((gnt_nibble_t*) (writer->bytes + parent))->nodes[i] : (void**) &((gnt_node_t*) (writer->bytes + parent))->nibbles[i];
+            *slot = (void*) (uintptr_t) child;
+        }
+    }
+    
+    memcpy(image.magic, GNT_IMAGE_MAGIC, sizeof(image.magic));
+    image.order = GNT_IMAGE_ORDER;
+    image.node_size = sizeof(gnt_node_t);
+    image.nibble_size = sizeof(gnt_nibble_t);
+    image.flags = trie->flags & GNT_IMAGE_FLAGS;
+    image.size = writer->size;
+    memcpy(writer->bytes, &image, sizeof(gnt_image_t));
+    
+    return 0;
+}
+
+static gnt_trie_t* _gnt_freeze(gnt_trie_t* trie, gnt_allocator_t allocator, gnt_releaser_t releaser)
+{
+    gnt_writer_t writer = {.trie = trie, .allocator = allocator, .releaser = releaser};
+    gnt_cfg_t cfg = {trie->accessor, trie->span_accessor, NULL, allocator, releaser, trie->flags & GNT_FLAG_WIDE_ROOT, trie->observer, NULL, 0, 0, 0};
+    
+    _gnt_lock_all(trie, false);
+    gnt_status_t status = _gnt_flatten(&writer);
+    _gnt_unlock_all(trie, false);
+    
+    if (writer.queue) trie->releaser(writer.queue);
+    
+    gnt_trie_t* frozen = 0 == status ? _gnt_adopt(writer.bytes, writer.size, &cfg) : NULL;
+    
+    if (!frozen)
+    {
+        if (writer.block) writer.releaser(writer.block);
+        return NULL;
+    }
+    
+    frozen->block = writer.block;
+    
+    return frozen;
+}
+
+static uint32_t _gnt_numa_node(void)
+{
+#ifdef __linux__
+    unsigned cpu;
+    unsigned node;
+    
+    if (0 == syscall(SYS_getcpu, &cpu, &node, NULL))
+    {
+        return node;
+    }
+#endif
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_replica_refresh(gnt_replicas_t* replicas, gnt_replica_t* replica)
+{
+    gnt_trie_t* trie = replicas->trie;
+    size_t index = (size_t) (replica - replicas->replicas);
+    
+    // Cleared before the copy is taken, writes it misses mark the replica again
+    atomic_store(&replica->stale, false);
+    
+    gnt_trie_t* frozen = replicas->allocators ? _gnt_freeze(trie, replicas->allocators[index], replicas->releaser) : _gnt_freeze(trie, trie->allocator, trie->releaser);
+    
+    atomic_store_explicit(&replica->refreshed, _gnt_journal_clock(), memory_order_relaxed);
+    
+    if (!frozen)
+    {
+        atomic_store(&replica->stale, true);
+        return -1;
+    }
+    
+    gnt_trie_t* previous = atomic_exchange(&replica->frozen, frozen);
+    
+    // Pins taken before the exchange may sit on either side, each is drained in turn while new pins go to the other
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        unsigned side = atomic_load(&replica->side);
+        atomic_store(&replica->side, side ^ 1);
+        
+        while (atomic_load(&replica->readers[side]))
+        {
+            thrd_yield();
+        }
+    }
+    
+    return previous ? gnt_destroy(previous) : 0;
+}
+
+static void _gnt_replicas_release(gnt_replicas_t* replicas, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        gnt_replica_t* replica = &replicas->replicas[i];
+        gnt_trie_t* frozen = atomic_load(&replica->frozen);
+        
+        if (frozen)
+        {
+            gnt_destroy(frozen);
+        }
+        
+        GLL_MUTEX_DESTROY(replica);
+    }
+    
+    replicas->trie->releaser(replicas);
+}
+
+static gnt_trie_t* _gnt_adopt(const char* base, size_t size, gnt_cfg_t* cfg)
+{
+    const gnt_image_t* image = (const gnt_image_t*) base;
+    
+    if (size < sizeof(gnt_image_t) || 0 != memcmp(image->magic, GNT_IMAGE_MAGIC, sizeof(image->magic)) || GNT_IMAGE_ORDER != image->order
+        || sizeof(gnt_node_t) != image->node_size || sizeof(gnt_nibble_t) != image->nibble_size || size != image->size)
+    {
+        return NULL;
+    }
+    
+    gnt_cfg_t adopted = cfg ? *cfg : (gnt_cfg_t) {0};
+    adopted.deallocator = NULL;
+    adopted.journal = NULL;
+    adopted.budget = 0;
+    adopted.flags = (image->flags & GNT_IMAGE_FLAGS) | (adopted.flags & GNT_FLAG_WIDE_ROOT);
+    
+    gnt_trie_t* trie = gnt_create(&adopted);
+    
+    if (!trie)
+    {
+        return NULL;
+    }
+    
+    trie->base = base;
+    trie->size = size;
+    
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        trie->nibbles[i] = (gnt_nibble_t*) (uintptr_t) image->nibbles[i];
+        
+        if (image->nibbles[i])
+        {
+            atomic_fetch_add(&trie->children, 1);
+        }
+    }
+    
+    for (uint16_t byte = 0; trie->roots && byte < 256; byte++)
+    {
+        _gnt_root_refresh(trie, (gnt_byte_t) byte);
+    }
+    
+    // Images are never written to, their counters are taken once
+    gnt_stats_t shape;
+    
+    memset(&shape, 0, sizeof(gnt_stats_t));
+    _gnt_stats_walk(trie, NULL, 0, &shape, &trie->shards[0].tally);
+    
+    return trie;
+}
+
+static void _gnt_stats_walk(gnt_trie_t* trie, gnt_node_t* parent, gnt_index_t depth, gnt_stats_t* stats, gnt_tally_t* tally)
+{
+    if (parent)
+    {
+        tally->nodes++;
+        tally->slots += parent->capacity;
+        stats->node_fanout[GNT_CHILDREN(parent)]++;
+        
+        if (parent->occupied)
+        {
+            tally->values++;
+            tally->key_bytes += depth;
+            stats->max_depth = depth > stats->max_depth ? depth : stats->max_depth;
+        }
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, high_nibble);
+        
+        if (!nibble)
+        {
+            continue;
+        }
+        
+        tally->nibbles++;
+        tally->slots += nibble->capacity;
+        stats->nibble_fanout[GNT_CHILDREN(nibble)]++;
+        
+        for (uint8_t i = 0; i < GNT_CHILDREN(nibble); i++)
+        {
+            gnt_node_t* node = _gnt_resolve(trie, nibble->nodes[i]);
+            _gnt_stats_walk(trie, node, depth + 1 + node->length, stats, tally);
+        }
+    }
+}
+
+static void _gnt_release(gnt_trie_t* trie)
+{
+    // Nodes live in the pools, so they only need to be visited to release their data
+    if (!trie->deallocator)
+    {
+        return;
+    }
+    
+    gnt_release_t releases[16];
+    thrd_t threads[16];
+    uint8_t started = 0;
+    
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        if (!trie->nibbles[i])
+        {
+            continue;
+        }
+        
+        releases[started] = (gnt_release_t) {trie->nibbles[i], trie->deallocator};
+        
+        if (!(trie->flags & GNT_FLAG_FREE_THREADS) || thrd_success != thrd_create(&threads[started], _gnt_release_subtrie, &releases[started]))
+        {
+            _gnt_release_subtrie(&releases[started]);
+            continue;
+        }
+        
+        started++;
+    }
+    
+    for (uint8_t i = 0; i < started; i++)
+    {
+        thrd_join(threads[i], NULL);
+    }
+}
+
+static int _gnt_release_subtrie(void* release)
+{
+    gnt_deallocator_t deallocator = ((gnt_release_t*) release)->deallocator;
+    gnt_nibble_t* stack[GNT_RELEASE_STACK];
+    gnt_node_t* pending = NULL;
+    size_t depth = 0;
+    
+    stack[depth++] = ((gnt_release_t*) release)->nibble;
+    
+    while (depth || pending)
+    {
+        // Nodes whose nibbles did not fit on the stack are chained through their data, already released
+        if (!depth)
+        {
+            gnt_node_t* node = pending;
+            pending = (gnt_node_t*) node->data;
+            
+            memcpy(stack, node->nibbles, GNT_CHILDREN(node) * sizeof(gnt_nibble_t*));
+            depth = GNT_CHILDREN(node);
+            continue;
+        }
+        
+        gnt_nibble_t* nibble = stack[--depth];
+        
+        // Children are pushed last to first so that the walk follows them in the order they were allocated in
+        for (uint8_t i = GNT_CHILDREN(nibble); i--;)
+        {
+            gnt_node_t* node = nibble->nodes[i];
+            
+            if (node->occupied)
+            {
+                deallocator(node->data);
+            }
+            
+            if (depth + GNT_CHILDREN(node) <= GNT_RELEASE_STACK)
+            {
+                for (uint8_t j = GNT_CHILDREN(node); j--;)
+                {
+                    stack[depth++] = node->nibbles[j];
+                }
+            }
+            else
+            {
+                node->data = (gnt_data_t) pending;
+                pending = node;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_delete(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length)
+{
+    return _gnt_remove(trie, shard, bytes, length, trie->flags & GNT_FLAG_LAZY_DELETE);
+}
+
+static gnt_status_t _gnt_remove(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, bool lazy)
+{
+    gnt_cut_t cut;
+    gnt_node_t** slot = trie->base || trie->origin ? NULL : _gnt_locate(trie, shard, bytes, length, &cut);
+    
+    if (!slot || !(*slot)->occupied)
+    {
+        return MISSING;
+    }
+    
+    gnt_node_t* node = *slot;
+    
+    if (0 != _gnt_discard(trie, shard, node->data))
+    {
+        return MISSING;
+    }
+    
+    node->data = 0;
+    node->occupied = false;
+    shard->tally.values--;
+    shard->tally.key_bytes -= length;
+    
+    // Lazy deletes leave the branch for gnt_compact, unless the key can't be queued
+    if (!lazy || 0 != _gnt_defer(trie, shard, bytes, length))
+    {
+        _gnt_prune(shard, slot, &cut, trie->flags & GNT_FLAG_COMPRESS);
+        _gnt_root_refresh(trie, bytes[0]);
+    }
+    
+    // The key is gone either way, the caller only learns that the log lost its deletion
+    if (trie->journal && 0 != _gnt_journal_append(trie, GNT_JOURNAL_DELETE, bytes, length, 0))
+    {
+        return MISSING;
+    }
+    
+    return STOP;
+}
+
+static size_t _gnt_compact_shard(gnt_trie_t* trie, gnt_shard_t* shard, size_t budget)
+{
+    size_t pruned = 0;
+    
+    while (shard->pending_size && (!budget || pruned < budget))
+    {
+        gnt_index_t length;
+        gnt_cut_t cut;
+        
+        memcpy(&length, shard->pending + shard->pending_size - sizeof(gnt_index_t), sizeof(gnt_index_t));
+        shard->pending_size -= length + sizeof(gnt_index_t);
+        
+        // The key may have been inserted again or queued twice, pruning then stops at its node
+        const gnt_byte_t* bytes = shard->pending + shard->pending_size;
+        gnt_node_t** slot = _gnt_locate(trie, shard, bytes, length, &cut);
+        
+        if (slot)
+        {
+            _gnt_prune(shard, slot, &cut, trie->flags & GNT_FLAG_COMPRESS);
+            _gnt_root_refresh(trie, bytes[0]);
+        }
+        
+        pruned++;
+    }
+    
+    if (!shard->pending_size && shard->pending)
+    {
+        trie->releaser(shard->pending);
+        shard->pending = NULL;
+        shard->pending_capacity = 0;
+    }
+    
+    return pruned;
+}
+
+static void _gnt_evict(gnt_trie_t* trie, gnt_shard_t* shard)
+{
+    size_t target = trie->budget - trie->budget / GNT_EVICT_SLACK;
+    size_t passed = 0; // Keys passed over since the last eviction, every bit is cleared once they cover the shard twice
+    
+    // Branches left by lazy deletes go before any key that is still stored
+    _gnt_compact_shard(trie, shard, 0);
+    
+    // The clock hand sweeps the keys of the shard in order, giving a second chance to those searched since it last went by
+    while (passed <= 2 * shard->tally.values)
+    {
+        size_t used = atomic_load_explicit(&trie->used, memory_order_relaxed);
+        
+        // Shards holding less than an even share leave the rest to the largest one, see _gnt_evict_largest
+        if (used <= target || shard->used * (trie->mask + 1u) < used)
+        {
+            break;
+        }
+        
+        gnt_node_t* node = _gnt_evict_next(trie, shard, NULL, 0, shard->hand_length);
+        
+        if (!node && shard->hand_length)
+        {
+            shard->hand_length = 0;
+            node = _gnt_evict_next(trie, shard, NULL, 0, false);
+        }
+        
+        if (!node)
+        {
+            break;
+        }
+        
+        if (node->occupied & GNT_REFERENCED)
+        {
+            node->occupied = true;
+            passed++;
+        }
+        else if (MISSING == _gnt_remove(trie, shard, shard->hand, shard->hand_length, false))
+        {
+            break;
+        }
+        else
+        {
+            passed = 0;
+        }
+    }
+}
+
+static void _gnt_evict_largest(gnt_trie_t* trie, gnt_shard_t* shard)
+{
+    gnt_shard_t* largest = NULL;
+    size_t most = 0;
+    
+    // Counts are read without the locks of their shards, a stale one only picks another shard
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        size_t used = __atomic_load_n(&trie->shards[i].used, __ATOMIC_RELAXED);
+        
+        if (&trie->shards[i] != shard && used > most)
+        {
+            largest = &trie->shards[i];
+            most = used;
+        }
+    }
+    
+    // Never waits for the shard or its readers, the caller may still hold other shards
+    if (!largest || !GNT_MUTEX_TRYLOCK(largest))
+    {
+        return;
+    }
+    
+    unsigned int idle = 0;
+    
+    if (!(trie->flags & GNT_FLAG_RWLOCK) || atomic_compare_exchange_strong(&largest->readers, &idle, GNT_WRITER))
+    {
+        GNT_PROBE_ACQUIRE(trie);
+        
+        if (!trie->snapshots)
+        {
+            _gnt_evict(trie, largest);
+        }
+        
+        if (trie->replicas)
+        {
+            _gnt_replicas_mark(trie->replicas);
+        }
+        
+        if (trie->flags & GNT_FLAG_RWLOCK)
+        {
+            atomic_fetch_and_explicit(&largest->readers, ~GNT_WRITER, memory_order_release);
+        }
+    }
+    
+    GNT_MUTEX_UNLOCK(largest);
+}
+
+static gnt_node_t* _gnt_evict_next(gnt_trie_t* trie, gnt_shard_t* shard, gnt_node_t* parent, size_t depth, bool bounded)
+{
+    unsigned int start = 0;
+    
+    // Same walk as _gnt_cursor_after from the hand, the key found is written over it in place
+    if (bounded && depth == shard->hand_length)
+    {
+        bounded = false; // Every descendant is past the hand
+    }
+    else if (bounded)
+    {
+        start = shard->hand[depth];
+    }
+    else if (parent && parent->occupied)
+    {
+        shard->hand_length = depth;
+        return parent;
+    }
+    
+    for (unsigned int byte = start; byte < 256; byte++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(trie, parent, GNT_HIGH_NIBBLE(byte));
+        gnt_node_t* node;
+        
+        // Root subtries of other shards are not guarded by this one's lock
+        if (!nibble || (!parent && GNT_SHARD(trie, GNT_HIGH_NIBBLE(byte)) != shard))
+        {
+            byte |= 0x0F;
+            continue;
+        }
+        
+        if (!(node = _gnt_node_get(trie, nibble, GNT_LOW_NIBBLE(byte))))
+        {
+            continue;
+        }
+        
+        bool bound = bounded && byte == start;
+        
+        if (bound)
+        {
+            size_t rest = shard->hand_length - depth - 1;
+            int order = memcmp(node->prefix, shard->hand + depth + 1, node->length < rest ? node->length : rest);
+            
+            if (order < 0)
+            {
+                continue;
+            }
+            
+            if (order > 0 || node->length > rest)
+            {
+                bound = false;
+            }
+        }
+        
+        if (depth + 1 + node->length > shard->hand_capacity)
+        {
+            size_t capacity = shard->hand_capacity ? 2 * shard->hand_capacity : GNT_SPAN_BUFFER;
+            gnt_byte_t* hand = trie->allocator(capacity);
+            
+            if (!hand)
+            {
+                return NULL;
+            }
+            
+            if (shard->hand)
+            {
+                memcpy(hand, shard->hand, shard->hand_capacity);
+                trie->releaser(shard->hand);
+            }
+            
+            shard->hand = hand;
+            shard->hand_capacity = capacity;
+        }
+        
+        shard->hand[depth] = (gnt_byte_t) byte;
+        memcpy(&shard->hand[depth + 1], node->prefix, node->length);
+        
+        gnt_node_t* found = _gnt_evict_next(trie, shard, node, depth + 1 + node->length, bound);
+        
+        if (found)
+        {
+            return found;
+        }
+    }
+    
+    return NULL;
+}
+
+static gnt_node_t** _gnt_locate(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length, gnt_cut_t* cut)
+{
+    gnt_node_t** parent = NULL;
+    gnt_node_t** slot = NULL;
+    gnt_index_t index = 0;
+    
+    while (index < length)
+    {
+        gnt_byte_t byte = bytes[index++];
+        GNT_PROBE_LEVEL();
+        
+        gnt_nibble_t** nibble = parent ? _gnt_nibble_slot(*parent, GNT_HIGH_NIBBLE(byte)) : &trie->nibbles[GNT_HIGH_NIBBLE(byte)];
+        
+        // The path is copied out of open snapshots on the way down, as the node found is about to change
+        if (!nibble || !*nibble || !(parent ? _gnt_own(shard, nibble) : _gnt_own_root(shard, GNT_HIGH_NIBBLE(byte))))
+        {
+            return NULL;
+        }
+        
+        if (!(slot = _gnt_node_slot(*nibble, GNT_LOW_NIBBLE(byte))))
+        {
+            return NULL;
+        }
+        
+        // The branch removed by a delete starts below the last node that keeps other keys or children
+        if (!parent || (*parent)->occupied || 1 != GNT_CHILDREN(*parent) || 1 != GNT_CHILDREN(*nibble))
+        {
+            *cut = (gnt_cut_t) {nibble, slot, parent, byte};
+        }
+        
+        gnt_node_t* node = *slot;
+        
+        if (node->length)
+        {
+            if (node->length > length - index || 0 != memcmp(node->prefix, bytes + index, node->length))
+            {
+                return NULL;
+            }
+            
+            index += node->length;
+        }
+        
+        parent = slot;
+    }
+    
+    return slot;
+}
+
+static void _gnt_prune(gnt_shard_t* shard, gnt_node_t** slot, gnt_cut_t* cut, bool compress)
+{
+    gnt_node_t* node = *slot;
+    
+    if (node->occupied)
+    {
+        return;
+    }
+    
+    if (GNT_CHILDREN(node))
+    {
+        if (1 == GNT_CHILDREN(node) && compress)
+        {
+            _gnt_merge(shard, slot);
+        }
+        
+        return;
+    }
+    
+    // Below the cut, every node has a single nibble holding a single node, down to the emptied one
+    node = *cut->slot;
+    
+    while (node)
+    {
+        gnt_nibble_t* nibble = GNT_CHILDREN(node) ? node->nibbles[0] : NULL;
+        gnt_node_t* child = nibble ? nibble->nodes[0] : NULL;
+        
+        _gnt_node_free(shard, node);
+        
+        if (nibble)
+        {
+            _gnt_nibble_free(shard, nibble);
+        }
+        
+        node = child;
+    }
+    
+    _gnt_node_detach(shard, cut->nibble, GNT_LOW_NIBBLE(cut->byte));
+    
+    if (GNT_CHILDREN(*cut->nibble))
+    {
+        return;
+    }
+    
+    _gnt_nibble_free(shard, *cut->nibble);
+    
+    if (!cut->parent)
+    {
+        *cut->nibble = NULL;
+        atomic_fetch_sub(&shard->trie->children, 1);
+        return;
+    }
+    
+    _gnt_nibble_detach(shard, cut->parent, GNT_HIGH_NIBBLE(cut->byte));
+    
+    if (!(*cut->parent)->occupied && 1 == GNT_CHILDREN(*cut->parent) && compress)
+    {
+        _gnt_merge(shard, cut->parent);
+    }
+}
+
+static gnt_status_t _gnt_defer(gnt_trie_t* trie, gnt_shard_t* shard, const gnt_byte_t* bytes, gnt_index_t length)
+{
+    size_t needed = shard->pending_size + length + sizeof(gnt_index_t);
+    
+    if (needed > shard->pending_capacity)
+    {
+        size_t capacity = shard->pending_capacity ? shard->pending_capacity : GNT_SLAB_MIN;
+        
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+        
+        gnt_byte_t* pending = trie->allocator(capacity);
+        
+        if (!pending)
+        {
+            return -1;
+        }
+        
+        if (shard->pending)
+        {
+            memcpy(pending, shard->pending, shard->pending_size);
+            trie->releaser(shard->pending);
+        }
+        
+        shard->pending = pending;
+        shard->pending_capacity = capacity;
+    }
+    
+    // The length follows the key so that the newest key is popped first
+    memcpy(shard->pending + shard->pending_size, bytes, length);
+    memcpy(shard->pending + shard->pending_size + length, &length, sizeof(gnt_index_t));
+    shard->pending_size = needed;
+    
+    return 0;
+}
+
+static gnt_nibble_t* _gnt_copy(gnt_shard_t* shard, gnt_nibble_t** slot)
+{
+    gnt_trie_t* trie = shard->trie;
+    gnt_nibble_t* nibble = *slot;
+    gnt_nibble_t* copy = NULL;
+    uint8_t copied = 0;
+    
+    // Room to retire the originals is made first, so that nothing is left half copied
+    if (0 == _gnt_retire_reserve(shard, GNT_CHILDREN(nibble) + 1) && (copy = _gnt_nibble_alloc(shard, nibble->capacity)))
+    {
+        memcpy(copy, nibble, GNT_NIBBLE_SIZE(GNT_CHILDREN(nibble)));
+        copy->generation = trie->generation;
+        
+        for (; copied < GNT_CHILDREN(nibble); copied++)
+        {
+            gnt_node_t* node = nibble->nodes[copied];
+            
+            if (!(copy->nodes[copied] = _gnt_node_alloc(shard, node->capacity)))
+            {
+                break;
+            }
+            
+            memcpy(copy->nodes[copied], node, GNT_NODE_SIZE(GNT_CHILDREN(node)));
+        }
+    }
+    
+    if (!copy || copied < GNT_CHILDREN(nibble))
+    {
+        while (copied--)
+        {
+            _gnt_node_free(shard, copy->nodes[copied]);
+        }
+        
+        if (copy) _gnt_nibble_free(shard, copy);
+        return NULL;
+    }
+    
+    // The nibble and its nodes are only reclaimed once the snapshots that can still read them are closed
+    gnt_retired_t* retired = shard->retired + shard->retired_size;
+    
+    *retired++ = (gnt_retired_t) {(uintptr_t) nibble, trie->generation, GNT_RETIRED_NIBBLE};
+    
+    for (uint8_t i = 0; i < GNT_CHILDREN(nibble); i++)
+    {
+        *retired++ = (gnt_retired_t) {(uintptr_t) nibble->nodes[i], trie->generation, GNT_RETIRED_NODE};
+    }
+    
+    shard->retired_size += GNT_CHILDREN(nibble) + 1;
+    *slot = copy;
+    
+    return copy;
+}
+
+static gnt_nibble_t* _gnt_own_root(gnt_shard_t* shard, gnt_byte_t high_nibble)
+{
+    gnt_trie_t* trie = shard->trie;
+    gnt_nibble_t* nibble = trie->nibbles[high_nibble];
+    gnt_nibble_t* owned = _gnt_own(shard, &trie->nibbles[high_nibble]);
+    
+    // The wide root table points to the nodes of the nibble, which moved with it
+    for (gnt_byte_t low_nibble = 0; owned && owned != nibble && low_nibble < 16; low_nibble++)
+    {
+        _gnt_root_refresh(trie, GNT_MAKE_BYTE(high_nibble, low_nibble));
+    }
+    
+    return owned;
+}
+
+static gnt_status_t _gnt_own_subtrie(gnt_shard_t* shard, gnt_nibble_t* nibble)
+{
+    for (uint8_t i = 0; i < GNT_CHILDREN(nibble); i++)
+    {
+        gnt_node_t* node = nibble->nodes[i];
+        
+        for (uint8_t j = 0; j < GNT_CHILDREN(node); j++)
+        {
+            gnt_nibble_t* child = _gnt_own(shard, &node->nibbles[j]);
+            
+            if (!child || 0 != _gnt_own_subtrie(shard, child))
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_own_all(gnt_trie_t* trie)
+{
+    // Passes hand out writable data, every node shared with open snapshots is copied first
+    for (gnt_byte_t high_nibble = 0; trie->snapshots && high_nibble < 16; high_nibble++)
+    {
+        gnt_shard_t* shard = GNT_SHARD(trie, high_nibble);
+        gnt_nibble_t* nibble;
+        
+        if (trie->nibbles[high_nibble] && (!(nibble = _gnt_own_root(shard, high_nibble)) || 0 != _gnt_own_subtrie(shard, nibble)))
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_discard(gnt_trie_t* trie, gnt_shard_t* shard, gnt_data_t data)
+{
+    if (!trie->deallocator)
+    {
+        return 0;
+    }
+    
+    if (!trie->snapshots)
+    {
+        trie->deallocator(data);
+        return 0;
+    }
+    
+    // Open snapshots may still return the data, it is released along with the nodes they read
+    if (0 != _gnt_retire_reserve(shard, 1))
+    {
+        return -1;
+    }
+    
+    shard->retired[shard->retired_size++] = (gnt_retired_t) {data, trie->generation, GNT_RETIRED_DATA};
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_retire_reserve(gnt_shard_t* shard, size_t count)
+{
+    size_t needed = shard->retired_size + count;
+    
+    if (needed > shard->retired_capacity)
+    {
+        size_t capacity = shard->retired_capacity ? shard->retired_capacity : GNT_SLAB_MIN / sizeof(gnt_retired_t);
+        
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+        
+        gnt_retired_t* retired = shard->trie->allocator(capacity * sizeof(gnt_retired_t));
+        
+        if (!retired)
+        {
+            return -1;
+        }
+        
+        if (shard->retired)
+        {
+            memcpy(retired, shard->retired, shard->retired_size * sizeof(gnt_retired_t));
+            shard->trie->releaser(shard->retired);
+        }
+        
+        shard->retired = retired;
+        shard->retired_capacity = capacity;
+    }
+    
+    return 0;
+}
+
+static void _gnt_reclaim(gnt_trie_t* trie)
+{
+    gnt_trie_t* oldest = trie->snapshots;
+    
+    while (oldest && oldest->snapshots)
+    {
+        oldest = oldest->snapshots;
+    }
+    
+    // Everything replaced after the oldest open snapshot was taken is still read by it
+    for (uint8_t i = 0; i <= trie->mask; i++)
+    {
+        gnt_shard_t* shard = &trie->shards[i];
+        size_t reclaimed = 0;
+        
+        for (; reclaimed < shard->retired_size && (!oldest || shard->retired[reclaimed].generation <= oldest->generation); reclaimed++)
+        {
+            gnt_retired_t* retired = &shard->retired[reclaimed];
+            
+            if (GNT_RETIRED_NIBBLE == retired->kind)
+            {
+                _gnt_nibble_free(shard, (gnt_nibble_t*) retired->object);
+            }
+            else if (GNT_RETIRED_NODE == retired->kind)
+            {
+                _gnt_node_free(shard, (gnt_node_t*) retired->object);
+            }
+            else
+            {
+                trie->deallocator((gnt_data_t) retired->object);
+            }
+        }
+        
+        if (reclaimed)
+        {
+            shard->retired_size -= reclaimed;
+            memmove(shard->retired, shard->retired + reclaimed, shard->retired_size * sizeof(gnt_retired_t));
+        }
+    }
+}
+
+static void* _gnt_pool_alloc(gnt_shard_t* shard, uint8_t class)
+{
+    gnt_pool_t* pool = &shard->pools[class];
+    void* object = pool->released;
+    
+    GNT_PROBE_ALLOCATION();
+    shard->epoch++;
+    
+    if (object)
+    {
+        pool->released = *(void**) object;
+    }
+    else
+    {
+        if ((size_t) (pool->end - pool->cursor) < pool->size)
+        {
+            gnt_slab_t* slab = shard->trie->allocator(GNT_LINE_SIZE + pool->bytes);
+            
+            if (!slab)
+            {
+                return NULL;
+            }
+            
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            shard->tally.bytes += GNT_LINE_SIZE + pool->bytes;
+            
+            // Objects start on the first cache line after the header, so that single-slot nibbles and nodes never straddle two
+            pool->cursor = (char*) (slab + 1);
+            pool->cursor += (GNT_LINE_SIZE - (uintptr_t) pool->cursor % GNT_LINE_SIZE) % GNT_LINE_SIZE;
+            pool->end = pool->cursor + pool->bytes;
+            
+            if (pool->bytes < GNT_SLAB_MAX)
+            {
+                pool->bytes *= 2;
+            }
+        }
+        
+        object = pool->cursor;
+        pool->cursor += pool->size;
+    }
+    
+    shard->used += pool->size;
+    
+    if (shard->trie->budget)
+    {
+        atomic_fetch_add_explicit(&shard->trie->used, pool->size, memory_order_relaxed);
+    }
+    
+    memset(object, 0, pool->size);
+    return object;
+}
+
+static void _gnt_pool_release(gnt_shard_t* shard, uint8_t class, void* object)
+{
+    gnt_pool_t* pool = &shard->pools[class];
+    
+    *(void**) object = pool->released;
+    pool->released = object;
+    shard->epoch++;
+    
+    shard->used -= pool->size;
+    
+    if (shard->trie->budget)
+    {
+        atomic_fetch_sub_explicit(&shard->trie->used, pool->size, memory_order_relaxed);
+    }
+}
+
+static void _gnt_pool_destroy(gnt_shard_t* shard)
+{
+    for (uint8_t class = 0; class < GNT_POOL_CLASSES; class++)
+    {
+        gnt_slab_t* slab = shard->pools[class].slabs;
+        
+        while (slab)
+        {
+            gnt_slab_t* next = slab->next;
+            shard->trie->releaser(slab);
+            slab = next;
+        }
+        
+        shard->pools[class] = (gnt_pool_t) {.size = shard->pools[class].size, .bytes = GNT_SLAB_MIN};
+    }
+}
+
+static gnt_nibble_t* _gnt_nibble_alloc(gnt_shard_t* shard, uint8_t capacity)
+{
+    gnt_nibble_t* nibble = _gnt_pool_alloc(shard, GNT_NIBBLE_CLASS(capacity));
+    
+    if (nibble)
+    {
+        nibble->capacity = capacity;
+        nibble->generation = shard->trie->generation;
+        shard->tally.nibbles++;
+        shard->tally.slots += capacity;
+    }
+    
+    return nibble;
+}
+
+static gnt_node_t* _gnt_node_alloc(gnt_shard_t* shard, uint8_t capacity)
+{
+    gnt_node_t* node = _gnt_pool_alloc(shard, GNT_NODE_CLASS(capacity));
+    
+    if (node)
+    {
+        node->capacity = capacity;
+        shard->tally.nodes++;
+        shard->tally.slots += capacity;
+    }
+    
+    return node;
+}
+
+static gnt_nibble_t* _gnt_nibble_resize(gnt_shard_t* shard, gnt_nibble_t* nibble, uint8_t capacity)
+{
+    gnt_nibble_t* resized = _gnt_nibble_alloc(shard, capacity);
+    
+    if (resized)
+    {
+        memcpy(resized, nibble, GNT_NIBBLE_SIZE(GNT_CHILDREN(nibble)));
+        resized->capacity = capacity;
+        _gnt_nibble_free(shard, nibble);
+    }
+    
+    return resized;
+}
+
+static gnt_node_t* _gnt_node_resize(gnt_shard_t* shard, gnt_node_t* node, uint8_t capacity)
+{
+    gnt_node_t* resized = _gnt_node_alloc(shard, capacity);
+    
+    if (resized)
+    {
+        memcpy(resized, node, GNT_NODE_SIZE(GNT_CHILDREN(node)));
+        resized->capacity = capacity;
+        _gnt_node_free(shard, node);
+    }
+    
+    return resized;
+}
+
+static void _gnt_nibble_free(gnt_shard_t* shard, gnt_nibble_t* nibble)
+{
+    shard->tally.nibbles--;
+    shard->tally.slots -= nibble->capacity;
+    _gnt_pool_release(shard, GNT_NIBBLE_CLASS(nibble->capacity), nibble);
+}
+
+static void _gnt_node_free(gnt_shard_t* shard, gnt_node_t* node)
+{
+    shard->tally.nodes--;
+    shard->tally.slots -= node->capacity;
+    _gnt_pool_release(shard, GNT_NODE_CLASS(node->capacity), node);
+}
+
+static gnt_nibble_t** _gnt_nibble_attach(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble)
+{
+    gnt_nibble_t* nibble = _gnt_nibble_alloc(shard, 1);
+    gnt_nibble_t** linked = nibble ? _gnt_nibble_link(shard, slot, high_nibble, nibble) : NULL;
+    
+    if (nibble && !linked)
+    {
+        _gnt_nibble_free(shard, nibble);
+    }
+    
+    return linked;
+}
+
+static gnt_node_t** _gnt_node_attach(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble)
+{
+    gnt_node_t* node = _gnt_node_alloc(shard, 0);
+    gnt_node_t** linked = node ? _gnt_node_link(shard, slot, low_nibble, node) : NULL;
+    
+    if (node && !linked)
+    {
+        _gnt_node_free(shard, node);
+    }
+    
+    return linked;
+}
+
+static gnt_nibble_t** _gnt_nibble_link(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble, gnt_nibble_t* nibble)
+{
+    gnt_node_t* node = *slot;
+    
+    if (GNT_CHILDREN(node) == node->capacity)
+    {
+        gnt_node_t* grown = _gnt_node_resize(shard, node, node->capacity ? node->capacity * 2 : 1);
+        
+        if (!grown)
+        {
+            return NULL;
+        }
+        
+        *slot = node = grown;
+    }
+    
+    gnt_index_t rank = GNT_RANK(node->map, high_nibble);
+    
+    memmove(&node->nibbles[rank + 1], &node->nibbles[rank], (GNT_CHILDREN(node) - rank) * sizeof(gnt_nibble_t*));
+    node->nibbles[rank] = nibble;
+    node->map |= GNT_BIT(high_nibble);
+    
+    return &node->nibbles[rank];
+}
+
+static gnt_node_t** _gnt_node_link(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble, gnt_node_t* node)
+{
+    gnt_nibble_t* nibble = *slot;
+    
+    if (GNT_CHILDREN(nibble) == nibble->capacity)
+    {
+        gnt_nibble_t* grown = _gnt_nibble_resize(shard, nibble, nibble->capacity * 2);
+        
+        if (!grown)
+        {
+            return NULL;
+        }
+        
+        *slot = nibble = grown;
+    }
+    
+    gnt_index_t rank = GNT_RANK(nibble->map, low_nibble);
+    
+    memmove(&nibble->nodes[rank + 1], &nibble->nodes[rank], (GNT_CHILDREN(nibble) - rank) * sizeof(gnt_node_t*));
+    nibble->nodes[rank] = node;
+    nibble->map |= GNT_BIT(low_nibble);
+    
+    return &nibble->nodes[rank];
+}
+
+static void _gnt_nibble_detach(gnt_shard_t* shard, gnt_node_t** slot, gnt_byte_t high_nibble)
+{
+    gnt_node_t* node = *slot;
+    gnt_index_t rank = GNT_RANK(node->map, high_nibble);
+    
+    node->map &= ~GNT_BIT(high_nibble);
+    memmove(&node->nibbles[rank], &node->nibbles[rank + 1], (GNT_CHILDREN(node) - rank) * sizeof(gnt_nibble_t*));
+    
+    // Shrink once a quarter of the slots or less are in use, leaves keep no slots at all
+    if (!GNT_CHILDREN(node) || GNT_CHILDREN(node) * 4 <= node->capacity)
+    {
+        gnt_node_t* shrunk = _gnt_node_resize(shard, node, GNT_CHILDREN(node) ? node->capacity / 2 : 0);
+        
+        if (shrunk)
+        {
+            *slot = shrunk;
+        }
+    }
+}
+
+static void _gnt_node_detach(gnt_shard_t* shard, gnt_nibble_t** slot, gnt_byte_t low_nibble)
+{
+    gnt_nibble_t* nibble = *slot;
+    gnt_index_t rank = GNT_RANK(nibble->map, low_nibble);
+    
+    nibble->map &= ~GNT_BIT(low_nibble);
+    memmove(&nibble->nodes[rank], &nibble->nodes[rank + 1], (GNT_CHILDREN(nibble) - rank) * sizeof(gnt_node_t*));
+    
+    // Empty nibbles are released by the caller
+    if (GNT_CHILDREN(nibble) && GNT_CHILDREN(nibble) * 4 <= nibble->capacity)
+    {
+        gnt_nibble_t* shrunk = _gnt_nibble_resize(shard, nibble, nibble->capacity / 2);
+        
+        if (shrunk)
+        {
+            *slot = shrunk;
+        }
+    }
+}
+
+static gnt_node_t* _gnt_split(gnt_shard_t* shard, gnt_node_t** slot, uint8_t length)
+{
+    gnt_node_t* node = *slot;
+    gnt_node_t* parent = _gnt_node_alloc(shard, 1);
+    gnt_nibble_t* nibble = _gnt_nibble_alloc(shard, 1);
+    
+    if (!parent || !nibble)
+    {
+        if (parent) _gnt_node_free(shard, parent);
+        if (nibble) _gnt_nibble_free(shard, nibble);
+        return NULL;
+    }
+    
+    // The parent keeps the matching part of the prefix, the node keeps what follows the diverging byte
+    gnt_byte_t byte = node->prefix[length];
+    
+    memcpy(parent->prefix, node->prefix, length);
+    parent->length = length;
+    memmove(node->prefix, node->prefix + length + 1, node->length - length - 1);
+    node->length -= length + 1;
+    
+    nibble->nodes[0] = node;
+    nibble->map = GNT_BIT(GNT_LOW_NIBBLE(byte));
+    parent->nibbles[0] = nibble;
+    parent->map = GNT_BIT(GNT_HIGH_NIBBLE(byte));
+    
+    *slot = parent;
+    return parent;
+}
+
+static void _gnt_merge(gnt_shard_t* shard, gnt_node_t** slot)
+{
+    gnt_node_t* node = *slot;
+    gnt_nibble_t* nibble = node->nibbles[0];
+    
+    if (1 != GNT_CHILDREN(nibble) || node->length + 1 + nibble->nodes[0]->length > GNT_PREFIX_SIZE)
+    {
+        return;
+    }
+    
+    // The child is rewritten, so open snapshots keep the original
+    if (!(nibble = _gnt_own(shard, &node->nibbles[0])))
+    {
+        return;
+    }
+    
+    gnt_node_t* child = nibble->nodes[0];
+    
+    // The child absorbs the node's prefix and the byte leading to it, then takes its place
+    memmove(child->prefix + node->length + 1, child->prefix, child->length);
+    memcpy(child->prefix, node->prefix, node->length);
+    child->prefix[node->length] = GNT_MAKE_BYTE(GNT_FIRST(node->map), GNT_FIRST(nibble->map));
+    child->length += node->length + 1;
+    
+    *slot = child;
+    _gnt_nibble_free(shard, nibble);
+    _gnt_node_free(shard, node);
+}
+
+static gnt_status_t _gnt_write_all(int fd, const char* bytes, size_t size)
+{
+    for (size_t written = 0; written < size;)
+    {
+        ssize_t chunk = write(fd, bytes + written, size - written);
+        
+        if (chunk < 0 && EINTR != errno)
+        {
+            return -1;
+        }
+        else if (chunk > 0)
+        {
+            written += chunk;
+        }
+    }
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_journal_open(gnt_trie_t* trie, gnt_cfg_t* cfg, off_t end)
+{
+    gnt_journal_t* journal = trie->allocator(sizeof(gnt_journal_t));
+    struct stat info;
+    
+    if (!journal)
+    {
+        return -1;
+    }
+    
+    *journal = (gnt_journal_t) {.sync_bytes = cfg->journal_bytes, .sync_ns = (uint64_t) cfg->journal_ms * 1000000u};
+    
+    if (!GNT_MUTEX_CREATE(journal))
+    {
+        trie->releaser(journal);
+        return -1;
+    }
+    
+    journal->fd = open(cfg->journal, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    
+    // A new trie refuses a log that still holds records, a recovered one cuts off what a crash left torn
+    gnt_status_t status = journal->fd >= 0 && 0 == fstat(journal->fd, &info) && (end ? 0 == ftruncate(journal->fd, end) : info.st_size <= GNT_JOURNAL_HEADER) ? 0 : -1;
+    
+    if (0 == status && end <= GNT_JOURNAL_HEADER)
+    {
+        status = _gnt_journal_reset(journal);
+    }
+    
+    if (0 != status)
+    {
+        if (journal->fd >= 0) close(journal->fd);
+        GLL_MUTEX_DESTROY(journal);
+        trie->releaser(journal);
+        return -1;
+    }
+    
+    journal->synced = _gnt_journal_clock();
+    trie->journal = journal;
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_journal_reset(gnt_journal_t* journal)
+{
+    char header[GNT_JOURNAL_HEADER];
+    uint32_t order = GNT_IMAGE_ORDER;
+    
+    memcpy(header, GNT_JOURNAL_MAGIC, 4);
+    memcpy(header + 4, &order, sizeof(order));
+    
+    journal->size = 0;
+    journal->status = 0 == ftruncate(journal->fd, 0) && 0 == _gnt_write_all(journal->fd, header, sizeof(header)) && 0 == fdatasync(journal->fd) ? 0 : -1;
+    journal->synced = _gnt_journal_clock();
+    
+    return journal->status;
+}
+
+static gnt_status_t _gnt_journal_append(gnt_trie_t* trie, uint8_t kind, const gnt_byte_t* bytes, gnt_index_t length, gnt_data_t data)
+{
+    gnt_journal_t* journal = trie->journal;
+    uint32_t key_length = (uint32_t) length;
+    size_t size = 1 + sizeof(uint32_t) + length + (GNT_JOURNAL_INSERT == kind ? sizeof(gnt_data_t) : 0) + sizeof(uint32_t);
+    
+    mtx_lock(&journal->mutex);
+    
+    if (length > UINT32_MAX)
+    {
+        journal->status = -1;
+    }
+    
+    if (0 == journal->status && journal->size + size > journal->capacity)
+    {
+        size_t capacity = journal->capacity ? journal->capacity : GNT_SLAB_MIN;
+        
+        while (capacity < journal->size + size)
+        {
+            capacity *= 2;
+        }
+        
+        char* buffer = trie->allocator(capacity);
+        
+        // A record missing from the log would make every later one replay over the wrong state
+        if (!buffer)
+        {
+            journal->status = -1;
+        }
+        else
+        {
+            if (journal->buffer)
+            {
+                memcpy(buffer, journal->buffer, journal->size);
+                trie->releaser(journal->buffer);
+            }
+            
+            journal->buffer = buffer;
+            journal->capacity = capacity;
+        }
+    }
+    
+    if (0 == journal->status)
+    {
+        char* record = journal->buffer + journal->size;
+        
+        record[0] = (char) kind;
+        memcpy(record + 1, &key_length, sizeof(uint32_t));
+        
+        if (length)
+        {
+            memcpy(record + 1 + sizeof(uint32_t), bytes, length);
+        }
+        
+        if (GNT_JOURNAL_INSERT == kind)
+        {
+            memcpy(record + 1 + sizeof(uint32_t) + length, &data, sizeof(gnt_data_t));
+        }
+        
+        uint32_t checksum = _gnt_checksum(record, size - sizeof(uint32_t));
+        memcpy(record + size - sizeof(uint32_t), &checksum, sizeof(uint32_t));
+        journal->size += size;
+        
+        // Records buffered since the last sync share the next one, which comes once enough bytes or time piled up
+        if ((!journal->sync_bytes && !journal->sync_ns) || (journal->sync_bytes && journal->size >= journal->sync_bytes)
+            || (journal->sync_ns && _gnt_journal_clock() - journal->synced >= journal->sync_ns))
+        {
+            _gnt_journal_flush(journal);
+        }
+    }
+    
+    gnt_status_t status = journal->status;
+    
+    mtx_unlock(&journal->mutex);
+    
+    return status;
+}
+
+static gnt_status_t _gnt_journal_flush(gnt_journal_t* journal)
+{
+    if (0 == journal->status && journal->size)
+    {
+        journal->status = 0 == _gnt_write_all(journal->fd, journal->buffer, journal->size) && 0 == fdatasync(journal->fd) ? 0 : -1;
+        journal->size = 0;
+    }
+    
+    journal->synced = _gnt_journal_clock();
+    
+    return journal->status;
+}
+
+static gnt_status_t _gnt_journal_close(gnt_trie_t* trie)
+{
+    gnt_journal_t* journal = trie->journal;
+    gnt_status_t status = _gnt_journal_flush(journal);
+    
+    if (0 != close(journal->fd))
+    {
+        status = -1;
+    }
+    
+    if (journal->buffer)
+    {
+        trie->releaser(journal->buffer);
+    }
+    
+    GLL_MUTEX_DESTROY(journal);
+    trie->releaser(journal);
+    trie->journal = NULL;
+    
+    return status;
+}
+
+static gnt_status_t _gnt_journal_replay(gnt_trie_t* trie, const char* path, off_t* end)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    
+    *end = 0;
+    
+    if (fd < 0)
+    {
+        return ENOENT == errno ? 0 : -1;
+    }
+    
+    if (0 != fstat(fd, &info))
+    {
+        close(fd);
+        return -1;
+    }
+    
+    // A log shorter than its header was cut while being created and holds nothing
+    if ((size_t) info.st_size < GNT_JOURNAL_HEADER)
+    {
+        close(fd);
+        return 0;
+    }
+    
+    size_t size = info.st_size;
+    const char* log = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    
+    if (MAP_FAILED == log)
+    {
+        return -1;
+    }
+    
+    uint32_t order;
+    memcpy(&order, log + 4, sizeof(order));
+    
+    if (0 != memcmp(log, GNT_JOURNAL_MAGIC, 4) || GNT_IMAGE_ORDER != order)
+    {
+        munmap((void*) log, size);
+        return -1;
+    }
+    
+    size_t offset = GNT_JOURNAL_HEADER;
+    gnt_status_t status = 0;
+    
+    // The first record cut short or damaged by a crash ends the log
+    while (0 == status && size - offset >= 1 + 2 * sizeof(uint32_t))
+    {
+        const char* record = log + offset;
+        uint8_t kind = (uint8_t) record[0];
+        uint32_t length;
+        uint32_t checksum;
+        
+        memcpy(&length, record + 1, sizeof(uint32_t));
+        
+        size_t bytes = 1 + sizeof(uint32_t) + (size_t) length + (GNT_JOURNAL_INSERT == kind ? sizeof(gnt_data_t) : 0) + sizeof(uint32_t);
+        
+        if (kind < GNT_JOURNAL_INSERT || kind > GNT_JOURNAL_CLEAR || bytes > size - offset)
+        {
+            break;
+        }
+        
+        memcpy(&checksum, record + bytes - sizeof(uint32_t), sizeof(uint32_t));
+        
+        if (checksum != _gnt_checksum(record, bytes - sizeof(uint32_t)))
+        {
+            break;
+        }
+        
+        const gnt_byte_t* key = (const gnt_byte_t*) record + 1 + sizeof(uint32_t);
+        
+        if (GNT_JOURNAL_INSERT == kind)
+        {
+            gnt_data_t data;
+            memcpy(&data, key + length, sizeof(gnt_data_t));
+            status = gnt_insert_bytes(trie, key, length, data);
+        }
+        else if (GNT_JOURNAL_DELETE == kind)
+        {
+            gnt_delete_bytes(trie, key, length); // Already gone when the log is replayed over a checkpoint that has it
+        }
+        else
+        {
+            status = gnt_clear(trie);
+        }
+        
+        offset += bytes;
+    }
+    
+    munmap((void*) log, size);
+    *end = offset;
+    
+    return status;
+}
+
+static gnt_status_t _gnt_restore(gnt_trie_t* trie, gnt_trie_t* image, gnt_node_t* parent, gnt_byte_t** key, size_t* capacity, size_t depth)
+{
+    if (parent && parent->occupied && 0 != gnt_insert_bytes(trie, *key, depth, parent->data))
+    {
+        return -1;
+    }
+    
+    for (gnt_byte_t high_nibble = 0; high_nibble < 16; high_nibble++)
+    {
+        gnt_nibble_t* nibble = _gnt_nibble_get(image, parent, high_nibble);
+        
+        if (!nibble)
+        {
+            continue;
+        }
+        
+        for (uint16_t map = nibble->map; map; map &= map - 1)
+        {
+            gnt_node_t* node = _gnt_node_get(image, nibble, GNT_FIRST(map));
+            size_t length = depth + 1 + node->length;
+            
+            // Unlike cursors, restoring has no bound on the key length
+            if (length > *capacity)
+            {
+                gnt_byte_t* grown = trie->allocator(2 * length);
+                
+                if (!grown)
+                {
+                    return -1;
+                }
+                
+                memcpy(grown, *key, depth);
+                trie->releaser(*key);
+                *key = grown;
+                *capacity = 2 * length;
+            }
+            
+            (*key)[depth] = GNT_MAKE_BYTE(high_nibble, GNT_FIRST(map));
+            memcpy(*key + depth + 1, node->prefix, node->length);
+            
+            if (0 != _gnt_restore(trie, image, node, key, capacity, length))
+            {
+                return -1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static gnt_status_t _gnt_sync_directory(gnt_trie_t* trie, const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    size_t length = slash ? (size_t) (slash - path) + 1 : 1;
+    char* directory = trie->allocator(length + 1);
+    
+    if (!directory)
+    {
+        return -1;
+    }
+    
+    memcpy(directory, slash ? path : ".", length);
+    directory[length] = '\0';
+    
+    // Makes the rename itself durable
+    int fd = open(directory, O_RDONLY);
+    trie->releaser(directory);
+    
+    gnt_status_t status = fd >= 0 && 0 == fsync(fd) ? 0 : -1;
+    
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    
+    return status;
+}
+
+#ifdef GNT_INSTRUMENT
+static int _gnt_probe_lock(gnt_trie_t* trie, mtx_t* mutex)
+{
+    GNT_PROBE_ACQUIRE(trie);
+    
+    // Only acquisitions that find the mutex taken pay for reading the clock
+    if (thrd_success == mtx_trylock(mutex))
+    {
+        return thrd_success;
+    }
+    
+    GNT_PROBE_WAIT_BEGIN();
+    int status = mtx_lock(mutex);
+    GNT_PROBE_WAIT_END(trie);
+    
+    return status;
+}
+
+static void _gnt_probe_contended(gnt_trie_t* trie, uint64_t start)
+{
+    uint64_t waited = _gnt_probe_clock() - start;
+    
+    _gnt_probe.waited += waited;
+    atomic_fetch_add_explicit(&trie->probe.contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&trie->probe.wait_ns, waited, memory_order_relaxed);
+}
+
+static void _gnt_probe_end(gnt_trie_t* trie, gnt_op_t op, uint64_t start)
+{
+    gnt_probe_t* probe = &trie->probe;
+    uint64_t nanoseconds = _gnt_probe_clock() - start;
+    uint8_t bucket = 63 - __builtin_clzll(nanoseconds | 1);
+    
+    atomic_fetch_add_explicit(&probe->operations[op], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&probe->latency[op][bucket < GNT_LATENCY_BUCKETS ? bucket : GNT_LATENCY_BUCKETS - 1], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&probe->levels[op], _gnt_probe.levels, memory_order_relaxed);
+    atomic_fetch_add_explicit(&probe->allocations[op], _gnt_probe.allocations, memory_order_relaxed);
+    
+    if (trie->observer)
+    {
+        gnt_sample_t sample = {op, nanoseconds, _gnt_probe.waited, _gnt_probe.levels, _gnt_probe.allocations};
+        trie->observer(trie, &sample);
+    }
 }
+#endif
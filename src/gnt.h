@@ -27,26 +27,149 @@
 #ifndef GNT_H
 #define GNT_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define	GNT_FORCE_INLINE inline __attribute__((always_inline))
 
 typedef struct gnt_trie gnt_trie_t;
+typedef struct gnt_sample gnt_sample_t;
+typedef struct gnt_replicas gnt_replicas_t;
 typedef uintptr_t gnt_key_t;
 typedef uintptr_t gnt_data_t;
 typedef int8_t gnt_status_t;
 typedef uint8_t gnt_byte_t;
 typedef size_t gnt_index_t;
+typedef uint32_t gnt_flags_t;
 
 typedef gnt_status_t (*gnt_accessor_t)(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index);
+typedef gnt_status_t (*gnt_span_accessor_t)(const gnt_byte_t** bytes, gnt_index_t* length, gnt_key_t key);
 typedef void (*gnt_deallocator_t)(gnt_data_t data);
+typedef void* (*gnt_allocator_t)(size_t size);
+typedef void (*gnt_releaser_t)(void* memory);
+typedef void (*gnt_observer_t)(gnt_trie_t* trie, const gnt_sample_t* sample);
+
+#define GNT_FLAG_COMPRESS     (1u << 0) // Collapses single-child chains into stored prefixes
+#define GNT_FLAG_RWLOCK       (1u << 1) // Lets searches run concurrently, writers still serialize
+#define GNT_FLAG_SHARDED      (1u << 2) // Gives each of the 16 root subtries its own lock and pools
+#define GNT_FLAG_FIXED_WIDTH  (1u << 3) // Stores integer keys on their full width, big-endian, so that key order is numeric order
+#define GNT_FLAG_WIDE_ROOT    (1u << 4) // Reaches the nodes below the first key byte through a 256-way table, saving a level on lookups
+#define GNT_FLAG_LAZY_DELETE  (1u << 5) // Deletes only empty the key, gnt_compact releases the branches left behind
+#define GNT_FLAG_FREE_THREADS (1u << 6) // Releases the data of each root subtrie on its own thread on destroy and clear, the deallocator must be thread-safe
+#define GNT_FLAG_COMBINING    (1u << 7) // Hands inserts and deletes that find their shard busy to the writer holding it, which applies them in key order
 
 typedef struct gnt_cfg
 {
     gnt_accessor_t accessor;
+    gnt_span_accessor_t span_accessor; // Returns the whole key at once, takes precedence over accessor
     gnt_deallocator_t deallocator;
+    gnt_allocator_t allocator; // Backs the trie and its node slabs, used only along with releaser
+    gnt_releaser_t releaser;
+    gnt_flags_t flags;
+    gnt_observer_t observer; // Called at the end of every insert, search and delete, only when built with GNT_INSTRUMENT
+    const char* journal; // Path of the log every write is appended to, none when NULL
+    size_t journal_bytes; // Bytes of records buffered before the log is synced
+    uint32_t journal_ms; // Milliseconds a record may stay buffered, the log is synced on every write when both are 0
+    size_t budget; // Bytes of nibbles and nodes kept, keys not searched lately are evicted past it, no bound when 0
 } gnt_cfg_t;
 
+typedef struct gnt_replicas_cfg
+{
+    uint32_t nodes; // Replicas kept, the calling thread reads the one of its NUMA node modulo this count
+    gnt_allocator_t* allocators; // One per replica, bound to its node, replicas are placed by the first thread reading them when NULL
+    gnt_releaser_t releaser; // Frees the memory of every allocator, used only along with allocators
+    uint32_t lag_ms; // Milliseconds between two refreshes of a replica, each read after a write refreshes it when 0
+} gnt_replicas_cfg_t;
+
+typedef struct gnt_pin // Replica read by the calling thread, taken by gnt_replicas_enter and given back by gnt_replicas_exit
+{
+    gnt_trie_t* trie; // Local replica, or the source trie while none is built
+    void* replica;
+    unsigned side;
+} gnt_pin_t;
+
+#ifndef GNT_CURSOR_KEY_MAX
+#define GNT_CURSOR_KEY_MAX 256 // Longest key a cursor can hold, longer keys are skipped by iteration
+#endif
+
+typedef struct gnt_cursor // Position in the ordered keys of a trie, needs no allocation
+{
+    gnt_trie_t* trie;
+    bool positioned; // Cleared past either end, next then starts over from the first key and prev from the last
+    gnt_index_t length;
+    gnt_data_t data;
+    gnt_byte_t key[GNT_CURSOR_KEY_MAX];
+} gnt_cursor_t;
+
+#ifndef GNT_HINT_DEPTH
+#define GNT_HINT_DEPTH 32 // Most key bytes and nodes a hint remembers, descents past them start over from the root
+#endif
+
+struct gnt_node;
+
+typedef struct gnt_hint // Path to the last key reached through it, held by the caller and never shared between threads
+{
+    gnt_trie_t* trie;
+    uint64_t epoch; // Changes of the shard seen when the path was taken, any allocation since voids it
+    bool written; // Taken by an insert, which copied any node still shared with a snapshot
+    uint8_t depth;
+    gnt_index_t length;
+    gnt_byte_t key[GNT_HINT_DEPTH];
+    gnt_index_t indexes[GNT_HINT_DEPTH];
+    struct gnt_node** slots[GNT_HINT_DEPTH];
+} gnt_hint_t;
+
+typedef struct gnt_stats
+{
+    size_t nibbles; // Live nibble objects
+    size_t nodes; // Live node objects
+    size_t values; // Keys stored
+    size_t bytes; // Memory held by the trie, including slab space not handed out yet
+    size_t live; // Bytes of nibbles and nodes handed out, the memory a budget bounds
+    size_t wasted; // Bytes of child slots allocated but unused
+    double average_depth; // Mean key length in bytes
+    size_t max_depth; // Longest key in bytes, shape only
+    size_t nibble_fanout[17]; // Nibbles by number of nodes, shape only
+    size_t node_fanout[17]; // Nodes by number of nibbles, shape only
+} gnt_stats_t;
+
+#define GNT_LATENCY_BUCKETS 32 // Bucket i counts operations that took from 2^i to 2^(i+1) nanoseconds
+
+typedef enum gnt_op
+{
+    GNT_OP_INSERT,
+    GNT_OP_SEARCH,
+    GNT_OP_DELETE,
+    GNT_OPS
+} gnt_op_t;
+
+typedef struct gnt_sample // Measures of a single operation, handed to the observer
+{
+    gnt_op_t op;
+    uint64_t nanoseconds; // Time spent in the operation, lock waits included
+    uint64_t waited; // Nanoseconds spent waiting on contended locks
+    size_t levels; // Nodes visited
+    size_t allocations; // Nibbles and nodes allocated
+} gnt_sample_t;
+
+typedef struct gnt_metrics // Totals gathered since the trie was created, only when built with GNT_INSTRUMENT
+{
+    size_t locks; // Lock acquisitions
+    size_t contended; // Acquisitions that had to wait for another thread
+    uint64_t wait_ns; // Total time spent waiting on contended locks
+    size_t operations[GNT_OPS];
+    size_t latency[GNT_OPS][GNT_LATENCY_BUCKETS];
+    size_t levels[GNT_OPS]; // Nodes visited by all operations of each kind
+    size_t allocations[GNT_OPS]; // Nibbles and nodes allocated by all operations of each kind
+} gnt_metrics_t;
+
+typedef void (*gnt_updater_t)(gnt_data_t* data, bool found, void* context);
+typedef gnt_status_t (*gnt_visitor_t)(const gnt_byte_t* key, gnt_index_t length, gnt_data_t data, void* context);
+typedef gnt_status_t (*gnt_mapper_t)(const gnt_byte_t* key, gnt_index_t length, gnt_data_t* data, void* context);
+typedef void (*gnt_reducer_t)(void* result, void* partial);
+typedef gnt_data_t (*gnt_conflict_t)(const gnt_byte_t* key, gnt_index_t length, gnt_data_t kept, gnt_data_t incoming, void* context);
+
 // Conversion functions for various types to gnt_data_t
 static GNT_FORCE_INLINE gnt_data_t _gnt_int8_to_data(int8_t data) {return (gnt_data_t) data;}
 static GNT_FORCE_INLINE gnt_data_t _gnt_int16_to_data(int16_t data) {return (gnt_data_t) data;}
@@ -80,6 +203,53 @@ static GNT_FORCE_INLINE gnt_data_t _gnt_voidptr_to_data(void* data) {return (gnt
 #define GNT_FLOAT(data)         (*(float*) &data)
 #define GNT_DOUBLE(data)        (*(double*) &data)
 
+// Order-preserving conversions for signed and floating-point keys, numeric along with GNT_FLAG_FIXED_WIDTH
+static GNT_FORCE_INLINE gnt_key_t _gnt_int64_to_ordered(int64_t key) {return (gnt_key_t) ((uint64_t) key ^ (UINT64_C(1) << 63));}
+static GNT_FORCE_INLINE gnt_key_t _gnt_uint64_to_ordered(uint64_t key) {return (gnt_key_t) key;}
+static GNT_FORCE_INLINE gnt_key_t _gnt_double_to_ordered(double key)
+{
+    union {double value; uint64_t bits;} cast = {key};
+    return (gnt_key_t) (cast.bits >> 63 ? ~cast.bits : cast.bits | (UINT64_C(1) << 63));
+}
+static GNT_FORCE_INLINE int64_t _gnt_ordered_to_int64(gnt_key_t key) {return (int64_t) ((uint64_t) key ^ (UINT64_C(1) << 63));}
+static GNT_FORCE_INLINE double _gnt_ordered_to_double(gnt_key_t key)
+{
+    union {uint64_t bits; double value;} cast = {(uint64_t) key >> 63 ? (uint64_t) key & ~(UINT64_C(1) << 63) : ~(uint64_t) key};
+    return cast.value;
+}
+
+#define GNT_ORDERED_KEY(key)    _Generic((key), \
+        int8_t: _gnt_int64_to_ordered,          \
+        int16_t: _gnt_int64_to_ordered,         \
+        int32_t: _gnt_int64_to_ordered,         \
+        int64_t: _gnt_int64_to_ordered,         \
+        float: _gnt_double_to_ordered,          \
+        double: _gnt_double_to_ordered,         \
+        default: _gnt_uint64_to_ordered         \
+        )(key)
+
+#define GNT_ORDERED_INT(key)    (_gnt_ordered_to_int64(key))
+#define GNT_ORDERED_DOUBLE(key) (_gnt_ordered_to_double(key))
+
+/**
+ * @brief Rebuilds an integer key from the bytes reported by a cursor or a range.
+ * 
+ * @param bytes The big-endian bytes of the key.
+ * @param length The number of bytes, at most sizeof(gnt_key_t).
+ * @return The key.
+ */
+static inline gnt_key_t gnt_bytes_to_key(const gnt_byte_t* bytes, gnt_index_t length)
+{
+    gnt_key_t key = 0;
+    
+    for (gnt_index_t i = 0; i < length; i++)
+    {
+        key = (key << 8) | bytes[i];
+    }
+    
+    return key;
+}
+
 /**
  * @brief Creates a new nibble trie.
  * 
@@ -91,11 +261,21 @@ gnt_trie_t* gnt_create(gnt_cfg_t* cfg);
 /**
  * @brief Destroys the entire trie and frees all allocated memory.
  * 
+ * A trie with open snapshots can't be destroyed, destroying a snapshot closes it.
+ * 
  * @param trie The trie to destroy.
  * @return 0 on success, -1 on failure.
  */
 gnt_status_t gnt_destroy(gnt_trie_t* trie);
 
+/**
+ * @brief Removes every key from the trie and releases its nodes, leaving it ready for reuse.
+ * 
+ * @param trie The trie to clear, mapped, frozen and snapshot tries or tries with open snapshots can't be cleared.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_clear(gnt_trie_t* trie);
+
 /**
  * @brief Inserts data in the trie and associates it to a key.
  * 
@@ -115,15 +295,645 @@ gnt_status_t gnt_insert(gnt_trie_t* trie, gnt_key_t key, gnt_data_t data);
  */
 gnt_data_t gnt_search(gnt_trie_t* trie, gnt_key_t key);
 
+/**
+ * @brief Searches the data associated to a key and reports whether it was found.
+ * 
+ * @param trie The trie to search.
+ * @param key The key associated to the data.
+ * @param found Optionally receives whether the key is stored, which tells a stored 0 from a missing key, can be NULL.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_search_ex(gnt_trie_t* trie, gnt_key_t key, bool* found);
+
+/**
+ * @brief Inserts or modifies the data associated to a key in a single traversal.
+ * 
+ * The updater runs under the trie's lock with the stored data, or 0 if the key is new, and modifies it in place.
+ * The deallocator isn't called on the previous data.
+ * 
+ * @param trie The trie to update.
+ * @param key The key associated to the data.
+ * @param updater Called once with the data of the key and whether it was already stored.
+ * @param context Passed to the updater.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_update(gnt_trie_t* trie, gnt_key_t key, gnt_updater_t updater, void* context);
+
 /**
  * @brief Deletes the data associated to a key.
  * 
  * @param trie The trie to delete the data from.
  * @param key The key associated to the data.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success, -1 on failure or if the key isn't found.
  */
 gnt_status_t gnt_delete(gnt_trie_t* trie, gnt_key_t key);
 
+/**
+ * @brief Inserts data in the trie and associates it to a key given as raw bytes.
+ * 
+ * @param trie The trie to insert the data into.
+ * @param bytes The bytes of the key, which may contain zeros.
+ * @param length The number of bytes in the key.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_insert_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_data_t data);
+
+/**
+ * @brief Searches and returns the data associated to a key given as raw bytes.
+ * 
+ * @param trie The trie to search.
+ * @param bytes The bytes of the key, which may contain zeros.
+ * @param length The number of bytes in the key.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_search_bytes(gnt_trie_t* trie, const void* bytes, size_t length);
+
+/**
+ * @brief Deletes the data associated to a key given as raw bytes.
+ * 
+ * @param trie The trie to delete the data from.
+ * @param bytes The bytes of the key, which may contain zeros.
+ * @param length The number of bytes in the key.
+ * @return 0 on success, -1 on failure or if the key isn't found.
+ */
+gnt_status_t gnt_delete_bytes(gnt_trie_t* trie, const void* bytes, size_t length);
+
+/**
+ * @brief Releases the nodes left behind by lazy deletes.
+ * 
+ * With GNT_FLAG_LAZY_DELETE, deleted keys are queued and their branches are only pruned here, in batches.
+ * 
+ * @param trie The trie to compact.
+ * @param budget The most deleted keys to prune in this call, 0 to prune them all.
+ * @return 0 once nothing is left to prune, 1 when the budget ran out first, -1 on failure.
+ */
+gnt_status_t gnt_compact(gnt_trie_t* trie, size_t budget);
+
+/**
+ * @brief Inserts data in the trie and associates it to a 32-bit integer key.
+ * 
+ * @param trie The trie to insert the data into.
+ * @param key The key to associate the data to.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_insert_u32(gnt_trie_t* trie, uint32_t key, gnt_data_t data);
+
+/**
+ * @brief Searches and returns the data associated to a 32-bit integer key.
+ * 
+ * @param trie The trie to search.
+ * @param key The key associated to the data.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_search_u32(gnt_trie_t* trie, uint32_t key);
+
+/**
+ * @brief Deletes the data associated to a 32-bit integer key.
+ * 
+ * @param trie The trie to delete the data from.
+ * @param key The key associated to the data.
+ * @return 0 on success, -1 on failure or if the key isn't found.
+ */
+gnt_status_t gnt_delete_u32(gnt_trie_t* trie, uint32_t key);
+
+/**
+ * @brief Inserts data in the trie and associates it to a 64-bit integer key.
+ * 
+ * @param trie The trie to insert the data into.
+ * @param key The key to associate the data to.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_insert_u64(gnt_trie_t* trie, uint64_t key, gnt_data_t data);
+
+/**
+ * @brief Searches and returns the data associated to a 64-bit integer key.
+ * 
+ * @param trie The trie to search.
+ * @param key The key associated to the data.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_search_u64(gnt_trie_t* trie, uint64_t key);
+
+/**
+ * @brief Deletes the data associated to a 64-bit integer key.
+ * 
+ * @param trie The trie to delete the data from.
+ * @param key The key associated to the data.
+ * @return 0 on success, -1 on failure or if the key isn't found.
+ */
+gnt_status_t gnt_delete_u64(gnt_trie_t* trie, uint64_t key);
+
+/**
+ * @brief Prepares a hint to resume descents into a trie from the nodes shared with the previous key.
+ * 
+ * Keys inserted or searched through a hint in about increasing order skip the levels they share with their
+ * predecessor. A hint stays valid across any other operation on the trie, it only starts over from the root
+ * once nodes were allocated or released in the subtrie it points into. Integer keys share their leading bytes
+ * only with GNT_FLAG_FIXED_WIDTH.
+ * 
+ * @param hint The hint to prepare.
+ * @param trie The trie the hint is used on.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_hint_init(gnt_hint_t* hint, gnt_trie_t* trie);
+
+/**
+ * @brief Inserts data associated to a key through a hint.
+ * 
+ * @param hint The hint to the trie to insert the data into.
+ * @param key The key to associate the data to.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_hint_insert(gnt_hint_t* hint, gnt_key_t key, gnt_data_t data);
+
+/**
+ * @brief Searches and returns the data associated to a key through a hint.
+ * 
+ * @param hint The hint to the trie to search.
+ * @param key The key associated to the data.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_hint_search(gnt_hint_t* hint, gnt_key_t key);
+
+/**
+ * @brief Inserts data through a hint and associates it to a key given as raw bytes.
+ * 
+ * @param hint The hint to the trie to insert the data into.
+ * @param bytes The key bytes.
+ * @param length The number of key bytes.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_hint_insert_bytes(gnt_hint_t* hint, const void* bytes, size_t length, gnt_data_t data);
+
+/**
+ * @brief Searches through a hint and returns the data associated to a key given as raw bytes.
+ * 
+ * @param hint The hint to the trie to search.
+ * @param bytes The key bytes.
+ * @param length The number of key bytes.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_hint_search_bytes(gnt_hint_t* hint, const void* bytes, size_t length);
+
+/**
+ * @brief Inserts data associated to a 64-bit integer key through a hint.
+ * 
+ * @param hint The hint to the trie to insert the data into.
+ * @param key The key to associate the data to.
+ * @param data The data to insert.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_hint_insert_u64(gnt_hint_t* hint, uint64_t key, gnt_data_t data);
+
+/**
+ * @brief Searches and returns the data associated to a 64-bit integer key through a hint.
+ * 
+ * @param hint The hint to the trie to search.
+ * @param key The key associated to the data.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_hint_search_u64(gnt_hint_t* hint, uint64_t key);
+
+/**
+ * @brief Inserts many keys at once, resuming each insertion from the nodes shared with the previous key.
+ * 
+ * Keys sorted in byte order share the longest prefixes with their predecessor and load fastest, unsorted keys
+ * are still accepted.
+ * 
+ * @param trie The trie to load the data into.
+ * @param keys The keys to associate the data to.
+ * @param data The data to insert, one per key.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_bulk_load(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count);
+
+/**
+ * @brief Same as gnt_bulk_load, loading each of the 16 root subtries on its own thread.
+ * 
+ * Requires a trie created with GNT_FLAG_SHARDED and sorted keys, otherwise falls back to gnt_bulk_load.
+ * 
+ * @param trie The trie to load the data into.
+ * @param keys The keys to associate the data to.
+ * @param data The data to insert, one per key.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_bulk_load_parallel(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count);
+
+/**
+ * @brief Inserts a batch of data in the trie while holding its locks once.
+ * 
+ * @param trie The trie to insert the data into.
+ * @param keys The keys to associate the data with.
+ * @param data The data to insert, one per key.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure. Keys before the failing one are inserted.
+ */
+gnt_status_t gnt_insert_batch(gnt_trie_t* trie, const gnt_key_t* keys, const gnt_data_t* data, size_t count);
+
+/**
+ * @brief Searches a batch of keys, walking several of them in lockstep to overlap their cache misses.
+ * 
+ * @param trie The trie to search.
+ * @param keys The keys to search.
+ * @param data Receives the data of each key, or 0 if it isn't found.
+ * @param found Optionally receives whether each key is present, can be NULL.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure. Keys before the first one that fails to load are searched, the others are left untouched.
+ */
+gnt_status_t gnt_search_batch(gnt_trie_t* trie, const gnt_key_t* keys, gnt_data_t* data, bool* found, size_t count);
+
+/**
+ * @brief Searches a batch of 32-bit integer keys, walking them in groups whose nibbles are extracted with vector operations.
+ * 
+ * @param trie The trie to search.
+ * @param keys The keys to search, encoded as by gnt_insert_u32.
+ * @param data Receives the data of each key, or 0 if it isn't found.
+ * @param found Optionally receives a mask with bit i % 64 of word i / 64 set when key i is present, can be NULL.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_search_batch_u32(gnt_trie_t* trie, const uint32_t* keys, gnt_data_t* data, uint64_t* found, size_t count);
+
+/**
+ * @brief Searches a batch of 64-bit integer keys, walking them in groups whose nibbles are extracted with vector operations.
+ * 
+ * @param trie The trie to search.
+ * @param keys The keys to search, encoded as by gnt_insert_u64.
+ * @param data Receives the data of each key, or 0 if it isn't found.
+ * @param found Optionally receives a mask with bit i % 64 of word i / 64 set when key i is present, can be NULL.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_search_batch_u64(gnt_trie_t* trie, const uint64_t* keys, gnt_data_t* data, uint64_t* found, size_t count);
+
+/**
+ * @brief Deletes a batch of keys while holding the trie's locks once.
+ * 
+ * Mapped, frozen and snapshot tries are read-only and fail without reporting any key.
+ * 
+ * @param trie The trie to delete the data from.
+ * @param keys The keys to delete.
+ * @param found Optionally receives whether each key was present, can be NULL.
+ * @param count The number of keys.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_delete_batch(gnt_trie_t* trie, const gnt_key_t* keys, bool* found, size_t count);
+
+/**
+ * @brief Attaches a cursor to a trie, leaving it unpositioned.
+ * 
+ * @param cursor The cursor to initialize.
+ * @param trie The trie to iterate.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_cursor_init(gnt_cursor_t* cursor, gnt_trie_t* trie);
+
+/**
+ * @brief Positions a cursor on the first key greater than or equal to a key.
+ * 
+ * @param cursor The cursor to position.
+ * @param key The key to seek.
+ * @return 0 if the cursor is positioned on a key, -1 otherwise.
+ */
+gnt_status_t gnt_seek(gnt_cursor_t* cursor, gnt_key_t key);
+
+/**
+ * @brief Positions a cursor on the first key greater than or equal to a key given as raw bytes.
+ * 
+ * @param cursor The cursor to position.
+ * @param bytes The bytes of the key.
+ * @param length The number of bytes in the key.
+ * @return 0 if the cursor is positioned on a key, -1 otherwise.
+ */
+gnt_status_t gnt_seek_bytes(gnt_cursor_t* cursor, const void* bytes, size_t length);
+
+/**
+ * @brief Moves a cursor to the next key, or to the first one if it is unpositioned.
+ * 
+ * @param cursor The cursor to move.
+ * @return 0 if the cursor is positioned on a key, -1 past the last key.
+ */
+gnt_status_t gnt_next(gnt_cursor_t* cursor);
+
+/**
+ * @brief Moves a cursor to the previous key, or to the last one if it is unpositioned.
+ * 
+ * @param cursor The cursor to move.
+ * @return 0 if the cursor is positioned on a key, -1 before the first key.
+ */
+gnt_status_t gnt_prev(gnt_cursor_t* cursor);
+
+/**
+ * @brief Visits in order every key between two bounds, both included.
+ * 
+ * The trie stays locked during the scan, so the visitor must not call back into it.
+ * 
+ * @param trie The trie to scan.
+ * @param lo The lowest key to visit.
+ * @param hi The highest key to visit.
+ * @param visitor Called with the bytes and data of each key, stops the scan by returning non-zero.
+ * @param context Passed to the visitor.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_range(gnt_trie_t* trie, gnt_key_t lo, gnt_key_t hi, gnt_visitor_t visitor, void* context);
+
+/**
+ * @brief Returns the data of the longest stored key that is a prefix of a key.
+ * 
+ * @param trie The trie to search.
+ * @param key The key to match.
+ * @param matched Optionally receives the length in bytes of the matched key, 0 if none, can be NULL.
+ * @return The data or 0 if no prefix of the key is stored.
+ */
+gnt_data_t gnt_longest_prefix(gnt_trie_t* trie, gnt_key_t key, gnt_index_t* matched);
+
+/**
+ * @brief Returns the data of the longest stored key that is a prefix of a key given as raw bytes.
+ * 
+ * @param trie The trie to search.
+ * @param bytes The bytes of the key.
+ * @param length The number of bytes in the key.
+ * @param matched Optionally receives the length in bytes of the matched key, 0 if none, can be NULL.
+ * @return The data or 0 if no prefix of the key is stored.
+ */
+gnt_data_t gnt_longest_prefix_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_index_t* matched);
+
+/**
+ * @brief Visits in order every key starting with a prefix, the prefix included.
+ * 
+ * Only the subtrie below the prefix is walked. It stays locked during the walk, so the visitor must not call back into the trie.
+ * 
+ * @param trie The trie to walk.
+ * @param prefix The prefix of the keys to visit.
+ * @param visitor Called with the bytes and data of each key, stops the walk by returning non-zero.
+ * @param context Passed to the visitor.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_prefix_foreach(gnt_trie_t* trie, gnt_key_t prefix, gnt_visitor_t visitor, void* context);
+
+/**
+ * @brief Visits in order every key starting with a prefix given as raw bytes, the prefix included.
+ * 
+ * @param trie The trie to walk.
+ * @param bytes The bytes of the prefix, none to visit every key.
+ * @param length The number of bytes in the prefix.
+ * @param visitor Called with the bytes and data of each key, stops the walk by returning non-zero.
+ * @param context Passed to the visitor.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_prefix_foreach_bytes(gnt_trie_t* trie, const void* bytes, size_t length, gnt_visitor_t visitor, void* context);
+
+/**
+ * @brief Passes the data of every key to a mapper, which can rewrite it in place.
+ * 
+ * Keys are visited in order. The trie stays write locked during the pass, so the mapper must not call back into it.
+ * Keys longer than GNT_CURSOR_KEY_MAX are skipped. Mapped and frozen tries are read-only and fail.
+ * 
+ * @param trie The trie to walk.
+ * @param mapper Called with the bytes and a pointer to the data of each key, stops the pass by returning non-zero.
+ * @param context Passed to the mapper.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_foreach(gnt_trie_t* trie, gnt_mapper_t mapper, void* context);
+
+/**
+ * @brief Passes the data of every key to a mapper, splitting the trie into subtries walked by several threads.
+ * 
+ * Each thread has its own context and sees keys in no particular order, the mapper must be safe to call from all of them at once.
+ * Once every thread is done, the reducer folds each other context into the first one in thread order.
+ * The calling thread takes part in the pass. A mapper returning non-zero stops every thread after their current key.
+ * 
+ * @param trie The trie to walk.
+ * @param threads The number of threads, 1 for a serial pass.
+ * @param mapper Called with the bytes and a pointer to the data of each key.
+ * @param reducer Combines two contexts into the first, can be NULL.
+ * @param contexts One context per thread, can be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_parallel_foreach(gnt_trie_t* trie, size_t threads, gnt_mapper_t mapper, gnt_reducer_t reducer, void** contexts);
+
+/**
+ * @brief Moves every key of src into dst, walking both tries at once.
+ * 
+ * Subtries that dst lacks are grafted whole instead of copied, so merging disjoint tries costs about one step per
+ * top-level node. Both tries are only descended where both have children. src is left empty and its memory is handed
+ * over to dst, so the two must share their allocator, releaser, GNT_FLAG_COMPRESS, GNT_FLAG_FIXED_WIDTH and
+ * GNT_FLAG_SHARDED. Both are locked for the whole merge and must be writable, without open snapshots. On failure,
+ * the keys that could not be moved are released.
+ * 
+ * @param dst The trie receiving the keys.
+ * @param src The trie giving them up.
+ * @param conflict Picks the data of a key stored in both, src wins when NULL. Data not picked goes to the deallocator of dst.
+ * @param context Passed to conflict.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_merge(gnt_trie_t* dst, gnt_trie_t* src, gnt_conflict_t conflict, void* context);
+
+/**
+ * @brief Removes from dst every key that src does not hold, walking both tries at once.
+ * 
+ * Branches of dst that src lacks are dropped without looking up their keys one by one. Data of the removed keys goes to
+ * the deallocator of dst, and src is only read. dst must be writable, without open snapshots.
+ * 
+ * @param dst The trie to filter.
+ * @param src The trie whose keys are kept.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_intersect(gnt_trie_t* dst, gnt_trie_t* src);
+
+/**
+ * @brief Removes from dst every key that src holds, walking both tries at once.
+ * 
+ * Branches of dst that src lacks are left untouched. Data of the removed keys goes to the deallocator of dst, and src
+ * is only read. dst must be writable, without open snapshots.
+ * 
+ * @param dst The trie to filter.
+ * @param src The trie whose keys are removed.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_difference(gnt_trie_t* dst, gnt_trie_t* src);
+
+/**
+ * @brief Writes a pointer-free image of the trie that gnt_open_mapped can serve without deserializing it.
+ * 
+ * Data is saved as is, so pointers stored as data are only meaningful to the saving process.
+ * 
+ * @param trie The trie to save.
+ * @param fd The file descriptor to write the image to.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_save(gnt_trie_t* trie, int fd);
+
+/**
+ * @brief Opens a saved image as a read-only trie served directly from a shared memory mapping.
+ * 
+ * Searches, prefix queries, cursors and saving work as usual without taking any lock, writes fail. The image
+ * is trusted, and must come from a build with the same layout and endianness. Destroying the trie unmaps the image.
+ * 
+ * @param path The path of the image.
+ * @param cfg Optionally supplies the accessors used to encode keys, its flags and deallocator are ignored, can be NULL.
+ * @return Pointer to the mapped gnt_trie_t or NULL on failure.
+ */
+gnt_trie_t* gnt_open_mapped(const char* path, gnt_cfg_t* cfg);
+
+/**
+ * @brief Saves the trie as the image its journal is replayed over, then empties the journal.
+ * 
+ * The image is written next to path and renamed over it once synced, so a crash leaves either checkpoint whole.
+ * Writers wait until the checkpoint is done. Without a journal, this is a durable gnt_save.
+ * 
+ * @param trie The trie to save.
+ * @param path The path of the image.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_checkpoint(gnt_trie_t* trie, const char* path);
+
+/**
+ * @brief Rebuilds a trie from its last checkpoint and journal, then keeps appending to the journal.
+ * 
+ * The log is replayed from the first record after the checkpoint to the last one written whole, a record torn
+ * or damaged by a crash and anything after it are dropped. Data is restored as is, so pointers stored as data
+ * are only meaningful to the process that wrote them. The flags should match those of the trie that was logged.
+ * 
+ * @param path The path of the checkpoint, missing or NULL to replay the log over an empty trie.
+ * @param cfg The configuration of the trie, its journal has to be set.
+ * @return Pointer to the recovered gnt_trie_t or NULL on failure.
+ */
+gnt_trie_t* gnt_recover(const char* path, gnt_cfg_t* cfg);
+
+/**
+ * @brief Writes and syncs the journal records still buffered.
+ * 
+ * @param trie The trie whose journal to sync.
+ * @return 0 on success or without a journal, -1 once the journal couldn't be written.
+ */
+gnt_status_t gnt_sync(gnt_trie_t* trie);
+
+/**
+ * @brief Builds a read-only copy of the trie packed into a single cache-line aligned block.
+ * 
+ * Nodes are laid out breadth-first and sized to their children, lookups on the copy take no lock and writes
+ * fail. The source trie is left unchanged and keeps owning the data, changes to it require freezing it again.
+ * 
+ * @param trie The trie to freeze.
+ * @return Pointer to the frozen gnt_trie_t or NULL on failure.
+ */
+gnt_trie_t* gnt_freeze(gnt_trie_t* trie);
+
+/**
+ * @brief Takes a read-only view of the trie as it is now, in constant time.
+ * 
+ * Writers keep going and copy the nibbles and nodes they change out of the snapshot, only along the paths they write.
+ * Lookups on the snapshot take no lock and writes fail. Data replaced or deleted meanwhile is only passed to the deallocator,
+ * and the copied nodes are only reclaimed, once every snapshot that can still read them is destroyed.
+ * Snapshots must be destroyed before the trie.
+ * 
+ * @param trie The trie to take a snapshot of.
+ * @return Pointer to the snapshot gnt_trie_t or NULL on failure.
+ */
+gnt_trie_t* gnt_snapshot(gnt_trie_t* trie);
+
+/**
+ * @brief Keeps frozen copies of a read-mostly trie, one per NUMA node, and routes lookups to the local one.
+ * 
+ * Writes still go to the trie and mark every replica stale. A thread reading a stale replica rebuilds it once lag_ms
+ * have passed since its last refresh, while the other threads of its node keep reading the previous copy, so reads
+ * lag behind writes by about lag_ms. Replicas are built by a thread of their node, or through its allocator, and
+ * their pages are local to it. The replicas must be destroyed before the trie.
+ * 
+ * @param trie The trie to replicate.
+ * @param cfg The number of replicas, their allocators and their lag.
+ * @return Pointer to the new gnt_replicas_t or NULL on failure.
+ */
+gnt_replicas_t* gnt_replicas_create(gnt_trie_t* trie, const gnt_replicas_cfg_t* cfg);
+
+/**
+ * @brief Destroys the replicas of a trie, none may be pinned anymore.
+ * 
+ * @param replicas The replicas to destroy.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_replicas_destroy(gnt_replicas_t* replicas);
+
+/**
+ * @brief Pins the replica of the NUMA node of the calling thread, refreshing it first when it is stale.
+ * 
+ * pin->trie can then be passed to any read of the API, until gnt_replicas_exit. A thread must not refresh or destroy
+ * the replicas while it holds a pin.
+ * 
+ * @param replicas The replicas to read.
+ * @param pin The returned pin.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_replicas_enter(gnt_replicas_t* replicas, gnt_pin_t* pin);
+
+/**
+ * @brief Releases a replica pinned by gnt_replicas_enter.
+ * 
+ * @param pin The pin to release.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_replicas_exit(gnt_pin_t* pin);
+
+/**
+ * @brief Searches the local replica and returns the data associated to a key.
+ * 
+ * @param replicas The replicas to search.
+ * @param key The key associated to the data.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_replicas_search(gnt_replicas_t* replicas, gnt_key_t key);
+
+/**
+ * @brief Searches the local replica and returns the data associated to a key given as raw bytes.
+ * 
+ * @param replicas The replicas to search.
+ * @param bytes The key bytes.
+ * @param length The number of key bytes.
+ * @return The data or 0 if trie is empty or data isn't found.
+ */
+gnt_data_t gnt_replicas_search_bytes(gnt_replicas_t* replicas, const void* bytes, size_t length);
+
+/**
+ * @brief Rebuilds every stale replica now, on the calling thread.
+ * 
+ * Without allocators, the rebuilt replicas are all placed on the node of the calling thread.
+ * 
+ * @param replicas The replicas to refresh.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_replicas_sync(gnt_replicas_t* replicas);
+
+/**
+ * @brief Reports the size and shape of the trie.
+ * 
+ * Counts are maintained by the writers and read in constant time, the depth and fanout fields need a walk of the whole trie.
+ * 
+ * @param trie The trie to inspect.
+ * @param stats The returned statistics.
+ * @param shape Whether to walk the trie to fill max_depth and the fanout histograms, left at 0 otherwise.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_stats(gnt_trie_t* trie, gnt_stats_t* stats, bool shape);
+
+/**
+ * @brief Reports the lock contention and the operation latencies measured on the trie.
+ * 
+ * Measuring is compiled in only when GNT_INSTRUMENT is defined, and costs nothing otherwise.
+ * 
+ * @param trie The trie to inspect.
+ * @param metrics The returned metrics.
+ * @return 0 on success, -1 on failure or when built without GNT_INSTRUMENT.
+ */
+gnt_status_t gnt_metrics(gnt_trie_t* trie, gnt_metrics_t* metrics);
+
 /**
  * @brief Returns the byte of the key at the index.
  * 
@@ -134,4 +944,14 @@ gnt_status_t gnt_delete(gnt_trie_t* trie, gnt_key_t key);
  */
 gnt_status_t gnt_accessor_string(gnt_byte_t* byte, gnt_key_t key, gnt_index_t index);
 
+/**
+ * @brief Returns all the bytes of a null-terminated string key.
+ * 
+ * @param bytes The returned bytes.
+ * @param length The returned number of bytes, excluding the terminator.
+ * @param key The key to get the bytes from.
+ * @return 0 on success, -1 on failure.
+ */
+gnt_status_t gnt_span_accessor_string(const gnt_byte_t** bytes, gnt_index_t* length, gnt_key_t key);
+
 #endif /* GNT_H */
\ No newline at end of file
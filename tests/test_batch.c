@@ -0,0 +1,156 @@
+/*
+ * test_batch.c - Generic Nibble Trie batch operation tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 1000
+#define TEST_FAILING 437 // Key the span accessor refuses, a few lanes into a refill
+#define TEST_UNTOUCHED ((gnt_data_t) 0xDEAD)
+
+static char test_strings[TEST_KEYS][16];
+static bool test_refuse;
+
+static gnt_status_t test_span_accessor(const gnt_byte_t** bytes, gnt_index_t* length, gnt_key_t key)
+{
+    // Keys are indexes into test_strings
+    if (test_refuse && TEST_FAILING == key)
+    {
+        return -1;
+    }
+    
+    *bytes = (const gnt_byte_t*) test_strings[key];
+    *length = strlen(test_strings[key]);
+    
+    return 0;
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.span_accessor = test_span_accessor;
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_key_t keys[TEST_KEYS];
+    gnt_data_t data[TEST_KEYS];
+    gnt_data_t results[TEST_KEYS];
+    bool found[TEST_KEYS];
+    
+    TEST_CHECK(trie, flags);
+    test_refuse = false;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        keys[i] = i;
+        data[i] = i + 1;
+    }
+    
+    // Every other key is stored, so the lanes mix hits and misses of every depth
+    for (size_t i = 0; i < TEST_KEYS; i += 2)
+    {
+        TEST_CHECK(0 == gnt_insert(trie, keys[i], data[i]), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_search_batch(trie, keys, results, found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(results[i] == (i % 2 ? 0 : data[i]), flags);
+        TEST_CHECK(found[i] == !(i % 2), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_insert_batch(trie, keys, data, TEST_KEYS), flags);
+    TEST_CHECK(0 == gnt_search_batch(trie, keys, results, NULL, TEST_KEYS), flags);
+    TEST_CHECK(0 == memcmp(results, data, sizeof(data)), flags);
+    
+    // A key that fails to load stops the batch, the keys before it are still searched
+    test_refuse = true;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        results[i] = TEST_UNTOUCHED;
+    }
+    
+    TEST_CHECK(-1 == gnt_search_batch(trie, keys, results, found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(results[i] == (i < TEST_FAILING ? data[i] : TEST_UNTOUCHED), flags);
+    }
+    
+    // Failing on the first fill, before any lane has been walked
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        results[i] = TEST_UNTOUCHED;
+    }
+    
+    TEST_CHECK(-1 == gnt_search_batch(trie, &keys[TEST_FAILING - 3], results, NULL, 8), flags);
+    
+    for (size_t i = 0; i < 8; i++)
+    {
+        TEST_CHECK(results[i] == (i < 3 ? data[TEST_FAILING - 3 + i] : TEST_UNTOUCHED), flags);
+    }
+    
+    TEST_CHECK(-1 == gnt_insert_batch(trie, keys, data, TEST_KEYS), flags);
+    
+    // Deletes skip the keys that fail to load and go on with the others
+    TEST_CHECK(-1 == gnt_delete_batch(trie, keys, found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(found[i] == (i != TEST_FAILING), flags);
+    }
+    
+    test_refuse = false;
+    TEST_CHECK(0 == gnt_delete_batch(trie, keys, found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(found[i] == (i == TEST_FAILING), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(test_strings[i], sizeof(test_strings[i]), "key%zu", i * 7919 % 100003);
+    }
+    
+    // Every combination of the flags that change the layout or the locking
+    for (gnt_flags_t flags = 0; flags <= (GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_FIXED_WIDTH | GNT_FLAG_WIDE_ROOT); flags++)
+    {
+        test_run(flags);
+    }
+    
+    puts("test_batch: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/*
+ * test_budget.c - Generic Nibble Trie memory budget tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_BUDGET (1024 * 1024)
+#define TEST_KEYS 100000
+#define TEST_HOT 32 // Keys kept in use by searches, and as many by updates
+#define TEST_PERIOD 100 // Inserts between two uses of the hot keys, short of a sweep of the smallest shard
+
+static uint64_t test_keys[TEST_KEYS];
+static uint8_t test_released[TEST_KEYS + 1];
+static gnt_flags_t test_flags;
+
+static void test_deallocator(gnt_data_t data)
+{
+    TEST_CHECK(data > 0 && data <= TEST_KEYS, test_flags);
+    test_released[data]++;
+}
+
+static void test_keep(gnt_data_t* data, bool found, void* context)
+{
+    // Updates leave the data as is, they only use the key
+    TEST_CHECK(found, test_flags);
+    (void) data;
+    (*(size_t*) context)++;
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    cfg.budget = TEST_BUDGET;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_stats_t stats;
+    size_t updated = 0;
+    size_t stored = 0;
+    
+    TEST_CHECK(trie, flags);
+    test_flags = flags;
+    memset(test_released, 0, sizeof(test_released));
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(0 == gnt_insert_u64(trie, test_keys[i], (gnt_data_t) i + 1), flags);
+        
+        // The first keys are searched or updated between inserts, which must keep them from eviction
+        if (0 == (i + 1) % TEST_PERIOD)
+        {
+            for (size_t hot = 0; hot < TEST_HOT && hot <= i; hot++)
+            {
+                TEST_CHECK(gnt_search_u64(trie, test_keys[hot]) == (gnt_data_t) hot + 1, flags);
+            }
+            
+            for (size_t hot = TEST_HOT; hot < 2 * TEST_HOT && hot <= i; hot++)
+            {
+                TEST_CHECK(0 == gnt_update(trie, (gnt_key_t) test_keys[hot], test_keep, &updated), flags);
+            }
+            
+            // Eviction runs in batches, each write may overrun the budget by a sixteenth at most
+            TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+            TEST_CHECK(stats.live <= TEST_BUDGET + TEST_BUDGET / 16, flags);
+        }
+    }
+    
+    TEST_CHECK(updated > 0, flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+    
+    // Eviction keeps the trie close to the budget rather than emptying it
+    TEST_CHECK(stats.live >= TEST_BUDGET / 2, flags);
+    TEST_CHECK(stats.values < TEST_KEYS, flags);
+    
+    // Evicted keys are gone and their data was released once, the others are untouched
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        gnt_data_t data = gnt_search_u64(trie, test_keys[i]);
+        
+        TEST_CHECK(data == (test_released[i + 1] ? 0 : (gnt_data_t) i + 1), flags);
+        TEST_CHECK(test_released[i + 1] <= 1, flags);
+        TEST_CHECK(i >= 2 * TEST_HOT || data, flags);
+        stored += !!data;
+    }
+    
+    TEST_CHECK(stats.values == stored, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    for (size_t i = 1; i <= TEST_KEYS; i++)
+    {
+        TEST_CHECK(1 == test_released[i], flags);
+    }
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK,
+        GNT_FLAG_SHARDED | GNT_FLAG_LAZY_DELETE,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMBINING
+    };
+    
+    // Distinct keys, the low bits hold their index
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        test_keys[i] = (test_random(&seed) & ~(uint64_t) 0xFFFFF) | i;
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_budget: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*
+ * test_bulk.c - Generic Nibble Trie bulk loading tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 6000
+#define TEST_STRING_SIZE 12 // Hexadecimal keys of every length, shorter ones are often prefixes of longer ones
+
+static char test_strings[TEST_KEYS][TEST_STRING_SIZE];
+static gnt_key_t test_keys[TEST_KEYS];
+static gnt_data_t test_data[TEST_KEYS];
+static uint8_t test_released[2 * TEST_KEYS + 1];
+
+static void test_deallocator(gnt_data_t data)
+{
+    test_released[data]++;
+}
+
+static int test_compare(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+static gnt_trie_t* test_create(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.span_accessor = gnt_span_accessor_string;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    
+    TEST_CHECK(trie, flags);
+    
+    return trie;
+}
+
+static void test_same(gnt_trie_t* loaded, gnt_trie_t* inserted, gnt_flags_t flags)
+{
+    // Loading leaves the keys, the data and the shape the same inserts in the same order do
+    gnt_cursor_t a;
+    gnt_cursor_t b;
+    gnt_stats_t x;
+    gnt_stats_t y;
+    
+    TEST_CHECK(0 == gnt_cursor_init(&a, loaded) && 0 == gnt_cursor_init(&b, inserted), flags);
+    
+    while (0 == gnt_next(&b))
+    {
+        TEST_CHECK(0 == gnt_next(&a), flags);
+        TEST_CHECK(a.length == b.length && 0 == memcmp(a.key, b.key, a.length) && a.data == b.data, flags);
+    }
+    
+    TEST_CHECK(-1 == gnt_next(&a), flags);
+    TEST_CHECK(0 == gnt_stats(loaded, &x, true) && 0 == gnt_stats(inserted, &y, true), flags);
+    TEST_CHECK(x.values == y.values && x.nodes == y.nodes && x.nibbles == y.nibbles, flags);
+    TEST_CHECK(x.max_depth == y.max_depth && x.wasted == y.wasted, flags);
+}
+
+static void test_load(gnt_flags_t flags, size_t count, bool parallel, bool preload)
+{
+    gnt_trie_t* loaded = test_create(flags);
+    gnt_trie_t* inserted = test_create(flags);
+    bool used[2 * TEST_KEYS + 1] = {false};
+    
+    memset(test_released, 0, sizeof(test_released));
+    
+    // Loading into a trie that already holds keys overwrites the ones they share
+    if (preload)
+    {
+        for (size_t i = 0; i < count; i += 5)
+        {
+            gnt_data_t data = (gnt_data_t) (TEST_KEYS + 1 + i);
+            
+            used[data] = true;
+            TEST_CHECK(0 == gnt_insert(loaded, test_keys[i], data), flags);
+            TEST_CHECK(0 == gnt_insert(inserted, test_keys[i], data), flags);
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_CHECK(0 == gnt_insert(inserted, test_keys[i], test_data[i]), flags);
+        used[test_data[i]] = true;
+    }
+    
+    TEST_CHECK(0 == (parallel ? gnt_bulk_load_parallel : gnt_bulk_load)(loaded, test_keys, test_data, count), flags);
+    test_same(loaded, inserted, flags);
+    
+    // Both tries released the same overwritten data, then everything else once destroyed
+    for (size_t i = 1; i <= 2 * TEST_KEYS; i++)
+    {
+        TEST_CHECK(0 == test_released[i] || (used[i] && 2 == test_released[i]), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(loaded) && 0 == gnt_destroy(inserted), flags);
+    
+    for (size_t i = 1; i <= 2 * TEST_KEYS; i++)
+    {
+        TEST_CHECK(test_released[i] == (used[i] ? 2 : 0), flags);
+    }
+}
+
+static void test_run(gnt_flags_t flags, uint64_t* seed)
+{
+    const char* sorted[TEST_KEYS];
+    
+    // Sorted and distinct, sorted with runs of duplicates, then shuffled with the duplicates kept
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        sorted[i] = test_strings[i];
+    }
+    
+    qsort(sorted, TEST_KEYS, sizeof(sorted[0]), test_compare);
+    
+    size_t count = 0;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (!count || strcmp((const char*) test_keys[count - 1], sorted[i]))
+        {
+            test_keys[count] = (gnt_key_t) sorted[i];
+            test_data[count] = (gnt_data_t) count + 1;
+            count++;
+        }
+    }
+    
+    for (uint8_t parallel = 0; parallel < 2; parallel++)
+    {
+        test_load(flags, 0, parallel, false);
+        test_load(flags, 1, parallel, false);
+        test_load(flags, count, parallel, false);
+        test_load(flags, count, parallel, true);
+    }
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        test_keys[i] = (gnt_key_t) sorted[i];
+        test_data[i] = (gnt_data_t) i + 1;
+    }
+    
+    test_load(flags, TEST_KEYS, false, false);
+    test_load(flags, TEST_KEYS, true, true);
+    
+    for (size_t i = TEST_KEYS - 1; i > 0; i--)
+    {
+        size_t other = test_random(seed) % (i + 1);
+        gnt_key_t key = test_keys[i];
+        
+        test_keys[i] = test_keys[other];
+        test_keys[other] = key;
+    }
+    
+    test_load(flags, TEST_KEYS, false, false);
+    test_load(flags, TEST_KEYS, true, false);
+    test_load(flags, TEST_KEYS, false, true);
+    
+    // A key that fails to load stops the load, the keys before it are in
+    gnt_trie_t* trie = test_create(flags);
+    
+    test_keys[TEST_KEYS / 2] = (gnt_key_t) "";
+    TEST_CHECK(-1 == gnt_bulk_load(trie, test_keys, test_data, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS / 2; i++)
+    {
+        TEST_CHECK(0 != gnt_search(trie, test_keys[i]), flags);
+    }
+    
+    TEST_CHECK(-1 == gnt_bulk_load_parallel(trie, test_keys, test_data, TEST_KEYS), flags);
+    TEST_CHECK(-1 == gnt_bulk_load(trie, NULL, test_data, 1), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK,
+        GNT_FLAG_SHARDED | GNT_FLAG_WIDE_ROOT,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS
+    };
+    
+    // About one key in ten repeats another
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (i && 0 == test_random(&seed) % 10)
+        {
+            memcpy(test_strings[i], test_strings[test_random(&seed) % i], TEST_STRING_SIZE);
+            continue;
+        }
+        
+        snprintf(test_strings[i], TEST_STRING_SIZE, "%llx", (unsigned long long) (test_random(&seed) >> (4 * (5 + test_random(&seed) % 11))));
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i], &seed);
+    }
+    
+    puts("test_bulk: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/*
+ * test_combining.c - Generic Nibble Trie combining writer tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_WRITERS 8 // Writers held back per round, so that each round combines a batch of this many
+#define TEST_KEYS 64 // Keys the rounds cycle through, a multiple of TEST_WRITERS
+#define TEST_ROUNDS 48
+#define TEST_READERS 2
+#define TEST_CHURN_KEYS 8000 // Keys written by the free-running writers
+#define TEST_CHURN_PASSES 5
+
+typedef struct test_round // Writes of one round, published while a pass holds every shard
+{
+    gnt_trie_t* trie;
+    gnt_flags_t flags;
+    size_t round;
+    bool deletes[TEST_WRITERS];
+    gnt_status_t statuses[TEST_WRITERS];
+    thrd_t writers[TEST_WRITERS];
+    atomic_size_t arrived;
+    bool started;
+} test_round_t;
+
+typedef struct test_writer
+{
+    test_round_t* round;
+    size_t index;
+} test_writer_t;
+
+static uint64_t test_keys[TEST_KEYS];
+static thrd_t test_owners[TEST_KEYS]; // Writer of the current round for each key
+static atomic_bool test_counting;
+static atomic_size_t test_released;
+static atomic_size_t test_foreign; // Data released on a thread other than the one whose write replaced or deleted it
+
+static void test_deallocator(gnt_data_t data)
+{
+    atomic_fetch_add(&test_released, 1);
+    
+    // Round data holds its key index in the low byte
+    if (atomic_load(&test_counting) && !thrd_equal(thrd_current(), test_owners[(data - 1) & 0xFF]))
+    {
+        atomic_fetch_add(&test_foreign, 1);
+    }
+}
+
+static size_t test_key(size_t round, size_t index)
+{
+    return (round * TEST_WRITERS + index) % TEST_KEYS;
+}
+
+static int test_write(void* argument)
+{
+    test_writer_t* writer = argument;
+    test_round_t* round = writer->round;
+    size_t key = test_key(round->round, writer->index);
+    
+    test_owners[key] = thrd_current();
+    atomic_fetch_add(&round->arrived, 1);
+    
+    if (round->deletes[writer->index])
+    {
+        round->statuses[writer->index] = gnt_delete_u64(round->trie, test_keys[key]);
+    }
+    else
+    {
+        round->statuses[writer->index] = gnt_insert_u64(round->trie, test_keys[key], (gnt_data_t) ((round->round << 8 | key) + 1));
+    }
+    
+    return 0;
+}
+
+static gnt_status_t test_hold(const gnt_byte_t* key, gnt_index_t length, gnt_data_t* data, void* context)
+{
+    test_round_t* round = context;
+    static test_writer_t writers[TEST_WRITERS];
+    
+    (void) key;
+    (void) length;
+    (void) data;
+    
+    // The first key starts the writers, which find their shards locked and publish their writes
+    if (!round->started)
+    {
+        round->started = true;
+        
+        for (size_t i = 0; i < TEST_WRITERS; i++)
+        {
+            writers[i] = (test_writer_t) {round, i};
+            TEST_CHECK(thrd_success == thrd_create(&round->writers[i], test_write, &writers[i]), round->flags);
+        }
+        
+        while (atomic_load(&round->arrived) < TEST_WRITERS)
+        {
+            thrd_yield();
+        }
+        
+        thrd_sleep(&(struct timespec) {.tv_nsec = 2000000}, NULL);
+    }
+    
+    return 0;
+}
+
+static void test_publish(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_data_t model[TEST_KEYS] = {0};
+    uint64_t seed = flags + 1;
+    size_t stored = 0;
+    
+    TEST_CHECK(trie, flags);
+    atomic_store(&test_released, 0);
+    atomic_store(&test_foreign, 0);
+    
+    // Longer than any integer key, keeps the trie from being empty so that each pass reaches the mapper
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "sentinel key", 12, (gnt_data_t) 0x1000000), flags);
+    stored++;
+    
+    for (size_t r = 0; r < TEST_ROUNDS; r++)
+    {
+        test_round_t round = {trie, flags, r, {0}, {0}, {0}, 0, false};
+        
+        for (size_t i = 0; i < TEST_WRITERS; i++)
+        {
+            round.deletes[i] = test_random(&seed) % 2;
+        }
+        
+        atomic_store(&test_counting, true);
+        TEST_CHECK(0 == gnt_foreach(trie, test_hold, &round), flags);
+        
+        for (size_t i = 0; i < TEST_WRITERS; i++)
+        {
+            TEST_CHECK(thrd_success == thrd_join(round.writers[i], NULL), flags);
+        }
+        
+        atomic_store(&test_counting, false);
+        
+        for (size_t i = 0; i < TEST_WRITERS; i++)
+        {
+            size_t key = test_key(r, i);
+            
+            if (round.deletes[i])
+            {
+                TEST_CHECK(round.statuses[i] == (model[key] ? 0 : -1), flags);
+                model[key] = 0;
+            }
+            else
+            {
+                TEST_CHECK(0 == round.statuses[i], flags);
+                model[key] = (gnt_data_t) ((r << 8 | key) + 1);
+                stored++;
+            }
+        }
+        
+        for (size_t key = 0; key < TEST_KEYS; key++)
+        {
+            TEST_CHECK(gnt_search_u64(trie, test_keys[key]) == model[key], flags);
+        }
+    }
+    
+    // The writes were applied by whichever waiter got the shard, not each by its own thread
+    TEST_CHECK(atomic_load(&test_foreign) > 0, flags);
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    TEST_CHECK(atomic_load(&test_released) == stored, flags);
+}
+
+typedef struct test_churn // Free-running writers and readers on the same trie
+{
+    gnt_trie_t* trie;
+    gnt_flags_t flags;
+    size_t index;
+} test_churn_t;
+
+static int test_churn_write(void* argument)
+{
+    test_churn_t* churn = argument;
+    
+    // Every pass inserts this writer's keys, odd passes delete them again
+    for (size_t pass = 0; pass < TEST_CHURN_PASSES; pass++)
+    {
+        for (size_t key = churn->index; key < TEST_CHURN_KEYS; key += TEST_WRITERS)
+        {
+            TEST_CHECK(0 == gnt_insert_u64(churn->trie, key, (gnt_data_t) key + 1), churn->flags);
+            
+            if (pass % 2)
+            {
+                TEST_CHECK(0 == gnt_delete_u64(churn->trie, key), churn->flags);
+                TEST_CHECK(-1 == gnt_delete_u64(churn->trie, key), churn->flags);
+            }
+        }
+    }
+    
+    return 0;
+}
+
+static int test_churn_read(void* argument)
+{
+    test_churn_t* churn = argument;
+    
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        for (size_t key = 0; key < TEST_CHURN_KEYS; key++)
+        {
+            gnt_data_t data = gnt_search_u64(churn->trie, key);
+            TEST_CHECK(!data || data == (gnt_data_t) key + 1, churn->flags);
+        }
+    }
+    
+    return 0;
+}
+
+static void test_contend(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    test_churn_t churns[TEST_WRITERS + TEST_READERS];
+    thrd_t threads[TEST_WRITERS + TEST_READERS];
+    
+    TEST_CHECK(trie, flags);
+    atomic_store(&test_released, 0);
+    
+    for (size_t i = 0; i < TEST_WRITERS + TEST_READERS; i++)
+    {
+        churns[i] = (test_churn_t) {trie, flags, i};
+        TEST_CHECK(thrd_success == thrd_create(&threads[i], i < TEST_WRITERS ? test_churn_write : test_churn_read, &churns[i]), flags);
+    }
+    
+    for (size_t i = 0; i < TEST_WRITERS + TEST_READERS; i++)
+    {
+        TEST_CHECK(thrd_success == thrd_join(threads[i], NULL), flags);
+    }
+    
+    for (size_t key = 0; key < TEST_CHURN_KEYS; key++)
+    {
+        TEST_CHECK(gnt_search_u64(trie, key) == (gnt_data_t) key + 1, flags);
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    TEST_CHECK(atomic_load(&test_released) == TEST_CHURN_PASSES * TEST_CHURN_KEYS, flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    
+    // Keys of every length, spread over the root subtries and kept distinct by their low byte
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        test_keys[i] = (test_random(&seed) >> (i % 8 * 8) & ~(uint64_t) 0xFF) | i;
+    }
+    
+    // Every combination of the flags that change the layout or the delete path
+    for (gnt_flags_t flags = 0; flags <= (GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_FIXED_WIDTH | GNT_FLAG_WIDE_ROOT | GNT_FLAG_LAZY_DELETE); flags++)
+    {
+        test_publish(flags | GNT_FLAG_COMBINING);
+    }
+    
+    const gnt_flags_t contended[] = {
+        GNT_FLAG_COMBINING,
+        GNT_FLAG_COMBINING | GNT_FLAG_SHARDED,
+        GNT_FLAG_COMBINING | GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK | GNT_FLAG_COMPRESS,
+        GNT_FLAG_COMBINING | GNT_FLAG_SHARDED | GNT_FLAG_LAZY_DELETE | GNT_FLAG_WIDE_ROOT,
+        GNT_FLAG_COMBINING | GNT_FLAG_SHARDED | GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS
+    };
+    
+    for (size_t i = 0; i < sizeof(contended) / sizeof(contended[0]); i++)
+    {
+        test_contend(contended[i]);
+    }
+    
+    puts("test_combining: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+/*
+ * test_cursor.c - Generic Nibble Trie cursor and range scan tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 3000
+#define TEST_STRING_SIZE 8 // Decimal keys, shorter ones are often prefixes of longer ones
+
+typedef struct test_scan
+{
+    size_t next; // Lowest index the next key visited can have
+    size_t visited;
+    size_t limit; // Keys visited before the scan is stopped
+} test_scan_t;
+
+static char test_strings[TEST_KEYS][TEST_STRING_SIZE];
+static char test_probe[TEST_STRING_SIZE + 1];
+static bool test_stored[TEST_KEYS];
+static size_t test_count;
+static gnt_flags_t test_flags;
+
+static int test_compare(const void* a, const void* b)
+{
+    return strcmp(a, b);
+}
+
+static size_t test_following(size_t index)
+{
+    while (index < test_count && !test_stored[index])
+    {
+        index++;
+    }
+    
+    return index;
+}
+
+static size_t test_preceding(size_t index)
+{
+    // Index of the last stored key before the given one, test_count if there is none
+    while (index-- > 0)
+    {
+        if (test_stored[index])
+        {
+            return index;
+        }
+    }
+    
+    return test_count;
+}
+
+static gnt_key_t test_after(size_t index)
+{
+    // '/' sorts below every digit, so the probe falls between the key and the next one
+    snprintf(test_probe, sizeof(test_probe), "%s/", test_strings[index]);
+    
+    return (gnt_key_t) test_probe;
+}
+
+static void test_at(gnt_cursor_t* cursor, size_t index)
+{
+    TEST_CHECK(index < test_count && cursor->positioned, test_flags);
+    TEST_CHECK(cursor->data == (gnt_data_t) index + 1, test_flags);
+    TEST_CHECK(cursor->length == strlen(test_strings[index]), test_flags);
+    TEST_CHECK(0 == memcmp(cursor->key, test_strings[index], cursor->length), test_flags);
+}
+
+static gnt_status_t test_visit(const gnt_byte_t* key, gnt_index_t length, gnt_data_t data, void* context)
+{
+    test_scan_t* scan = context;
+    size_t index = test_following(scan->next);
+    
+    TEST_CHECK(index < test_count && data == (gnt_data_t) index + 1, test_flags);
+    TEST_CHECK(length == strlen(test_strings[index]) && 0 == memcmp(key, test_strings[index], length), test_flags);
+    scan->next = index + 1;
+    
+    return ++scan->visited == scan->limit;
+}
+
+static void test_range(gnt_trie_t* trie, gnt_key_t lo, gnt_key_t hi, size_t first, size_t last, size_t limit)
+{
+    // Exactly the stored keys with an index in [first, last) are visited, up to the limit
+    test_scan_t scan = {first, 0, limit};
+    size_t expected = 0;
+    
+    for (size_t i = first; i < last; i++)
+    {
+        expected += test_stored[i];
+    }
+    
+    TEST_CHECK(0 == gnt_range(trie, lo, hi, test_visit, &scan), test_flags);
+    TEST_CHECK(scan.visited == (expected < limit ? expected : limit), test_flags);
+}
+
+static void test_verify(gnt_trie_t* trie, uint64_t* seed)
+{
+    gnt_cursor_t cursor;
+    size_t index;
+    
+    TEST_CHECK(0 == gnt_cursor_init(&cursor, trie), test_flags);
+    TEST_CHECK(!cursor.positioned, test_flags);
+    
+    // Full walks both ways, then past either end the cursor starts over
+    for (index = test_following(0); index < test_count; index = test_following(index + 1))
+    {
+        TEST_CHECK(0 == gnt_next(&cursor), test_flags);
+        test_at(&cursor, index);
+    }
+    
+    TEST_CHECK(-1 == gnt_next(&cursor) && !cursor.positioned, test_flags);
+    TEST_CHECK(0 == gnt_next(&cursor), test_flags);
+    test_at(&cursor, test_following(0));
+    TEST_CHECK(-1 == gnt_prev(&cursor) && !cursor.positioned, test_flags);
+    
+    for (index = test_preceding(test_count); index < test_count; index = test_preceding(index))
+    {
+        TEST_CHECK(0 == gnt_prev(&cursor), test_flags);
+        test_at(&cursor, index);
+    }
+    
+    TEST_CHECK(-1 == gnt_prev(&cursor) && !cursor.positioned, test_flags);
+    
+    // Seeks land on the key itself or on the first stored key above it, and steps go on from there
+    for (size_t i = 0; i < test_count; i += 1 + test_random(seed) % 7)
+    {
+        index = test_following(i);
+        TEST_CHECK((index < test_count ? 0 : -1) == gnt_seek(&cursor, (gnt_key_t) test_strings[i]), test_flags);
+        
+        if (index < test_count)
+        {
+            test_at(&cursor, index);
+            
+            if (test_preceding(index) < test_count)
+            {
+                TEST_CHECK(0 == gnt_prev(&cursor), test_flags);
+                test_at(&cursor, test_preceding(index));
+                TEST_CHECK(0 == gnt_next(&cursor), test_flags);
+                test_at(&cursor, index);
+            }
+        }
+        
+        index = test_following(i + 1);
+        TEST_CHECK((index < test_count ? 0 : -1) == gnt_seek(&cursor, test_after(i)), test_flags);
+        
+        if (index < test_count)
+        {
+            test_at(&cursor, index);
+        }
+    }
+    
+    TEST_CHECK(-1 == gnt_seek(&cursor, (gnt_key_t) "a"), test_flags);
+    TEST_CHECK(0 == gnt_seek(&cursor, (gnt_key_t) "!"), test_flags);
+    test_at(&cursor, test_following(0));
+    
+    test_range(trie, (gnt_key_t) "!", (gnt_key_t) "a", 0, test_count, SIZE_MAX);
+    
+    for (uint8_t round = 0; round < 50; round++)
+    {
+        size_t a = test_random(seed) % test_count;
+        size_t b = a + test_random(seed) % (test_count - a);
+        
+        // Bounds that are stored keys are included
+        test_range(trie, (gnt_key_t) test_strings[a], (gnt_key_t) test_strings[b], a, b + 1, SIZE_MAX);
+        test_range(trie, (gnt_key_t) test_strings[a], (gnt_key_t) test_strings[a], a, a + 1, SIZE_MAX);
+        
+        // Bounds between keys exclude their neighbours
+        test_range(trie, test_after(a), (gnt_key_t) test_strings[b], a + 1, b + 1, SIZE_MAX);
+        
+        char high[TEST_STRING_SIZE + 1];
+        snprintf(high, sizeof(high), "%s/", test_strings[b]);
+        test_range(trie, (gnt_key_t) test_strings[a], (gnt_key_t) high, a, b + 1, SIZE_MAX);
+        test_range(trie, test_after(a), (gnt_key_t) high, a + 1, b + 1, SIZE_MAX);
+        
+        // Empty ranges, reversed or holding no key, never call the visitor
+        test_range(trie, test_after(a), test_after(a), 0, 0, SIZE_MAX);
+        
+        if (a < b)
+        {
+            test_range(trie, (gnt_key_t) test_strings[b], (gnt_key_t) test_strings[a], 0, 0, SIZE_MAX);
+        }
+        
+        // The visitor stops the scan early
+        test_range(trie, (gnt_key_t) test_strings[a], (gnt_key_t) test_strings[b], a, b + 1, 3);
+    }
+    
+    test_range(trie, (gnt_key_t) "a", (gnt_key_t) "b", 0, 0, SIZE_MAX);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.span_accessor = gnt_span_accessor_string;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_cursor_t cursor;
+    
+    TEST_CHECK(trie, flags);
+    test_flags = flags;
+    
+    // An empty trie has no first or last key and no range holds anything
+    TEST_CHECK(0 == gnt_cursor_init(&cursor, trie), flags);
+    TEST_CHECK(-1 == gnt_next(&cursor) && -1 == gnt_prev(&cursor), flags);
+    TEST_CHECK(-1 == gnt_seek(&cursor, (gnt_key_t) "!"), flags);
+    
+    for (size_t i = 0; i < test_count; i++)
+    {
+        test_stored[i] = false;
+    }
+    
+    test_range(trie, (gnt_key_t) "!", (gnt_key_t) "a", 0, test_count, SIZE_MAX);
+    
+    // Inserted out of order
+    for (size_t i = 0; i < test_count; i++)
+    {
+        size_t index = (i * 7919) % test_count;
+        
+        TEST_CHECK(0 == gnt_insert(trie, (gnt_key_t) test_strings[index], (gnt_data_t) index + 1), flags);
+        test_stored[index] = true;
+    }
+    
+    test_verify(trie, &seed);
+    
+    // Deleted keys, and with GNT_FLAG_LAZY_DELETE the branches they leave, are skipped
+    for (size_t i = 0; i < test_count; i++)
+    {
+        if (test_random(&seed) % 3 == 0)
+        {
+            TEST_CHECK(0 == gnt_delete(trie, (gnt_key_t) test_strings[i]), flags);
+            test_stored[i] = false;
+        }
+    }
+    
+    test_verify(trie, &seed);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_LAZY_DELETE
+    };
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(test_strings[i], TEST_STRING_SIZE, "%u", (unsigned) (test_random(&seed) % 100000));
+    }
+    
+    qsort(test_strings, TEST_KEYS, TEST_STRING_SIZE, test_compare);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (!test_count || strcmp(test_strings[test_count - 1], test_strings[i]))
+        {
+            memcpy(test_strings[test_count++], test_strings[i], TEST_STRING_SIZE);
+        }
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_cursor: ok");
+    
+    return EXIT_SUCCESS;
+}
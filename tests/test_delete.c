@@ -0,0 +1,224 @@
+/*
+ * test_delete.c - Generic Nibble Trie delete and compaction tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 8000
+#define TEST_ROUNDS 4
+#define TEST_STRING_SIZE 24 // Longer than any integer key, so the two kinds never share a key
+
+static size_t test_released;
+
+static void test_deallocator(gnt_data_t data)
+{
+    (void) data;
+    test_released++;
+}
+
+static int test_compare(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    
+    return (x > y) - (x < y);
+}
+
+static size_t test_keys(uint64_t* keys, uint64_t seed)
+{
+    size_t count = 0;
+    
+    // Dense small keys mixed with sparse keys of every length
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        keys[i] = (i % 2) ? test_random(&seed) % 5000 : test_random(&seed) >> (test_random(&seed) % 64);
+    }
+    
+    qsort(keys, TEST_KEYS, sizeof(uint64_t), test_compare);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (!count || keys[count - 1] != keys[i])
+        {
+            keys[count++] = keys[i];
+        }
+    }
+    
+    return count;
+}
+
+static size_t test_string(char* string, uint64_t key)
+{
+    return (size_t) snprintf(string, TEST_STRING_SIZE, "key-%016llx", (unsigned long long) key);
+}
+
+static void test_verify(gnt_trie_t* trie, gnt_flags_t flags, const uint64_t* keys, size_t count, const bool* integers, const bool* strings)
+{
+    char string[TEST_STRING_SIZE];
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(gnt_search_u64(trie, keys[i]) == (integers[i] ? (gnt_data_t) i + 1 : 0), flags);
+        TEST_CHECK(gnt_search_bytes(trie, string, length) == (strings[i] ? (gnt_data_t) (i + 1 + TEST_KEYS) : 0), flags);
+    }
+}
+
+static void test_shape(gnt_trie_t* trie, gnt_flags_t flags)
+{
+    // Pruning must leave the shape a trie loaded with only the surviving keys has
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags & ~GNT_FLAG_LAZY_DELETE;
+    gnt_trie_t* fresh = gnt_create(&cfg);
+    gnt_cursor_t cursor;
+    gnt_stats_t pruned;
+    gnt_stats_t loaded;
+    size_t count = 0;
+    
+    TEST_CHECK(fresh, flags);
+    TEST_CHECK(0 == gnt_cursor_init(&cursor, trie), flags);
+    
+    while (0 == gnt_next(&cursor))
+    {
+        TEST_CHECK(0 == gnt_insert_bytes(fresh, cursor.key, cursor.length, cursor.data), flags);
+        count++;
+    }
+    
+    TEST_CHECK(0 == gnt_stats(trie, &pruned, true), flags);
+    TEST_CHECK(0 == gnt_stats(fresh, &loaded, true), flags);
+    TEST_CHECK(pruned.values == count && loaded.values == count, flags);
+    
+    // Merges after a delete only shorten the chain they touch, so compressed shapes depend on history
+    if (!(flags & GNT_FLAG_COMPRESS))
+    {
+        TEST_CHECK(pruned.nodes == loaded.nodes, flags);
+        TEST_CHECK(pruned.nibbles == loaded.nibbles, flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(fresh), flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t keys[TEST_KEYS];
+    bool integers[TEST_KEYS] = {0};
+    bool strings[TEST_KEYS] = {0};
+    char string[TEST_STRING_SIZE];
+    uint64_t seed = flags + 1;
+    size_t count = test_keys(keys, seed);
+    size_t stored = 0;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_stats_t stats;
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(-1 == gnt_delete_u64(trie, 12345), flags);
+    TEST_CHECK(-1 == gnt_delete_bytes(trie, "zz", 2), flags);
+    test_released = 0;
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(0 == gnt_insert_u64(trie, keys[i], (gnt_data_t) i + 1), flags);
+        TEST_CHECK(0 == gnt_insert_bytes(trie, string, length, (gnt_data_t) (i + 1 + TEST_KEYS)), flags);
+        integers[i] = strings[i] = true;
+        stored += 2;
+    }
+    
+    for (uint8_t round = 0; round < TEST_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t length = test_string(string, keys[i]);
+            
+            if (test_random(&seed) % 2)
+            {
+                TEST_CHECK(gnt_delete_u64(trie, keys[i]) == (integers[i] ? 0 : -1), flags);
+                TEST_CHECK(gnt_delete_bytes(trie, string, length) == (strings[i] ? 0 : -1), flags);
+                integers[i] = strings[i] = false;
+            }
+            else
+            {
+                TEST_CHECK(0 == gnt_insert_u64(trie, keys[i], (gnt_data_t) i + 1), flags);
+                integers[i] = true;
+                stored++;
+            }
+        }
+        
+        // Compaction in small budgets and partial passes interleaved with further deletes
+        if (1 == round)
+        {
+            gnt_status_t status;
+            
+            while (1 == (status = gnt_compact(trie, 100)));
+            
+            TEST_CHECK(0 == status, flags);
+        }
+        else if (2 == round)
+        {
+            TEST_CHECK(-1 != gnt_compact(trie, 37), flags);
+        }
+        
+        test_verify(trie, flags, keys, count, integers, strings);
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    test_verify(trie, flags, keys, count, integers, strings);
+    test_shape(trie, flags);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(gnt_delete_u64(trie, keys[i]) == (integers[i] ? 0 : -1), flags);
+        TEST_CHECK(gnt_delete_bytes(trie, string, length) == (strings[i] ? 0 : -1), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+    TEST_CHECK(0 == stats.nodes && 0 == stats.nibbles && 0 == stats.values, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    TEST_CHECK(test_released == stored, flags);
+}
+
+int main(void)
+{
+    // Every combination of the flags that change the layout or the delete path
+    for (gnt_flags_t flags = 0; flags <= (GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_FIXED_WIDTH | GNT_FLAG_WIDE_ROOT | GNT_FLAG_LAZY_DELETE); flags++)
+    {
+        test_run(flags);
+    }
+    
+    puts("test_delete: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/*
+ * test_freeze.c - Generic Nibble Trie frozen trie tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 4000
+#define TEST_STRING_SIZE 24 // Longer than any integer key, so the two kinds never share a key
+
+static size_t test_released;
+
+static void test_deallocator(gnt_data_t data)
+{
+    (void) data;
+    test_released++;
+}
+
+static gnt_status_t test_rewrite(const gnt_byte_t* key, gnt_index_t length, gnt_data_t* data, void* context)
+{
+    (void) key;
+    (void) length;
+    (void) context;
+    (*data) += 2 * TEST_KEYS;
+    
+    return 0;
+}
+
+static void test_replace(gnt_data_t* data, bool found, void* context)
+{
+    (void) found;
+    (void) context;
+    *data = 1234;
+}
+
+static gnt_data_t test_conflict(const gnt_byte_t* key, gnt_index_t length, gnt_data_t kept, gnt_data_t incoming, void* context)
+{
+    (void) key;
+    (void) length;
+    (void) kept;
+    (void) context;
+    
+    return incoming;
+}
+
+static size_t test_string(char* string, uint64_t key)
+{
+    return (size_t) snprintf(string, TEST_STRING_SIZE, "key-%llx", (unsigned long long) key);
+}
+
+static void test_same(gnt_trie_t* frozen, gnt_trie_t* trie, const uint64_t* keys, gnt_flags_t flags)
+{
+    char string[TEST_STRING_SIZE];
+    gnt_data_t data[TEST_KEYS];
+    uint64_t found[(TEST_KEYS + 63) / 64];
+    gnt_cursor_t a;
+    gnt_cursor_t b;
+    gnt_stats_t x;
+    gnt_stats_t y;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        size_t length = test_string(string, keys[i]);
+        bool stored;
+        bool kept;
+        
+        TEST_CHECK(gnt_search_ex(frozen, (gnt_key_t) keys[i], &stored) == gnt_search_ex(trie, (gnt_key_t) keys[i], &kept), flags);
+        TEST_CHECK(stored == kept, flags);
+        TEST_CHECK(gnt_search_u64(frozen, keys[i]) == gnt_search_u64(trie, keys[i]), flags);
+        TEST_CHECK(gnt_search_bytes(frozen, string, length) == gnt_search_bytes(trie, string, length), flags);
+        TEST_CHECK(gnt_longest_prefix_bytes(frozen, string, length, NULL) == gnt_longest_prefix_bytes(trie, string, length, NULL), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_search_batch_u64(frozen, keys, data, found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(data[i] == gnt_search_u64(trie, keys[i]), flags);
+        TEST_CHECK(!!(found[i / 64] >> (i % 64) & 1) == !!data[i], flags);
+    }
+    
+    TEST_CHECK(0 == gnt_cursor_init(&a, frozen) && 0 == gnt_cursor_init(&b, trie), flags);
+    
+    while (0 == gnt_next(&b))
+    {
+        TEST_CHECK(0 == gnt_next(&a), flags);
+        TEST_CHECK(a.length == b.length && 0 == memcmp(a.key, b.key, a.length) && a.data == b.data, flags);
+    }
+    
+    TEST_CHECK(-1 == gnt_next(&a), flags);
+    
+    TEST_CHECK(0 == gnt_stats(frozen, &x, true) && 0 == gnt_stats(trie, &y, true), flags);
+    TEST_CHECK(x.values == y.values && x.nodes == y.nodes && x.nibbles == y.nibbles && x.max_depth == y.max_depth, flags);
+}
+
+static void test_rejects(gnt_trie_t* frozen, gnt_trie_t* trie, const uint64_t* keys, gnt_flags_t flags)
+{
+    // Every write fails on the frozen copy and leaves it as it was
+    char string[TEST_STRING_SIZE];
+    size_t length = test_string(string, keys[0]);
+    gnt_key_t batch[2] = {(gnt_key_t) keys[0], (gnt_key_t) keys[1]};
+    gnt_data_t data[2] = {1234, 1235};
+    bool found[2];
+    
+    TEST_CHECK(-1 == gnt_insert(frozen, (gnt_key_t) keys[0], 1234), flags);
+    TEST_CHECK(-1 == gnt_insert_u64(frozen, keys[0] + 1, 1234), flags);
+    TEST_CHECK(-1 == gnt_insert_bytes(frozen, "new", 3, 1234), flags);
+    TEST_CHECK(-1 == gnt_update(frozen, (gnt_key_t) keys[1], test_replace, NULL), flags);
+    TEST_CHECK(-1 == gnt_delete_u64(frozen, keys[0]), flags);
+    TEST_CHECK(-1 == gnt_delete_bytes(frozen, string, length), flags);
+    TEST_CHECK(-1 == gnt_insert_batch(frozen, batch, data, 2), flags);
+    TEST_CHECK(-1 == gnt_bulk_load(frozen, batch, data, 2), flags);
+    TEST_CHECK(-1 == gnt_delete_batch(frozen, batch, found, 2), flags);
+    TEST_CHECK(-1 == gnt_foreach(frozen, test_rewrite, NULL), flags);
+    TEST_CHECK(-1 == gnt_merge(frozen, trie, test_conflict, NULL), flags);
+    TEST_CHECK(-1 == gnt_difference(frozen, trie), flags);
+    TEST_CHECK(-1 == gnt_clear(frozen), flags);
+    TEST_CHECK(!gnt_snapshot(frozen), flags);
+    test_same(frozen, trie, keys, flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t keys[TEST_KEYS];
+    char string[TEST_STRING_SIZE];
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_trie_t* frozen;
+    gnt_stats_t packed;
+    gnt_stats_t stats;
+    
+    TEST_CHECK(trie, flags);
+    
+    // An empty trie freezes into an empty copy
+    TEST_CHECK(frozen = gnt_freeze(trie), flags);
+    TEST_CHECK(0 == gnt_search_u64(frozen, 1) && -1 == gnt_insert_u64(frozen, 1, 1), flags);
+    TEST_CHECK(0 == gnt_destroy(frozen), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        keys[i] = (test_random(&seed) >> (i % 64)) / TEST_KEYS * TEST_KEYS + i;
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(0 == gnt_insert_u64(trie, keys[i], (gnt_data_t) i + 1), flags);
+        TEST_CHECK(0 == gnt_insert_bytes(trie, string, length, (gnt_data_t) (i + 1 + TEST_KEYS)), flags);
+        
+        if (0 == test_random(&seed) % 4)
+        {
+            TEST_CHECK(0 == gnt_delete_u64(trie, keys[i]), flags);
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(frozen = gnt_freeze(trie), flags);
+    test_same(frozen, trie, keys, flags);
+    test_rejects(frozen, trie, keys, flags);
+    
+    // The packed copy holds the same shape in less memory than the slabs of the trie
+    TEST_CHECK(0 == gnt_stats(frozen, &packed, false) && 0 == gnt_stats(trie, &stats, false), flags);
+    TEST_CHECK(packed.bytes < stats.bytes, flags);
+    
+    // Changes to the trie are only seen by a copy frozen after them
+    gnt_trie_t* before = gnt_freeze(frozen);
+    
+    TEST_CHECK(before, flags);
+    test_same(before, frozen, keys, flags);
+    TEST_CHECK(0 == gnt_foreach(trie, test_rewrite, NULL), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i += 3)
+    {
+        TEST_CHECK(0 == gnt_insert_u64(trie, keys[i], (gnt_data_t) i + 1), flags);
+    }
+    
+    test_same(before, frozen, keys, flags);
+    TEST_CHECK(0 == gnt_destroy(frozen), flags);
+    TEST_CHECK(frozen = gnt_freeze(trie), flags);
+    test_same(frozen, trie, keys, flags);
+    
+    // The source keeps owning the data, its copies never release any
+    size_t released = test_released;
+    
+    TEST_CHECK(0 == gnt_destroy(frozen) && 0 == gnt_destroy(before), flags);
+    TEST_CHECK(test_released == released, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS,
+        GNT_FLAG_LAZY_DELETE
+    };
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_freeze: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+ * test_hint.c - Generic Nibble Trie hint tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 3000
+#define TEST_STEPS 60000
+#define TEST_STRING_SIZE 12
+
+static char test_strings[TEST_KEYS][TEST_STRING_SIZE];
+static size_t test_lengths[TEST_KEYS];
+static gnt_data_t test_model[TEST_KEYS];
+
+static void test_stale(gnt_flags_t flags)
+{
+    // Slots of the path kept by a hint move once their nibble or node is reallocated, the hint then starts over
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_hint_t hint;
+    gnt_byte_t key[3] = {'k', 0, 'x'};
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_hint_init(&hint, trie), flags);
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, key, 2, 100), flags);
+    TEST_CHECK(100 == gnt_hint_search_bytes(&hint, key, 2), flags);
+    
+    // Every sibling grows the nibbles and nodes along the path of the hint
+    for (gnt_data_t i = 1; i < 128; i++)
+    {
+        key[1] = (gnt_byte_t) i;
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, 2, 100 + i), flags);
+        TEST_CHECK(100 + i == gnt_hint_search_bytes(&hint, key, 2), flags);
+        key[1] = (gnt_byte_t) (i - 1);
+        TEST_CHECK(100 + i - 1 == gnt_hint_search_bytes(&hint, key, 2), flags);
+    }
+    
+    // Deletes shrink and release them again, the hint still finds the keys left
+    for (gnt_data_t i = 127; i > 0; i--)
+    {
+        key[1] = (gnt_byte_t) i;
+        TEST_CHECK(0 == gnt_delete_bytes(trie, key, 2), flags);
+        TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+        TEST_CHECK(0 == gnt_hint_search_bytes(&hint, key, 2), flags);
+        key[1] = (gnt_byte_t) (i - 1);
+        TEST_CHECK(100 + i - 1 == gnt_hint_search_bytes(&hint, key, 2), flags);
+    }
+    
+    // Inserts go through the new path, even once the node they resumed from was released
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, key, 3, 7), flags);
+    TEST_CHECK(0 == gnt_delete_bytes(trie, key, 2), flags);
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(7 == gnt_hint_search_bytes(&hint, key, 3) && 0 == gnt_hint_search_bytes(&hint, key, 2), flags);
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, key, 2, 8), flags);
+    TEST_CHECK(8 == gnt_search_bytes(trie, key, 2) && 7 == gnt_search_bytes(trie, key, 3), flags);
+    
+    // A clear releases the whole path
+    TEST_CHECK(0 == gnt_clear(trie), flags);
+    TEST_CHECK(0 == gnt_hint_search_bytes(&hint, key, 3), flags);
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, "k01", 3, 9), flags);
+    TEST_CHECK(9 == gnt_search_bytes(trie, "k01", 3) && 0 == gnt_hint_search_bytes(&hint, key, 2), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+static void test_snapshot(gnt_flags_t flags)
+{
+    // A path taken by a search runs through nodes a snapshot still shares, inserts through it must copy them
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_hint_t hint;
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_hint_init(&hint, trie), flags);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "snap", 4, 1), flags);
+    TEST_CHECK(1 == gnt_hint_search_bytes(&hint, "snap", 4), flags);
+    
+    gnt_trie_t* snapshot = gnt_snapshot(trie);
+    
+    TEST_CHECK(snapshot, flags);
+    TEST_CHECK(1 == gnt_hint_search_bytes(&hint, "snap", 4), flags);
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, "snap", 4, 2), flags);
+    TEST_CHECK(0 == gnt_hint_insert_bytes(&hint, "snaps", 5, 3), flags);
+    TEST_CHECK(2 == gnt_search_bytes(trie, "snap", 4) && 3 == gnt_search_bytes(trie, "snaps", 5), flags);
+    TEST_CHECK(1 == gnt_search_bytes(snapshot, "snap", 4) && 0 == gnt_search_bytes(snapshot, "snaps", 5), flags);
+    TEST_CHECK(0 == gnt_destroy(snapshot), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    // Two hints walk the keys in small steps, mostly upwards, among plain writes that keep voiding their paths
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_hint_t hints[2];
+    size_t positions[2] = {0, TEST_KEYS / 2};
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_hint_init(&hints[0], trie) && 0 == gnt_hint_init(&hints[1], trie), flags);
+    memset(test_model, 0, sizeof(test_model));
+    
+    for (size_t step = 0; step < TEST_STEPS; step++)
+    {
+        uint8_t side = test_random(&seed) % 2;
+        size_t index = positions[side] = (positions[side] + test_random(&seed) % 4 + TEST_KEYS - 1) % TEST_KEYS;
+        const char* key = test_strings[index];
+        size_t length = test_lengths[index];
+        gnt_data_t data = (gnt_data_t) (step + 1);
+        
+        switch (test_random(&seed) % 8)
+        {
+            case 0:
+            case 1:
+                TEST_CHECK(0 == gnt_hint_insert_bytes(&hints[side], key, length, data), flags);
+                test_model[index] = data;
+                break;
+            case 2:
+                TEST_CHECK(0 == gnt_insert_bytes(trie, key, length, data), flags);
+                test_model[index] = data;
+                break;
+            case 3:
+                TEST_CHECK(gnt_delete_bytes(trie, key, length) == (test_model[index] ? 0 : -1), flags);
+                test_model[index] = 0;
+                break;
+            case 4:
+                TEST_CHECK(-1 != gnt_compact(trie, 16), flags);
+                break;
+            default:
+                TEST_CHECK(gnt_hint_search_bytes(&hints[side], key, length) == test_model[index], flags);
+                break;
+        }
+    }
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(gnt_search_bytes(trie, test_strings[i], test_lengths[i]) == test_model[i], flags);
+        TEST_CHECK(gnt_hint_search_bytes(&hints[i % 2], test_strings[i], test_lengths[i]) == test_model[i], flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+static void test_integers(gnt_flags_t flags)
+{
+    // Ascending integer keys through a hint, then searched again through a fresh one
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_hint_t hint;
+    uint64_t key = 0;
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_hint_init(&hint, trie), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        key += 1 + test_random(&seed) % 300;
+        TEST_CHECK(0 == gnt_hint_insert_u64(&hint, key, (gnt_data_t) i + 1), flags);
+        TEST_CHECK((gnt_data_t) i + 1 == gnt_hint_search_u64(&hint, key), flags);
+        TEST_CHECK(0 == gnt_hint_search_u64(&hint, key + 1), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_hint_init(&hint, trie), flags);
+    key = 0;
+    seed = flags + 1;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        key += 1 + test_random(&seed) % 300;
+        TEST_CHECK((gnt_data_t) i + 1 == gnt_hint_search_u64(&hint, key), flags);
+        TEST_CHECK(gnt_search_u64(trie, key) == (gnt_data_t) i + 1, flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_FIXED_WIDTH,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS | GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS
+    };
+    
+    // Keys sharing long prefixes, so that most steps resume deep into the path of the previous one
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        test_lengths[i] = (size_t) snprintf(test_strings[i], TEST_STRING_SIZE, "k%02zu/%02zu/%u", i / 100, i % 100, (unsigned) (test_random(&seed) % 1000));
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_stale(flags[i]);
+        test_snapshot(flags[i]);
+        test_run(flags[i]);
+        test_integers(flags[i]);
+    }
+    
+    puts("test_hint: ok");
+    
+    return EXIT_SUCCESS;
+}
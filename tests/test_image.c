@@ -0,0 +1,252 @@
+/*
+ * test_image.c - Generic Nibble Trie saved and mapped image tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 4000
+#define TEST_PATH_SIZE 64
+#define TEST_STRING_SIZE 24 // Longer than any integer key, so the two kinds never share a key
+
+static char test_image[TEST_PATH_SIZE];
+static char test_copy[TEST_PATH_SIZE];
+static size_t test_released;
+
+static void test_deallocator(gnt_data_t data)
+{
+    (void) data;
+    test_released++;
+}
+
+static gnt_status_t test_rewrite(const gnt_byte_t* key, gnt_index_t length, gnt_data_t* data, void* context)
+{
+    (void) key;
+    (void) length;
+    (void) context;
+    (*data)++;
+    
+    return 0;
+}
+
+static size_t test_string(char* string, uint64_t key)
+{
+    return (size_t) snprintf(string, TEST_STRING_SIZE, "key-%llx", (unsigned long long) key);
+}
+
+static void test_save(gnt_trie_t* trie, const char* path, gnt_flags_t flags)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    
+    TEST_CHECK(fd >= 0, flags);
+    TEST_CHECK(0 == gnt_save(trie, fd), flags);
+    TEST_CHECK(0 == close(fd), flags);
+}
+
+static void test_same(gnt_trie_t* mapped, gnt_trie_t* trie, const uint64_t* keys, const bool* stored, gnt_flags_t flags)
+{
+    char string[TEST_STRING_SIZE];
+    gnt_cursor_t a;
+    gnt_cursor_t b;
+    gnt_stats_t x;
+    gnt_stats_t y;
+    gnt_index_t matched;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(gnt_search_u64(mapped, keys[i]) == (stored[i] ? (gnt_data_t) i + 1 : 0), flags);
+        TEST_CHECK(gnt_search_bytes(mapped, string, length) == (stored[i] ? (gnt_data_t) (i + 1 + TEST_KEYS) : 0), flags);
+        TEST_CHECK(gnt_longest_prefix_bytes(mapped, string, length, &matched) == gnt_longest_prefix_bytes(trie, string, length, NULL), flags);
+    }
+    
+    // Walks see the same keys in the same order
+    TEST_CHECK(0 == gnt_cursor_init(&a, mapped) && 0 == gnt_cursor_init(&b, trie), flags);
+    
+    while (0 == gnt_next(&b))
+    {
+        TEST_CHECK(0 == gnt_next(&a), flags);
+        TEST_CHECK(a.length == b.length && 0 == memcmp(a.key, b.key, a.length) && a.data == b.data, flags);
+    }
+    
+    TEST_CHECK(-1 == gnt_next(&a), flags);
+    TEST_CHECK(0 == gnt_seek_bytes(&a, "key-8", 5) && 0 == gnt_seek_bytes(&b, "key-8", 5), flags);
+    TEST_CHECK(a.data == b.data && 0 == gnt_prev(&a) && 0 == gnt_prev(&b) && a.data == b.data, flags);
+    TEST_CHECK(0 == gnt_stats(mapped, &x, true) && 0 == gnt_stats(trie, &y, true), flags);
+    TEST_CHECK(x.values == y.values && x.nodes == y.nodes && x.nibbles == y.nibbles && x.max_depth == y.max_depth, flags);
+}
+
+static void test_refused(gnt_trie_t* trie, size_t offset, bool cut, gnt_flags_t flags)
+{
+    int fd = open(test_copy, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    gnt_trie_t* mapped;
+    
+    TEST_CHECK(fd >= 0, flags);
+    TEST_CHECK(0 == gnt_save(trie, fd), flags);
+    TEST_CHECK((mapped = gnt_open_mapped(test_copy, NULL)) && 0 == gnt_destroy(mapped), flags);
+    
+    if (cut)
+    {
+        TEST_CHECK(0 == ftruncate(fd, (off_t) offset), flags);
+    }
+    else
+    {
+        // Reverses a field of the header, as a host of the other byte order would read it
+        char field[4];
+        char reversed[4];
+        
+        TEST_CHECK(4 == pread(fd, field, 4, (off_t) offset), flags);
+        
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            reversed[i] = field[3 - i];
+        }
+        
+        TEST_CHECK(4 == pwrite(fd, reversed, 4, (off_t) offset), flags);
+    }
+    
+    TEST_CHECK(0 == close(fd), flags);
+    TEST_CHECK(!gnt_open_mapped(test_copy, NULL), flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t keys[TEST_KEYS];
+    bool stored[TEST_KEYS];
+    char string[TEST_STRING_SIZE];
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    
+    TEST_CHECK(trie, flags);
+    
+    // An empty trie saves an image that maps back to an empty trie
+    test_save(trie, test_image, flags);
+    gnt_trie_t* mapped = gnt_open_mapped(test_image, NULL);
+    TEST_CHECK(mapped, flags);
+    TEST_CHECK(0 == gnt_search_u64(mapped, 1), flags);
+    TEST_CHECK(0 == gnt_destroy(mapped), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        keys[i] = (test_random(&seed) >> (i % 64)) / TEST_KEYS * TEST_KEYS + i;
+        stored[i] = test_random(&seed) % 4;
+        size_t length = test_string(string, keys[i]);
+        
+        TEST_CHECK(0 == gnt_insert_u64(trie, keys[i], (gnt_data_t) i + 1), flags);
+        TEST_CHECK(0 == gnt_insert_bytes(trie, string, length, (gnt_data_t) (i + 1 + TEST_KEYS)), flags);
+        
+        // Deleted keys leave nothing behind in the image
+        if (!stored[i])
+        {
+            TEST_CHECK(0 == gnt_delete_u64(trie, keys[i]), flags);
+            TEST_CHECK(0 == gnt_delete_bytes(trie, string, length), flags);
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    test_save(trie, test_image, flags);
+    test_released = 0;
+    
+    // The flags that shape the image come from it, not from the configuration
+    gnt_cfg_t other = {0};
+    other.flags = flags ^ (GNT_FLAG_COMPRESS | GNT_FLAG_FIXED_WIDTH);
+    other.deallocator = test_deallocator;
+    mapped = gnt_open_mapped(test_image, &other);
+    TEST_CHECK(mapped, flags);
+    test_same(mapped, trie, keys, stored, flags);
+    
+    // An image saved from the mapping holds the same trie
+    test_save(mapped, test_copy, flags);
+    gnt_trie_t* copy = gnt_open_mapped(test_copy, NULL);
+    TEST_CHECK(copy, flags);
+    test_same(copy, trie, keys, stored, flags);
+    TEST_CHECK(0 == gnt_destroy(copy), flags);
+    
+    // Mappings are read-only, every write fails and leaves them as they were
+    size_t length = test_string(string, keys[0]);
+    
+    TEST_CHECK(-1 == gnt_insert_u64(mapped, keys[0], 1234), flags);
+    TEST_CHECK(-1 == gnt_insert_bytes(mapped, "new", 3, 1234), flags);
+    TEST_CHECK(-1 == gnt_delete_bytes(mapped, string, length), flags);
+    TEST_CHECK(-1 == gnt_foreach(mapped, test_rewrite, NULL), flags);
+    TEST_CHECK(-1 == gnt_clear(mapped), flags);
+    TEST_CHECK(-1 == gnt_checkpoint(mapped, test_copy), flags);
+    test_same(mapped, trie, keys, stored, flags);
+    
+    // The image is apart from the trie, which keeps changing and keeps owning the data
+    TEST_CHECK(0 == gnt_foreach(trie, test_rewrite, NULL), flags);
+    TEST_CHECK(gnt_search_bytes(mapped, string, length) == (stored[0] ? (gnt_data_t) 1 + TEST_KEYS : 0), flags);
+    TEST_CHECK(0 == gnt_destroy(mapped), flags);
+    TEST_CHECK(0 == test_released, flags);
+    
+    // Images of another byte order, with another magic or cut short are not opened
+    test_refused(trie, 4, false, flags);
+    test_refused(trie, 0, false, flags);
+    test_refused(trie, 100, true, flags);
+    test_refused(trie, 4, true, flags);
+    unlink(test_copy);
+    TEST_CHECK(!gnt_open_mapped(test_copy, NULL), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    char directory[] = "/tmp/gnt_image_XXXXXX";
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_FIXED_WIDTH,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS | GNT_FLAG_SHARDED,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_RWLOCK,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS
+    };
+    
+    TEST_CHECK(mkdtemp(directory), 0);
+    snprintf(test_image, sizeof(test_image), "%s/image", directory);
+    snprintf(test_copy, sizeof(test_copy), "%s/copy", directory);
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    unlink(test_image);
+    unlink(test_copy);
+    rmdir(directory);
+    puts("test_image: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*
+ * test_integers.c - Generic Nibble Trie integer batch search tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 5000
+#define TEST_QUERIES (2 * TEST_KEYS + 3) // Stored and missing keys, in a count that leaves a partial group and word
+
+static uint64_t test_wide[TEST_QUERIES];
+static uint32_t test_narrow[TEST_QUERIES];
+static gnt_data_t test_data[TEST_QUERIES];
+static uint64_t test_found[(TEST_QUERIES + 63) / 64];
+
+static uint64_t test_key(uint64_t* seed)
+{
+    // Keys of every length, with runs of zero and full nibbles the vector extraction must keep apart
+    uint64_t key = test_random(seed) >> (test_random(seed) % 64);
+    
+    switch (test_random(seed) % 4)
+    {
+        case 0: return key & 0xF0F0F0F0F0F0F0F0u;
+        case 1: return key | 0x0F000000000000F0u;
+        case 2: return key & 0xFFFF;
+        default: return key;
+    }
+}
+
+static void test_compare(gnt_trie_t* trie, size_t count, gnt_flags_t flags)
+{
+    // Every key is found as the one at a time search finds it, and groups cut short by the count still are
+    TEST_CHECK(0 == gnt_search_batch_u64(trie, test_wide, test_data, test_found, count), flags);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        gnt_data_t data = gnt_search_u64(trie, test_wide[i]);
+        
+        TEST_CHECK(test_data[i] == data, flags);
+        TEST_CHECK(!!(test_found[i / 64] >> (i % 64) & 1) == !!data, flags);
+    }
+    
+    // Bits past the count are cleared, so the mask can be counted whole
+    if (count % 64)
+    {
+        TEST_CHECK(0 == test_found[count / 64] >> (count % 64), flags);
+    }
+    
+    memset(test_found, 0xFF, sizeof(test_found));
+    TEST_CHECK(0 == gnt_search_batch_u32(trie, test_narrow, test_data, test_found, count), flags);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        gnt_data_t data = gnt_search_u32(trie, test_narrow[i]);
+        
+        TEST_CHECK(test_data[i] == data, flags);
+        TEST_CHECK(!!(test_found[i / 64] >> (i % 64) & 1) == !!data, flags);
+    }
+    
+    if (count % 64)
+    {
+        TEST_CHECK(0 == test_found[count / 64] >> (count % 64), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_search_batch_u64(trie, test_wide, test_data, NULL, count), flags);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        TEST_CHECK(test_data[i] == gnt_search_u64(trie, test_wide[i]), flags);
+    }
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_search_batch_u64(trie, NULL, NULL, NULL, 0), flags);
+    TEST_CHECK(-1 == gnt_search_batch_u64(trie, test_wide, NULL, NULL, 1), flags);
+    TEST_CHECK(-1 == gnt_search_batch_u32(NULL, test_narrow, test_data, NULL, 1), flags);
+    
+    // Both widths share the trie, the queries mix stored keys with others that are not
+    for (size_t i = 0; i < TEST_QUERIES; i++)
+    {
+        test_wide[i] = test_key(&seed);
+        test_narrow[i] = (uint32_t) test_key(&seed);
+        
+        if (i < TEST_KEYS)
+        {
+            TEST_CHECK(0 == gnt_insert_u64(trie, test_wide[i], (gnt_data_t) i + 1), flags);
+            TEST_CHECK(0 == gnt_insert_u32(trie, test_narrow[i], (gnt_data_t) (i + 1 + TEST_QUERIES)), flags);
+        }
+    }
+    
+    test_compare(trie, 0, flags);
+    
+    for (size_t count = 1; count <= 17; count++)
+    {
+        test_compare(trie, count, flags);
+    }
+    
+    test_compare(trie, TEST_QUERIES, flags);
+    
+    // Keys deleted after a snapshot are still found in it, frozen copies answer as the trie does
+    gnt_trie_t* snapshot = gnt_snapshot(trie);
+    
+    TEST_CHECK(snapshot, flags);
+    
+    // Random keys may repeat, so a delete can find its key gone already
+    for (size_t i = 0; i < TEST_KEYS; i += 2)
+    {
+        gnt_delete_u64(trie, test_wide[i]);
+        gnt_delete_u32(trie, test_narrow[i]);
+    }
+    
+    test_compare(trie, TEST_QUERIES, flags);
+    test_compare(snapshot, TEST_QUERIES, flags);
+    TEST_CHECK(0 == gnt_search_batch_u64(snapshot, test_wide, test_data, test_found, TEST_KEYS), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(test_data[i] != 0 && (test_found[i / 64] >> (i % 64) & 1), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_destroy(snapshot), flags);
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    
+    gnt_trie_t* frozen = gnt_freeze(trie);
+    
+    TEST_CHECK(frozen, flags);
+    test_compare(frozen, TEST_QUERIES, flags);
+    TEST_CHECK(0 == gnt_destroy(frozen), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_FIXED_WIDTH,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS,
+        GNT_FLAG_WIDE_ROOT,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS
+    };
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_integers: ok");
+    
+    return EXIT_SUCCESS;
+}
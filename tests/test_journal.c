@@ -0,0 +1,240 @@
+/*
+ * test_journal.c - Generic Nibble Trie journal and recovery tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 3000
+#define TEST_PATH_SIZE 64
+#define TEST_LAST "last" // Key of the record damaged at the end of the log
+#define TEST_LAST_RECORD (1 + 4 + 4 + sizeof(gnt_data_t) + 4) // Kind, key length, key, data and checksum
+
+static char test_log[TEST_PATH_SIZE];
+static char test_image[TEST_PATH_SIZE];
+
+static size_t test_key(char* key, size_t index)
+{
+    return (size_t) snprintf(key, 32, "k%zu", index * 2654435761u % 1000003);
+}
+
+static void test_verify(gnt_trie_t* trie, const gnt_data_t* model, gnt_data_t last, gnt_flags_t flags)
+{
+    char key[32];
+    gnt_stats_t stats;
+    size_t values = 0;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(gnt_search_bytes(trie, key, test_key(key, i)) == model[i], flags);
+        values += !!model[i];
+    }
+    
+    TEST_CHECK(gnt_search_bytes(trie, TEST_LAST, strlen(TEST_LAST)) == last, flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+    TEST_CHECK(stats.values == values + !!last, flags);
+}
+
+static gnt_trie_t* test_recover(gnt_flags_t flags, const char* image)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.journal = test_log;
+    
+    return gnt_recover(image, &cfg);
+}
+
+static void test_damage(gnt_flags_t flags, bool torn)
+{
+    struct stat info;
+    
+    TEST_CHECK(0 == stat(test_log, &info), flags);
+    
+    if (torn)
+    {
+        // A crash in the middle of the last write leaves only part of its record
+        TEST_CHECK(0 == truncate(test_log, info.st_size - 5), flags);
+    }
+    else
+    {
+        // Flips a byte of the data, which only the checksum catches
+        int fd = open(test_log, O_RDWR);
+        char byte;
+        
+        TEST_CHECK(fd >= 0, flags);
+        TEST_CHECK(1 == pread(fd, &byte, 1, info.st_size - 5), flags);
+        byte ^= 0x5A;
+        TEST_CHECK(1 == pwrite(fd, &byte, 1, info.st_size - 5), flags);
+        TEST_CHECK(0 == close(fd), flags);
+    }
+}
+
+static void test_run(gnt_flags_t flags, size_t journal_bytes)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.journal = test_log;
+    cfg.journal_bytes = journal_bytes;
+    gnt_data_t model[TEST_KEYS] = {0};
+    char key[32];
+    
+    unlink(test_log);
+    unlink(test_image);
+    
+    gnt_trie_t* trie = gnt_create(&cfg);
+    TEST_CHECK(trie, flags);
+    
+    // Writes before the checkpoint are kept by the image, those after it by the log
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        model[i] = i + 1;
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), model[i]), flags);
+    }
+    
+    for (size_t i = 0; i < TEST_KEYS; i += 3)
+    {
+        model[i] = 0;
+        TEST_CHECK(0 == gnt_delete_bytes(trie, key, test_key(key, i)), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_checkpoint(trie, test_image), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i += 2)
+    {
+        model[i] = i + 1 + TEST_KEYS;
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), model[i]), flags);
+    }
+    
+    for (size_t i = 1; i < TEST_KEYS; i += 5)
+    {
+        if (model[i])
+        {
+            TEST_CHECK(0 == gnt_delete_bytes(trie, key, test_key(key, i)), flags);
+            model[i] = 0;
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_sync(trie), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    // A log that still holds records must be recovered, not started over
+    TEST_CHECK(!gnt_create(&cfg), flags);
+    
+    trie = test_recover(flags, test_image);
+    TEST_CHECK(trie, flags);
+    test_verify(trie, model, 0, flags);
+    
+    // Recovery keeps appending to the log, clears are replayed too
+    TEST_CHECK(0 == gnt_clear(trie), flags);
+    memset(model, 0, sizeof(model));
+    
+    for (size_t i = 0; i < TEST_KEYS; i += 7)
+    {
+        model[i] = i + 1 + 2 * TEST_KEYS;
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), model[i]), flags);
+    }
+    
+    TEST_CHECK(0 == gnt_insert_bytes(trie, TEST_LAST, strlen(TEST_LAST), 99), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    trie = test_recover(flags, test_image);
+    TEST_CHECK(trie, flags);
+    test_verify(trie, model, 99, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    // A torn or corrupt last record is dropped along with anything after it, the log is cut there
+    for (uint8_t damage = 0; damage < 2; damage++)
+    {
+        struct stat before;
+        struct stat after;
+        
+        test_damage(flags, 0 == damage);
+        TEST_CHECK(0 == stat(test_log, &before), flags);
+        trie = test_recover(flags, test_image);
+        TEST_CHECK(trie, flags);
+        test_verify(trie, model, 0, flags);
+        TEST_CHECK(0 == gnt_insert_bytes(trie, TEST_LAST, strlen(TEST_LAST), 100 + damage), flags);
+        TEST_CHECK(0 == gnt_destroy(trie), flags);
+        TEST_CHECK(0 == stat(test_log, &after), flags);
+        
+        // The new record replaces the damaged one
+        size_t kept = (size_t) before.st_size - (0 == damage ? TEST_LAST_RECORD - 5 : TEST_LAST_RECORD);
+        TEST_CHECK((size_t) after.st_size == kept + TEST_LAST_RECORD, flags);
+        
+        trie = test_recover(flags, test_image);
+        TEST_CHECK(trie, flags);
+        test_verify(trie, model, (gnt_data_t) (100 + damage), flags);
+        TEST_CHECK(0 == gnt_destroy(trie), flags);
+    }
+    
+    // Without the checkpoint the log alone starts from the clear it recorded
+    unlink(test_image);
+    trie = test_recover(flags, test_image);
+    TEST_CHECK(trie, flags);
+    test_verify(trie, model, 101, flags);
+    TEST_CHECK(0 == gnt_checkpoint(trie, test_image), flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    // An emptied log can start a new trie again
+    trie = gnt_create(&cfg);
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    char directory[] = "/tmp/gnt_journal_XXXXXX";
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS | GNT_FLAG_SHARDED,
+        GNT_FLAG_COMPRESS | GNT_FLAG_LAZY_DELETE | GNT_FLAG_WIDE_ROOT,
+        GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_COMBINING
+    };
+    
+    TEST_CHECK(mkdtemp(directory), 0);
+    snprintf(test_log, sizeof(test_log), "%s/log", directory);
+    snprintf(test_image, sizeof(test_image), "%s/image", directory);
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        // Synced on every write, then in groups of 4 KiB
+        test_run(flags[i], 0);
+        test_run(flags[i], 4096);
+    }
+    
+    unlink(test_log);
+    unlink(test_image);
+    rmdir(directory);
+    puts("test_journal: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,426 @@
+/*
+ * test_merge.c - Generic Nibble Trie merge, intersection and difference tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <threads.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_IDS 32768 // Data are unique ids, each must reach the deallocator exactly once
+#define TEST_KEY_SIZE 24
+#define TEST_LOCK_ROUNDS 20000
+
+typedef struct test_entry
+{
+    gnt_byte_t key[TEST_KEY_SIZE];
+    gnt_index_t length;
+    gnt_data_t data;
+} test_entry_t;
+
+typedef struct test_set // Reference model of a trie, sorted by key
+{
+    test_entry_t* entries;
+    size_t count;
+} test_set_t;
+
+typedef enum test_join
+{
+    TEST_MERGE,
+    TEST_INTERSECT,
+    TEST_DIFFERENCE
+} test_join_t;
+
+typedef struct test_check
+{
+    const test_set_t* set;
+    gnt_flags_t flags;
+    size_t seen;
+} test_check_t;
+
+static bool test_released[TEST_IDS];
+static gnt_data_t test_next;
+static uint64_t test_seed = 1;
+
+static void test_deallocator(gnt_data_t data)
+{
+    TEST_CHECK(data > 0 && data < TEST_IDS && !test_released[data], 0);
+    test_released[data] = true;
+}
+
+static int test_compare(const void* a, const void* b)
+{
+    const test_entry_t* x = a;
+    const test_entry_t* y = b;
+    int order = memcmp(x->key, y->key, x->length < y->length ? x->length : y->length);
+    
+    return order ? order : (int) x->length - (int) y->length;
+}
+
+static int test_compare_data(const void* a, const void* b)
+{
+    // Later inserts sort after earlier ones of the same key
+    int order = test_compare(a, b);
+    
+    return order ? order : (((const test_entry_t*) a)->data > ((const test_entry_t*) b)->data) - (((const test_entry_t*) a)->data < ((const test_entry_t*) b)->data);
+}
+
+static test_entry_t* test_find(const test_set_t* set, const gnt_byte_t* key, gnt_index_t length)
+{
+    test_entry_t entry = {{0}, length, 0};
+    memcpy(entry.key, key, length);
+    
+    return bsearch(&entry, set->entries, set->count, sizeof(test_entry_t), test_compare);
+}
+
+static void test_build(gnt_trie_t* trie, test_set_t* set, size_t count, const char* alphabet, gnt_index_t longest, gnt_flags_t flags)
+{
+    size_t letters = strlen(alphabet);
+    
+    set->entries = calloc(count ? count : 1, sizeof(test_entry_t));
+    set->count = 0;
+    TEST_CHECK(set->entries, flags);
+    
+    for (size_t i = 0; i < count; i++)
+    {
+        test_entry_t* entry = &set->entries[set->count++];
+        entry->length = (gnt_index_t) (1 + test_random(&test_seed) % longest);
+        entry->data = test_next++;
+        
+        for (gnt_index_t j = 0; j < entry->length; j++)
+        {
+            entry->key[j] = (gnt_byte_t) alphabet[test_random(&test_seed) % letters];
+        }
+        
+        TEST_CHECK(0 == gnt_insert_bytes(trie, entry->key, entry->length, entry->data), flags);
+    }
+    
+    // Only the last insert of each key stays in the trie
+    qsort(set->entries, set->count, sizeof(test_entry_t), test_compare_data);
+    count = 0;
+    
+    for (size_t i = 0; i < set->count; i++)
+    {
+        if (count && 0 == test_compare(&set->entries[count - 1], &set->entries[i]))
+        {
+            set->entries[count - 1] = set->entries[i];
+        }
+        else
+        {
+            set->entries[count++] = set->entries[i];
+        }
+    }
+    
+    set->count = count;
+}
+
+static gnt_status_t test_visit(const gnt_byte_t* key, gnt_index_t length, gnt_data_t data, void* context)
+{
+    test_check_t* check = context;
+    test_entry_t* entry = test_find(check->set, key, length);
+    
+    TEST_CHECK(entry && entry->data == data, check->flags);
+    check->seen++;
+    
+    return 0;
+}
+
+static void test_verify(gnt_trie_t* trie, const test_set_t* set, gnt_flags_t flags)
+{
+    test_check_t check = {set, flags, 0};
+    gnt_stats_t stats;
+    
+    TEST_CHECK(0 == gnt_prefix_foreach_bytes(trie, NULL, 0, test_visit, &check), flags);
+    TEST_CHECK(check.seen == set->count, flags);
+    
+    for (size_t i = 0; i < set->count; i++)
+    {
+        TEST_CHECK(gnt_search_bytes(trie, set->entries[i].key, set->entries[i].length) == set->entries[i].data, flags);
+    }
+    
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(stats.values == set->count, flags);
+}
+
+static gnt_data_t test_keep_smaller(const gnt_byte_t* key, gnt_index_t length, gnt_data_t kept, gnt_data_t incoming, void* context)
+{
+    (void) key;
+    (void) length;
+    (*(size_t*) context)++;
+    
+    return kept < incoming ? kept : incoming;
+}
+
+static void test_run(gnt_flags_t flags, const char* alphabet, gnt_index_t longest, size_t left, size_t right, test_join_t join)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* dst = gnt_create(&cfg);
+    gnt_trie_t* src = gnt_create(&cfg);
+    test_set_t a;
+    test_set_t b;
+    test_set_t result;
+    size_t conflicts = 0;
+    size_t expected = 0;
+    
+    TEST_CHECK(dst && src, flags);
+    memset(test_released, 0, sizeof(test_released));
+    test_next = 1;
+    test_build(dst, &a, left, alphabet, longest, flags);
+    test_build(src, &b, right, alphabet, longest, flags);
+    
+    // Leaves emptied nodes in both tries for the passes to skip
+    if (flags & GNT_FLAG_LAZY_DELETE)
+    {
+        size_t count = 0;
+        
+        for (size_t i = 0; i < a.count; i++)
+        {
+            if (i % 5)
+            {
+                a.entries[count++] = a.entries[i];
+            }
+            else
+            {
+                TEST_CHECK(0 == gnt_delete_bytes(dst, a.entries[i].key, a.entries[i].length), flags);
+            }
+        }
+        
+        a.count = count;
+        count = 0;
+        
+        for (size_t i = 0; i < b.count; i++)
+        {
+            if (i % 7 != 1)
+            {
+                b.entries[count++] = b.entries[i];
+            }
+            else
+            {
+                TEST_CHECK(0 == gnt_delete_bytes(src, b.entries[i].key, b.entries[i].length), flags);
+            }
+        }
+        
+        b.count = count;
+    }
+    
+    test_verify(dst, &a, flags);
+    test_verify(src, &b, flags);
+    result.entries = calloc(a.count + b.count + 1, sizeof(test_entry_t));
+    result.count = 0;
+    TEST_CHECK(result.entries, flags);
+    
+    if (TEST_MERGE == join)
+    {
+        for (size_t i = 0; i < a.count; i++)
+        {
+            test_entry_t* other = test_find(&b, a.entries[i].key, a.entries[i].length);
+            result.entries[result.count] = a.entries[i];
+            
+            if (other)
+            {
+                expected++;
+                
+                if (other->data < a.entries[i].data)
+                {
+                    result.entries[result.count].data = other->data;
+                }
+            }
+            
+            result.count++;
+        }
+        
+        for (size_t i = 0; i < b.count; i++)
+        {
+            if (!test_find(&a, b.entries[i].key, b.entries[i].length))
+            {
+                result.entries[result.count++] = b.entries[i];
+            }
+        }
+        
+        qsort(result.entries, result.count, sizeof(test_entry_t), test_compare);
+        TEST_CHECK(0 == gnt_merge(dst, src, test_keep_smaller, &conflicts), flags);
+        TEST_CHECK(conflicts == expected, flags);
+        
+        // Merging moves every key out of src
+        free(b.entries);
+        b.entries = NULL;
+        b.count = 0;
+    }
+    else
+    {
+        // Intersections keep the keys of dst also in src, differences the others
+        for (size_t i = 0; i < a.count; i++)
+        {
+            if ((NULL != test_find(&b, a.entries[i].key, a.entries[i].length)) == (TEST_INTERSECT == join))
+            {
+                result.entries[result.count++] = a.entries[i];
+            }
+        }
+        
+        TEST_CHECK(0 == (TEST_INTERSECT == join ? gnt_intersect(dst, src) : gnt_difference(dst, src)), flags);
+    }
+    
+    test_verify(dst, &result, flags);
+    test_verify(src, &b, flags);
+    
+    // Both tries stay usable
+    TEST_CHECK(0 == gnt_insert_bytes(dst, "zz-extra", 8, test_next++), flags);
+    TEST_CHECK(0 == gnt_insert_bytes(src, "zz-extra", 8, test_next++), flags);
+    TEST_CHECK(0 == gnt_destroy(dst), flags);
+    TEST_CHECK(0 == gnt_destroy(src), flags);
+    
+    for (gnt_data_t id = 1; id < test_next; id++)
+    {
+        TEST_CHECK(test_released[id], flags);
+    }
+    
+    free(a.entries);
+    free(b.entries);
+    free(result.entries);
+}
+
+static void test_refusals(void)
+{
+    gnt_cfg_t plain = {0};
+    gnt_cfg_t compressed = {0};
+    gnt_cfg_t fixed = {0};
+    compressed.flags = GNT_FLAG_COMPRESS;
+    fixed.flags = GNT_FLAG_FIXED_WIDTH;
+    gnt_trie_t* x = gnt_create(&plain);
+    gnt_trie_t* y = gnt_create(&compressed);
+    gnt_trie_t* z = gnt_create(&fixed);
+    
+    TEST_CHECK(x && y && z, 0);
+    
+    // Merges need the same layout in both tries, and two distinct tries
+    TEST_CHECK(-1 == gnt_merge(x, y, NULL, NULL), 0);
+    TEST_CHECK(-1 == gnt_merge(x, z, NULL, NULL), 0);
+    TEST_CHECK(-1 == gnt_merge(z, x, NULL, NULL), 0);
+    TEST_CHECK(-1 == gnt_merge(x, x, NULL, NULL), 0);
+    TEST_CHECK(0 == gnt_intersect(x, y), 0);
+    
+    // Filters only read src, but dst must be writable
+    TEST_CHECK(0 == gnt_insert_bytes(x, "a", 1, 1), 0);
+    gnt_trie_t* snapshot = gnt_snapshot(x);
+    TEST_CHECK(snapshot, 0);
+    TEST_CHECK(-1 == gnt_intersect(x, y), 0);
+    TEST_CHECK(-1 == gnt_merge(y, snapshot, NULL, NULL), 0);
+    TEST_CHECK(-1 == gnt_difference(snapshot, y), 0);
+    TEST_CHECK(0 == gnt_insert_bytes(y, "a", 1, 2), 0);
+    TEST_CHECK(-1 == gnt_difference(x, snapshot), 0);
+    TEST_CHECK(0 == gnt_destroy(snapshot), 0);
+    TEST_CHECK(0 == gnt_difference(x, y), 0);
+    TEST_CHECK(0 == gnt_search_bytes(x, "a", 1), 0);
+    
+    TEST_CHECK(0 == gnt_destroy(x), 0);
+    TEST_CHECK(0 == gnt_destroy(y), 0);
+    TEST_CHECK(0 == gnt_destroy(z), 0);
+}
+
+static gnt_trie_t* test_pair[2];
+
+static int test_forward(void* argument)
+{
+    (void) argument;
+    
+    for (size_t i = 0; i < TEST_LOCK_ROUNDS; i++)
+    {
+        gnt_intersect(test_pair[0], test_pair[1]);
+        gnt_difference(test_pair[0], test_pair[1]);
+    }
+    
+    return 0;
+}
+
+static int test_backward(void* argument)
+{
+    (void) argument;
+    
+    for (size_t i = 0; i < TEST_LOCK_ROUNDS; i++)
+    {
+        gnt_intersect(test_pair[1], test_pair[0]);
+        gnt_merge(test_pair[1], test_pair[0], NULL, NULL);
+        gnt_insert_bytes(test_pair[0], "k", 1, 1);
+    }
+    
+    return 0;
+}
+
+static void test_lock_order(void)
+{
+    // Calls on the same two tries in opposite directions must not deadlock
+    gnt_cfg_t cfg = {0};
+    cfg.flags = GNT_FLAG_SHARDED;
+    thrd_t forward;
+    thrd_t backward;
+    
+    test_pair[0] = gnt_create(&cfg);
+    test_pair[1] = gnt_create(&cfg);
+    TEST_CHECK(test_pair[0] && test_pair[1], cfg.flags);
+    TEST_CHECK(0 == gnt_insert_bytes(test_pair[0], "k", 1, 1), cfg.flags);
+    TEST_CHECK(0 == gnt_insert_bytes(test_pair[1], "k", 1, 2), cfg.flags);
+    TEST_CHECK(thrd_success == thrd_create(&forward, test_forward, NULL), cfg.flags);
+    TEST_CHECK(thrd_success == thrd_create(&backward, test_backward, NULL), cfg.flags);
+    TEST_CHECK(thrd_success == thrd_join(forward, NULL), cfg.flags);
+    TEST_CHECK(thrd_success == thrd_join(backward, NULL), cfg.flags);
+    TEST_CHECK(0 == gnt_destroy(test_pair[0]), cfg.flags);
+    TEST_CHECK(0 == gnt_destroy(test_pair[1]), cfg.flags);
+}
+
+int main(void)
+{
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS,
+        GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_WIDE_ROOT | GNT_FLAG_LAZY_DELETE
+    };
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        for (test_join_t join = TEST_MERGE; join <= TEST_DIFFERENCE; join++)
+        {
+            // Overlapping sets with short shared prefixes, deep chains, wide fanouts, and an empty side each way
+            test_run(flags[i], "abc", 12, 3000, 3000, join);
+            test_run(flags[i], "ab", 20, 2000, 500, join);
+            test_run(flags[i], "abcdefghijklmnopqrstuvwxyz0123456789", 14, 2000, 2000, join);
+            test_run(flags[i], "ab", 20, 0, 500, join);
+            test_run(flags[i], "ab", 20, 500, 0, join);
+        }
+    }
+    
+    test_refusals();
+    test_lock_order();
+    puts("test_merge: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/*
+ * test_prefix.c - Generic Nibble Trie prefix lookup and enumeration tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 2000
+#define TEST_STRING_SIZE 8 // Decimal keys of up to 6 digits and probes one digit longer
+
+typedef struct test_scan
+{
+    const char* prefix;
+    size_t length;
+    size_t next; // Lowest index the next key visited can have
+    size_t visited;
+    size_t limit; // Keys visited before the walk is stopped
+} test_scan_t;
+
+static char test_strings[TEST_KEYS][TEST_STRING_SIZE];
+static bool test_stored[TEST_KEYS];
+static size_t test_count;
+static gnt_flags_t test_flags;
+
+static int test_compare(const void* a, const void* b)
+{
+    return strcmp(a, b);
+}
+
+static size_t test_lower(const char* bytes, size_t length)
+{
+    // Index of the first key not below the bytes, in the byte order the trie keeps
+    size_t lo = 0;
+    size_t hi = test_count;
+    
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t other = strlen(test_strings[mid]);
+        int order = memcmp(test_strings[mid], bytes, other < length ? other : length);
+        
+        if (order < 0 || (0 == order && other < length))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    
+    return lo;
+}
+
+static bool test_starts(size_t index, const char* prefix, size_t length)
+{
+    return strlen(test_strings[index]) >= length && 0 == memcmp(test_strings[index], prefix, length);
+}
+
+static size_t test_longest(const char* bytes, size_t length)
+{
+    // Longest stored key that is a prefix of the bytes, test_count if there is none
+    for (size_t matched = length; matched > 0; matched--)
+    {
+        size_t index = test_lower(bytes, matched);
+        
+        if (index < test_count && test_stored[index] && strlen(test_strings[index]) == matched && test_starts(index, bytes, matched))
+        {
+            return index;
+        }
+    }
+    
+    return test_count;
+}
+
+static gnt_status_t test_visit(const gnt_byte_t* key, gnt_index_t length, gnt_data_t data, void* context)
+{
+    test_scan_t* scan = context;
+    size_t index = scan->next;
+    
+    while (index < test_count && !test_stored[index])
+    {
+        index++;
+    }
+    
+    TEST_CHECK(index < test_count && test_starts(index, scan->prefix, scan->length), test_flags);
+    TEST_CHECK(data == (gnt_data_t) index + 1, test_flags);
+    TEST_CHECK(length == strlen(test_strings[index]) && 0 == memcmp(key, test_strings[index], length), test_flags);
+    scan->next = index + 1;
+    
+    return ++scan->visited == scan->limit;
+}
+
+static void test_enumerate(gnt_trie_t* trie, const char* prefix, size_t limit)
+{
+    // The keys starting with the prefix are one run of the sorted keys
+    size_t length = strlen(prefix);
+    size_t first = test_lower(prefix, length);
+    test_scan_t scan = {prefix, length, first, 0, limit};
+    size_t expected = 0;
+    
+    for (size_t i = first; i < test_count && test_starts(i, prefix, length); i++)
+    {
+        expected += test_stored[i];
+    }
+    
+    expected = expected < limit ? expected : limit;
+    
+    if (length)
+    {
+        TEST_CHECK(0 == gnt_prefix_foreach(trie, (gnt_key_t) prefix, test_visit, &scan), test_flags);
+        TEST_CHECK(scan.visited == expected, test_flags);
+        scan.next = first;
+        scan.visited = 0;
+    }
+    
+    TEST_CHECK(0 == gnt_prefix_foreach_bytes(trie, prefix, length, test_visit, &scan), test_flags);
+    TEST_CHECK(scan.visited == expected, test_flags);
+}
+
+static void test_match(gnt_trie_t* trie, const char* probe)
+{
+    size_t length = strlen(probe);
+    size_t index = test_longest(probe, length);
+    gnt_index_t matched = 12345;
+    gnt_data_t expected = index < test_count ? (gnt_data_t) index + 1 : 0;
+    
+    TEST_CHECK(gnt_longest_prefix(trie, (gnt_key_t) probe, &matched) == expected, test_flags);
+    TEST_CHECK(matched == (index < test_count ? strlen(test_strings[index]) : 0), test_flags);
+    TEST_CHECK(gnt_longest_prefix_bytes(trie, probe, length, NULL) == expected, test_flags);
+}
+
+static void test_verify(gnt_trie_t* trie, uint64_t* seed)
+{
+    char probe[TEST_STRING_SIZE];
+    
+    for (size_t i = 0; i < test_count; i++)
+    {
+        // The key itself, the key extended by a digit, and the key cut short
+        size_t length = strlen(test_strings[i]);
+        
+        test_match(trie, test_strings[i]);
+        snprintf(probe, sizeof(probe), "%s%u", test_strings[i], (unsigned) (test_random(seed) % 10));
+        test_match(trie, probe);
+        memcpy(probe, test_strings[i], length - 1);
+        probe[length - 1] = '\0';
+        
+        if (length > 1)
+        {
+            test_match(trie, probe);
+        }
+    }
+    
+    for (uint16_t round = 0; round < 500; round++)
+    {
+        snprintf(probe, sizeof(probe), "%u", (unsigned) (test_random(seed) % 10000000));
+        test_match(trie, probe);
+        
+        // Prefixes of every length, stored or not, and some holding no key
+        probe[test_random(seed) % 5] = '\0';
+        test_enumerate(trie, probe, SIZE_MAX);
+        test_enumerate(trie, probe, 1 + test_random(seed) % 4);
+    }
+    
+    test_enumerate(trie, "", SIZE_MAX);
+    test_enumerate(trie, "x", SIZE_MAX);
+    test_enumerate(trie, "1234567", SIZE_MAX);
+    test_match(trie, "x");
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.span_accessor = gnt_span_accessor_string;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    
+    TEST_CHECK(trie, flags);
+    test_flags = flags;
+    
+    for (size_t i = 0; i < test_count; i++)
+    {
+        TEST_CHECK(0 == gnt_insert(trie, (gnt_key_t) test_strings[i], (gnt_data_t) i + 1), flags);
+        test_stored[i] = true;
+    }
+    
+    test_verify(trie, &seed);
+    
+    // Deleted keys stop matching, their longer and shorter neighbours still do
+    for (size_t i = 0; i < test_count; i++)
+    {
+        if (test_random(&seed) % 3 == 0)
+        {
+            TEST_CHECK(0 == gnt_delete(trie, (gnt_key_t) test_strings[i]), flags);
+            test_stored[i] = false;
+        }
+    }
+    
+    test_verify(trie, &seed);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_COMPRESS,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS
+    };
+    
+    // Keys of every length up to 6 digits, so that many are prefixes of others
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        size_t digits = 1 + test_random(&seed) % 6;
+        
+        for (size_t digit = 0; digit < digits; digit++)
+        {
+            test_strings[i][digit] = (char) ('0' + test_random(&seed) % 10);
+        }
+        
+        test_strings[i][digits] = '\0';
+    }
+    
+    qsort(test_strings, TEST_KEYS, TEST_STRING_SIZE, test_compare);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (!test_count || strcmp(test_strings[test_count - 1], test_strings[i]))
+        {
+            memcpy(test_strings[test_count++], test_strings[i], TEST_STRING_SIZE);
+        }
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_prefix: ok");
+    
+    return EXIT_SUCCESS;
+}
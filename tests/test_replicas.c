@@ -0,0 +1,231 @@
+/*
+ * test_replicas.c - Generic Nibble Trie read replica tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <time.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_BASE_KEYS 1000 // Keys stored before the replicas are created
+#define TEST_KEYS 20000 // Keys rewritten while readers race the refreshes
+#define TEST_READERS 4
+#define TEST_LAG_MS 500
+
+typedef struct test_race // Trie written by the main thread while readers search its replicas
+{
+    gnt_trie_t* trie;
+    gnt_replicas_t* replicas;
+    atomic_bool done;
+    atomic_size_t wrong;
+    atomic_size_t reads;
+} test_race_t;
+
+typedef struct test_reader
+{
+    test_race_t* race;
+    uint64_t seed;
+} test_reader_t;
+
+static atomic_size_t test_placed[2];
+
+static void* test_allocate_first(size_t size)
+{
+    atomic_fetch_add(&test_placed[0], 1);
+    
+    return malloc(size);
+}
+
+static void* test_allocate_second(size_t size)
+{
+    atomic_fetch_add(&test_placed[1], 1);
+    
+    return malloc(size);
+}
+
+static size_t test_key(char* key, size_t index)
+{
+    return (size_t) snprintf(key, 32, "k%zu", index);
+}
+
+static void test_sleep(uint32_t ms)
+{
+    thrd_sleep(&(struct timespec) {.tv_sec = ms / 1000, .tv_nsec = (long) (ms % 1000) * 1000000}, NULL);
+}
+
+static int test_read(void* argument)
+{
+    test_reader_t* reader = argument;
+    test_race_t* race = reader->race;
+    char key[32];
+    
+    // A replica may lag, but only ever holds data some write stored for the key
+    while (!atomic_load(&race->done))
+    {
+        size_t index = test_random(&reader->seed) % TEST_KEYS;
+        size_t length = test_key(key, index);
+        gnt_data_t data = gnt_replicas_search_bytes(race->replicas, key, length);
+        gnt_pin_t pin;
+        
+        if (data && data != (gnt_data_t) index + 1 && data != (gnt_data_t) index + 2)
+        {
+            atomic_fetch_add(&race->wrong, 1);
+        }
+        
+        TEST_CHECK(0 == gnt_replicas_enter(race->replicas, &pin), 0);
+        data = gnt_search_bytes(pin.trie, key, length);
+        TEST_CHECK(0 == gnt_replicas_exit(&pin), 0);
+        
+        if (data && data != (gnt_data_t) index + 1 && data != (gnt_data_t) index + 2)
+        {
+            atomic_fetch_add(&race->wrong, 1);
+        }
+        
+        atomic_fetch_add(&race->reads, 1);
+    }
+    
+    return 0;
+}
+
+static void test_fresh(gnt_trie_t* trie)
+{
+    // Without lag, every read after a write sees it
+    gnt_replicas_cfg_t cfg = {2, NULL, NULL, 0};
+    gnt_replicas_t* replicas = gnt_replicas_create(trie, &cfg);
+    gnt_pin_t pin;
+    
+    TEST_CHECK(replicas, 0);
+    TEST_CHECK(!gnt_replicas_create(trie, &cfg), 0);
+    TEST_CHECK(-1 == gnt_destroy(trie), 0);
+    TEST_CHECK(5 == gnt_replicas_search_bytes(replicas, "k4", 2), 0);
+    TEST_CHECK(0 == gnt_replicas_enter(replicas, &pin), 0);
+    TEST_CHECK(pin.trie != trie, 0);
+    TEST_CHECK(0 == gnt_replicas_exit(&pin), 0);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "new", 3, 77), 0);
+    TEST_CHECK(77 == gnt_replicas_search_bytes(replicas, "new", 3), 0);
+    TEST_CHECK(0 == gnt_delete_bytes(trie, "new", 3), 0);
+    TEST_CHECK(0 == gnt_replicas_search_bytes(replicas, "new", 3), 0);
+    TEST_CHECK(0 == gnt_replicas_destroy(replicas), 0);
+}
+
+static void test_lag(gnt_trie_t* trie)
+{
+    // Reads stay behind writes until the lag has passed or the replicas are synced
+    gnt_allocator_t allocators[] = {test_allocate_first, test_allocate_second};
+    gnt_replicas_cfg_t cfg = {2, allocators, free, TEST_LAG_MS};
+    gnt_replicas_t* replicas = gnt_replicas_create(trie, &cfg);
+    
+    TEST_CHECK(replicas, 0);
+    TEST_CHECK(5 == gnt_replicas_search_bytes(replicas, "k4", 2), 0);
+    TEST_CHECK(atomic_load(&test_placed[0]) + atomic_load(&test_placed[1]) > 0, 0);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "late", 4, 9), 0);
+    TEST_CHECK(0 == gnt_replicas_search_bytes(replicas, "late", 4), 0);
+    test_sleep(TEST_LAG_MS + 100);
+    TEST_CHECK(9 == gnt_replicas_search_bytes(replicas, "late", 4), 0);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "late", 4, 10), 0);
+    TEST_CHECK(0 == gnt_replicas_sync(replicas), 0);
+    TEST_CHECK(10 == gnt_replicas_search_bytes(replicas, "late", 4), 0);
+    
+    // Syncing builds every replica, each through its own allocator
+    TEST_CHECK(atomic_load(&test_placed[0]) > 0 && atomic_load(&test_placed[1]) > 0, 0);
+    TEST_CHECK(0 == gnt_replicas_destroy(replicas), 0);
+}
+
+static void test_race(gnt_trie_t* trie)
+{
+    gnt_replicas_cfg_t cfg = {1, NULL, NULL, 1};
+    test_race_t race = {trie, gnt_replicas_create(trie, &cfg), false, 0, 0};
+    test_reader_t readers[TEST_READERS];
+    thrd_t threads[TEST_READERS];
+    char key[32];
+    
+    TEST_CHECK(race.replicas, 0);
+    
+    for (size_t i = 0; i < TEST_READERS; i++)
+    {
+        readers[i] = (test_reader_t) {&race, i + 1};
+        TEST_CHECK(thrd_success == thrd_create(&threads[i], test_read, &readers[i]), 0);
+    }
+    
+    for (size_t pass = 0; pass < 3; pass++)
+    {
+        for (size_t i = 0; i < TEST_KEYS; i++)
+        {
+            TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), (gnt_data_t) (i + 1 + pass % 2)), 0);
+            
+            if (0 == i % 5000)
+            {
+                thrd_yield();
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < TEST_KEYS; i += 2)
+    {
+        TEST_CHECK(0 == gnt_delete_bytes(trie, key, test_key(key, i)), 0);
+    }
+    
+    test_sleep(50);
+    atomic_store(&race.done, true);
+    
+    for (size_t i = 0; i < TEST_READERS; i++)
+    {
+        TEST_CHECK(thrd_success == thrd_join(threads[i], NULL), 0);
+    }
+    
+    TEST_CHECK(atomic_load(&race.reads) > 0, 0);
+    TEST_CHECK(0 == atomic_load(&race.wrong), 0);
+    
+    // Once the lag has passed, the replica holds the last writes
+    test_sleep(5);
+    TEST_CHECK(0 == gnt_replicas_search_bytes(race.replicas, "k0", 2), 0);
+    TEST_CHECK(2 == gnt_replicas_search_bytes(race.replicas, "k1", 2), 0);
+    TEST_CHECK(0 == gnt_replicas_destroy(race.replicas), 0);
+}
+
+int main(void)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_WIDE_ROOT;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    char key[32];
+    
+    TEST_CHECK(trie, cfg.flags);
+    
+    for (size_t i = 0; i < TEST_BASE_KEYS; i++)
+    {
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), (gnt_data_t) i + 1), cfg.flags);
+    }
+    
+    test_fresh(trie);
+    test_lag(trie);
+    test_race(trie);
+    TEST_CHECK(0 == gnt_destroy(trie), cfg.flags);
+    puts("test_replicas: ok");
+    
+    return EXIT_SUCCESS;
+}
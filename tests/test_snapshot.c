@@ -0,0 +1,192 @@
+/*
+ * test_snapshot.c - Generic Nibble Trie snapshot tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 4000
+#define TEST_IDS (4 * TEST_KEYS + 2) // Data are unique ids, each must reach the deallocator exactly once
+
+static bool test_released[TEST_IDS];
+static size_t test_count;
+
+static void test_deallocator(gnt_data_t data)
+{
+    TEST_CHECK(data > 0 && data < TEST_IDS && !test_released[data], 0);
+    test_released[data] = true;
+    test_count++;
+}
+
+static size_t test_key(char* key, size_t index)
+{
+    return (size_t) snprintf(key, 32, "key/%zu/%zu", index % 7, index);
+}
+
+static gnt_status_t test_double(const gnt_byte_t* key, gnt_index_t length, gnt_data_t* data, void* context)
+{
+    (void) key;
+    (void) length;
+    
+    // Values rewritten in place are never handed to the deallocator
+    ((bool*) context)[*data] = false;
+    *data += 2 * TEST_KEYS;
+    ((bool*) context)[*data] = true;
+    
+    return 0;
+}
+
+static void test_verify(gnt_trie_t* trie, const gnt_data_t* model, gnt_flags_t flags)
+{
+    char key[32];
+    gnt_stats_t stats;
+    size_t values = 0;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(gnt_search_bytes(trie, key, test_key(key, i)) == model[i], flags);
+        values += !!model[i];
+    }
+    
+    TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+    TEST_CHECK(stats.values == values, flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_data_t first[TEST_KEYS];
+    gnt_data_t second[TEST_KEYS];
+    gnt_data_t current[TEST_KEYS];
+    bool stored[TEST_IDS] = {0}; // Data the trie must release by the end
+    char key[32];
+    
+    TEST_CHECK(trie, flags);
+    memset(test_released, 0, sizeof(test_released));
+    test_count = 0;
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        first[i] = i + 1;
+        stored[first[i]] = true;
+        TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), first[i]), flags);
+    }
+    
+    gnt_trie_t* older = gnt_snapshot(trie);
+    TEST_CHECK(older, flags);
+    
+    // Snapshots are read-only and keep the trie from being destroyed or cleared
+    TEST_CHECK(-1 == gnt_insert_bytes(older, "x", 1, 1), flags);
+    TEST_CHECK(-1 == gnt_delete_bytes(older, key, test_key(key, 0)), flags);
+    TEST_CHECK(-1 == gnt_clear(trie), flags);
+    TEST_CHECK(-1 == gnt_destroy(trie), flags);
+    
+    // Overwrites, deletes and new keys, then a second snapshot of that state
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (i % 3 == 0)
+        {
+            TEST_CHECK(0 == gnt_insert_bytes(trie, key, test_key(key, i), i + 1 + TEST_KEYS), flags);
+            second[i] = i + 1 + TEST_KEYS;
+            stored[second[i]] = true;
+        }
+        else if (i % 3 == 1)
+        {
+            TEST_CHECK(0 == gnt_delete_bytes(trie, key, test_key(key, i)), flags);
+            second[i] = 0;
+        }
+        else
+        {
+            second[i] = first[i];
+        }
+    }
+    
+    // Data replaced or deleted under a snapshot stays readable through it
+    TEST_CHECK(0 == test_count, flags);
+    gnt_trie_t* newer = gnt_snapshot(trie);
+    TEST_CHECK(newer, flags);
+    
+    // A whole-trie pass owns every node before rewriting the values
+    TEST_CHECK(0 == gnt_foreach(trie, test_double, stored), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        current[i] = second[i] ? second[i] + 2 * TEST_KEYS : 0;
+        
+        // Deleting the rest of what is left empties the trie
+        if (current[i] && i % 2)
+        {
+            TEST_CHECK(0 == gnt_delete_bytes(trie, key, test_key(key, i)), flags);
+            current[i] = 0;
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    test_verify(older, first, flags);
+    test_verify(newer, second, flags);
+    test_verify(trie, current, flags);
+    
+    // Closing the older snapshot releases only what no newer one still reads
+    TEST_CHECK(0 == gnt_destroy(older), flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        TEST_CHECK(test_released[first[i]] == (first[i] != second[i]), flags);
+    }
+    
+    test_verify(newer, second, flags);
+    TEST_CHECK(-1 == gnt_clear(trie), flags);
+    TEST_CHECK(0 == gnt_destroy(newer), flags);
+    
+    // Without snapshots left, the trie can be cleared and reused
+    TEST_CHECK(0 == gnt_clear(trie), flags);
+    memset(current, 0, sizeof(current));
+    test_verify(trie, current, flags);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "again", 5, TEST_IDS - 1), flags);
+    stored[TEST_IDS - 1] = true;
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    
+    for (gnt_data_t id = 1; id < TEST_IDS; id++)
+    {
+        TEST_CHECK(test_released[id] == stored[id], flags);
+    }
+}
+
+int main(void)
+{
+    for (gnt_flags_t flags = 0; flags <= (GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK | GNT_FLAG_SHARDED | GNT_FLAG_WIDE_ROOT | GNT_FLAG_LAZY_DELETE); flags++)
+    {
+        test_run(flags);
+    }
+    
+    puts("test_snapshot: ok");
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+/*
+ * test_stats.c - Generic Nibble Trie statistics tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 5000
+#define TEST_STRING_SIZE 16
+
+static void test_expect(gnt_trie_t* trie, size_t nibbles, size_t nodes, size_t values, size_t max_depth, gnt_flags_t flags)
+{
+    gnt_stats_t stats;
+    
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(stats.nibbles == nibbles && stats.nodes == nodes, flags);
+    TEST_CHECK(stats.values == values && stats.max_depth == max_depth, flags);
+}
+
+static void test_small(gnt_flags_t flags)
+{
+    // Shapes small enough to count by hand, "abcdef" only takes one node below "ab" once compressed
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    bool compress = flags & GNT_FLAG_COMPRESS;
+    gnt_stats_t stats;
+    
+    TEST_CHECK(trie, flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(0 == stats.nibbles && 0 == stats.nodes && 0 == stats.values && 0 == stats.live, flags);
+    TEST_CHECK(0 == stats.wasted && 0 == stats.average_depth && 0 == stats.max_depth && stats.bytes > 0, flags);
+    
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "a", 1, 1), flags);
+    test_expect(trie, 1, 1, 1, 1, flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(1 == stats.nibble_fanout[1] && 1 == stats.node_fanout[0] && 1.0 == stats.average_depth, flags);
+    TEST_CHECK(stats.live > 0 && stats.live <= stats.bytes, flags);
+    
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "ab", 2, 2), flags);
+    test_expect(trie, 2, 2, 2, 2, flags);
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "abcdef", 6, 3), flags);
+    test_expect(trie, compress ? 3 : 6, compress ? 3 : 6, 3, 6, flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, false), flags);
+    TEST_CHECK(3.0 == stats.average_depth && 0 == stats.max_depth && 0 == stats.node_fanout[0], flags);
+    
+    // A second key below "ab" splits the compressed chain
+    TEST_CHECK(0 == gnt_insert_bytes(trie, "abcxyz", 6, 4), flags);
+    test_expect(trie, compress ? 5 : 9, compress ? 5 : 9, 4, 6, flags);
+    
+    TEST_CHECK(0 == gnt_delete_bytes(trie, "abcxyz", 6), flags);
+    TEST_CHECK(0 == gnt_delete_bytes(trie, "abcdef", 6), flags);
+    TEST_CHECK(0 == gnt_delete_bytes(trie, "a", 1), flags);
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    
+    // Once compressed, "ab" is left alone and merges into a single node
+    test_expect(trie, compress ? 1 : 2, compress ? 1 : 2, 1, 2, flags);
+    
+    TEST_CHECK(0 == gnt_delete_bytes(trie, "ab", 2), flags);
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(0 == stats.nibbles && 0 == stats.nodes && 0 == stats.values && 0 == stats.live, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    char strings[TEST_KEYS][TEST_STRING_SIZE];
+    size_t lengths[TEST_KEYS];
+    bool stored[TEST_KEYS] = {false};
+    uint64_t seed = flags + 1;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_stats_t stats;
+    gnt_stats_t quick;
+    
+    TEST_CHECK(trie, flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        lengths[i] = 1 + test_random(&seed) % (TEST_STRING_SIZE - 1);
+        
+        for (size_t j = 0; j < lengths[i]; j++)
+        {
+            strings[i][j] = (char) ('a' + test_random(&seed) % (j < 3 ? 4 : 26));
+        }
+        
+        // Short keys repeat, only the first copy is stored
+        if (gnt_search_bytes(trie, strings[i], lengths[i]))
+        {
+            continue;
+        }
+        
+        TEST_CHECK(0 == gnt_insert_bytes(trie, strings[i], lengths[i], (gnt_data_t) i + 1), flags);
+        stored[i] = true;
+        
+        if (0 == test_random(&seed) % 3)
+        {
+            TEST_CHECK(0 == gnt_delete_bytes(trie, strings[i], lengths[i]), flags);
+            stored[i] = false;
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    
+    // Counts match the keys a cursor walks, whose lengths give the depths
+    gnt_cursor_t cursor;
+    size_t values = 0;
+    size_t key_bytes = 0;
+    size_t max_depth = 0;
+    uint16_t roots = 0;
+    
+    TEST_CHECK(0 == gnt_cursor_init(&cursor, trie), flags);
+    
+    while (0 == gnt_next(&cursor))
+    {
+        values++;
+        key_bytes += cursor.length;
+        max_depth = cursor.length > max_depth ? cursor.length : max_depth;
+        roots |= 1u << (cursor.key[0] >> 4);
+    }
+    
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(0 == gnt_stats(trie, &quick, false), flags);
+    TEST_CHECK(stats.values == values && stats.max_depth == max_depth, flags);
+    TEST_CHECK(stats.average_depth * values > key_bytes - 0.5 && stats.average_depth * values < key_bytes + 0.5, flags);
+    
+    // The fanouts add up to the counts, each node fills one slot of a nibble and each nibble below the root one of a node
+    size_t nibbles = 0;
+    size_t nodes = 0;
+    size_t nibble_slots = 0;
+    size_t node_slots = 0;
+    
+    for (uint8_t k = 0; k <= 16; k++)
+    {
+        nibbles += stats.nibble_fanout[k];
+        nodes += stats.node_fanout[k];
+        nibble_slots += k * stats.nibble_fanout[k];
+        node_slots += k * stats.node_fanout[k];
+    }
+    
+    TEST_CHECK(nibbles == stats.nibbles && nodes == stats.nodes, flags);
+    TEST_CHECK(nibble_slots == stats.nodes, flags);
+    TEST_CHECK(node_slots + __builtin_popcount(roots) == stats.nibbles, flags);
+    TEST_CHECK(0 == stats.nibble_fanout[0] && 0 == stats.wasted % sizeof(void*), flags);
+    
+    // Without the shape pass, the same counts and no histograms
+    TEST_CHECK(quick.nibbles == stats.nibbles && quick.nodes == stats.nodes && quick.values == stats.values, flags);
+    TEST_CHECK(quick.bytes == stats.bytes && quick.live == stats.live && quick.wasted == stats.wasted, flags);
+    TEST_CHECK(0 == quick.max_depth && 0 == quick.nibble_fanout[1] && 0 == quick.node_fanout[0], flags);
+    TEST_CHECK(stats.live > 0 && stats.live < stats.bytes, flags);
+    
+    // A snapshot counts the shape it was taken with, not the writes after it
+    gnt_trie_t* snapshot = gnt_snapshot(trie);
+    gnt_stats_t taken;
+    
+    TEST_CHECK(snapshot, flags);
+    
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        if (stored[i])
+        {
+            TEST_CHECK(0 == gnt_delete_bytes(trie, strings[i], lengths[i]), flags);
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_stats(snapshot, &taken, true), flags);
+    TEST_CHECK(taken.values == stats.values && taken.nodes == stats.nodes && taken.nibbles == stats.nibbles, flags);
+    TEST_CHECK(taken.max_depth == stats.max_depth && taken.average_depth == stats.average_depth, flags);
+    TEST_CHECK(0 == gnt_destroy(snapshot), flags);
+    
+    TEST_CHECK(0 == gnt_compact(trie, 0), flags);
+    TEST_CHECK(0 == gnt_stats(trie, &stats, true), flags);
+    TEST_CHECK(0 == stats.nibbles && 0 == stats.nodes && 0 == stats.values && 0 == stats.live && 0 == stats.wasted, flags);
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+}
+
+int main(void)
+{
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMPRESS | GNT_FLAG_RWLOCK,
+        GNT_FLAG_WIDE_ROOT,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS
+    };
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_small(flags[i]);
+        test_run(flags[i]);
+    }
+    
+    puts("test_stats: ok");
+    
+    return EXIT_SUCCESS;
+}
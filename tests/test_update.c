@@ -0,0 +1,190 @@
+/*
+ * test_update.c - Generic Nibble Trie update and found-aware search tests
+ *
+ * Copyright (c) 2024 Laurent Mailloux-Bourassa
+ *
+ * This file is part of the Generic Nibble Trie (GNT) library.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "gnt.h"
+#include "test.h"
+
+#define TEST_KEYS 700 // Distinct keys counted, each one is updated many times
+#define TEST_UPDATES 20000
+
+static uint64_t test_keys[TEST_KEYS];
+static size_t test_counts[TEST_KEYS];
+static size_t test_released;
+static size_t test_calls;
+static gnt_flags_t test_flags;
+
+static void test_deallocator(gnt_data_t data)
+{
+    (void) data;
+    test_released++;
+}
+
+static void test_count(gnt_data_t* data, bool found, void* context)
+{
+    // The updater sees the stored count, or 0 for a key it is about to store
+    size_t index = *(size_t*) context;
+    
+    TEST_CHECK(found == (test_counts[index] > 0), test_flags);
+    TEST_CHECK(*data == test_counts[index], test_flags);
+    test_calls++;
+    (*data)++;
+}
+
+static void test_zero(gnt_data_t* data, bool found, void* context)
+{
+    (void) context;
+    TEST_CHECK(!found && 0 == *data, test_flags);
+}
+
+static void test_verify(gnt_trie_t* trie, const size_t* counts)
+{
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        bool found = !counts[i];
+        
+        TEST_CHECK(gnt_search_ex(trie, (gnt_key_t) test_keys[i], &found) == counts[i], test_flags);
+        TEST_CHECK(found == (counts[i] > 0), test_flags);
+        TEST_CHECK(gnt_search_ex(trie, (gnt_key_t) test_keys[i], NULL) == counts[i], test_flags);
+    }
+}
+
+static void test_run(gnt_flags_t flags)
+{
+    uint64_t seed = flags + 1;
+    size_t counts[TEST_KEYS];
+    size_t stored = 0;
+    gnt_cfg_t cfg = {0};
+    cfg.flags = flags;
+    cfg.deallocator = test_deallocator;
+    gnt_trie_t* trie = gnt_create(&cfg);
+    gnt_trie_t* snapshot = NULL;
+    bool found = true;
+    
+    TEST_CHECK(trie, flags);
+    test_flags = flags;
+    test_released = 0;
+    test_calls = 0;
+    memset(test_counts, 0, sizeof(test_counts));
+    
+    TEST_CHECK(-1 == gnt_update(trie, (gnt_key_t) test_keys[0], NULL, NULL), flags);
+    TEST_CHECK(0 == gnt_search_ex(trie, (gnt_key_t) test_keys[0], &found) && !found, flags);
+    
+    for (size_t i = 0; i < TEST_UPDATES; i++)
+    {
+        size_t index = test_random(&seed) % TEST_KEYS;
+        
+        TEST_CHECK(0 == gnt_update(trie, (gnt_key_t) test_keys[index], test_count, &index), flags);
+        stored += !test_counts[index];
+        test_counts[index]++;
+        
+        // Writers copy what they change out of an open snapshot, which keeps the counts it was taken with
+        if (TEST_UPDATES / 2 == i)
+        {
+            memcpy(counts, test_counts, sizeof(counts));
+            TEST_CHECK(snapshot = gnt_snapshot(trie), flags);
+        }
+    }
+    
+    TEST_CHECK(TEST_UPDATES == test_calls, flags);
+    TEST_CHECK(0 == test_released, flags);
+    test_verify(trie, test_counts);
+    test_verify(snapshot, counts);
+    TEST_CHECK(-1 == gnt_update(snapshot, (gnt_key_t) test_keys[0], test_zero, NULL), flags);
+    TEST_CHECK(0 == gnt_destroy(snapshot), flags);
+    
+    // A stored 0 is found, unlike a missing key, whether it was inserted or left by an updater
+    uint64_t zero = TEST_KEYS;
+    uint64_t absent = TEST_KEYS + 1;
+    
+    TEST_CHECK(0 == gnt_insert(trie, (gnt_key_t) zero, 0), flags);
+    TEST_CHECK(0 == gnt_search_ex(trie, (gnt_key_t) zero, &found) && found, flags);
+    TEST_CHECK(0 == gnt_search_ex(trie, (gnt_key_t) absent, &found) && !found, flags);
+    TEST_CHECK(0 == gnt_update(trie, (gnt_key_t) absent, test_zero, NULL), flags);
+    TEST_CHECK(0 == gnt_search_ex(trie, (gnt_key_t) absent, &found) && found, flags);
+    stored += 2;
+    
+    // Deleted keys are new again to the next update
+    for (size_t i = 0; i < TEST_KEYS; i += 3)
+    {
+        if (test_counts[i])
+        {
+            TEST_CHECK(0 == gnt_delete(trie, (gnt_key_t) test_keys[i]), flags);
+            test_counts[i] = 0;
+            stored--;
+        }
+    }
+    
+    TEST_CHECK(0 == gnt_delete(trie, (gnt_key_t) absent), flags);
+    TEST_CHECK(0 == gnt_search_ex(trie, (gnt_key_t) absent, &found) && !found, flags);
+    stored--;
+    test_verify(trie, test_counts);
+    
+    for (size_t index = 0; index < TEST_KEYS; index += 3)
+    {
+        TEST_CHECK(0 == gnt_update(trie, (gnt_key_t) test_keys[index], test_count, &index), flags);
+        test_counts[index]++;
+        stored++;
+    }
+    
+    test_verify(trie, test_counts);
+    
+    // Updates never released the data they replaced, the deletes and the destroy release the rest once
+    size_t deleted = test_released;
+    
+    TEST_CHECK(0 == gnt_destroy(trie), flags);
+    TEST_CHECK(test_released == deleted + stored, flags);
+}
+
+int main(void)
+{
+    uint64_t seed = 1;
+    const gnt_flags_t flags[] = {
+        0,
+        GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_RWLOCK,
+        GNT_FLAG_FIXED_WIDTH | GNT_FLAG_COMPRESS,
+        GNT_FLAG_WIDE_ROOT | GNT_FLAG_SHARDED,
+        GNT_FLAG_LAZY_DELETE | GNT_FLAG_COMPRESS,
+        GNT_FLAG_SHARDED | GNT_FLAG_COMBINING
+    };
+    
+    // Distinct keys of every length, their remainders leave room for two more
+    for (size_t i = 0; i < TEST_KEYS; i++)
+    {
+        test_keys[i] = (test_random(&seed) >> (i % 56)) / (2 * TEST_KEYS) * (2 * TEST_KEYS) + i;
+    }
+    
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        test_run(flags[i]);
+    }
+    
+    puts("test_update: ok");
+    
+    return EXIT_SUCCESS;
+}